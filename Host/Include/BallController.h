@@ -0,0 +1,17 @@
+#pragma once
+
+/***********************************************************************************************
+* Host stand-in of the ball controller of the robot firmware
+* This class implements following futures:
+* 1. Keeps the last written kick, chip and dribble values so tests can inspect them
+************************************************************************************************/
+class BallController
+{
+public:
+	float kick = 0.0f;
+	float chip = 0.0f;
+	float dribble = 0.0f;
+
+	void init();
+	void write_data_to_ball_controller(float, float, float);
+};
@@ -0,0 +1,24 @@
+#pragma once
+#include <stdint.h>
+
+/***********************************************************************************************/
+// udp_settings namespace contains the settings of the command datagrams
+namespace udp_settings {
+	const uint32_t UDP_BUFFER_SIZE = 256;
+};
+/***********************************************************************************************/
+
+
+/***********************************************************************************************
+* Host stand-in of the network controller of the robot firmware
+* This class implements following futures:
+* 1. "Connects" immediately: sets is_connected
+* 2. Receives no datagram, the robot receives the commands on its hal command socket
+*    (see Robot::open_command_socket() and hal_sim::LoopbackUdpServer)
+************************************************************************************************/
+class NetworkController
+{
+public:
+	void connect_to_wifi(const char*, const char*);
+	uint32_t receive_udp_packet(uint8_t*);
+};
@@ -0,0 +1,52 @@
+#pragma once
+#include <stdint.h>
+
+/***********************************************************************************************
+* Host stand-in of the protobuf parser of the robot firmware
+* The messages and the field tags mirror the nanopb generated header of the command schema
+************************************************************************************************/
+typedef struct _Move {
+	float x;
+	float y;
+	float r;
+} Move;
+
+typedef struct _Action {
+	float kick;
+	float chip;
+	float dribble;
+} Action;
+
+typedef struct _Command {
+	Move move;
+	Action action;
+	uint32_t sequence;
+} Command;
+
+#define Move_init_zero     {0, 0, 0}
+#define Action_init_zero   {0, 0, 0}
+#define Command_init_zero  {Move_init_zero, Action_init_zero, 0}
+
+#define Move_x_tag         1
+#define Move_y_tag         2
+#define Move_r_tag         3
+#define Action_kick_tag    1
+#define Action_chip_tag    2
+#define Action_dribble_tag 3
+#define Command_move_tag   1
+#define Command_action_tag 2
+#define Command_sequence_tag 3
+
+
+/***********************************************************************************************
+* ProtobufParser class decodes a command datagram with a generic protobuf wire format reader
+* This class implements following futures:
+* 1. Decodes the Move and Action submessages and the sequence number
+* 2. Skips unknown fields of every wire type
+* 3. Rejects truncated packets
+************************************************************************************************/
+class ProtobufParser
+{
+public:
+	bool parse_udp_packet(uint8_t*, Command&, uint32_t);
+};
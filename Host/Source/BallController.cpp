@@ -0,0 +1,15 @@
+#include "BallController.h"
+
+void BallController::init()
+{
+	kick = 0.0f;
+	chip = 0.0f;
+	dribble = 0.0f;
+}
+
+void BallController::write_data_to_ball_controller(float kick_speed, float chip_speed, float dribble_speed)
+{
+	kick = kick_speed;
+	chip = chip_speed;
+	dribble = dribble_speed;
+}
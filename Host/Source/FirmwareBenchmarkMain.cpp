@@ -0,0 +1,41 @@
+#include "FirmwareBenchmark.h"
+#include <stdlib.h>
+#include <string.h>
+
+/****************************************************************************************************************
+* host benchmark tool of the firmware hot paths
+* usage: firmware_benchmark [baseline file] [--update-baseline] [--threshold fraction] [--no-timing]
+* the exit code is 0 if no benchmark regressed the baseline, see FirmwareBenchmark::run()
+* --no-timing checks the allocations, bus bytes and stack only, ns/op is host dependent
+*****************************************************************************************************************/
+static const char* const DEFAULT_BASELINE_PATH = "FirmwareBenchmarkBaseline.txt";
+
+static FirmwareBenchmark benchmark;
+
+int main(int argc, char** argv)
+{
+	const char* baseline_path = DEFAULT_BASELINE_PATH;
+	bool update_baseline = false;
+	float threshold = BENCHMARK_SETTINGS::DEFAULT_THRESHOLD;
+
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--update-baseline") == 0) {
+			update_baseline = true;
+		}
+		else if (strcmp(argv[i], "--threshold") == 0 && i + 1 < argc) {
+			threshold = strtof(argv[++i], nullptr);
+		}
+		else if (strcmp(argv[i], "--no-timing") == 0) {
+			threshold = BENCHMARK_SETTINGS::NO_TIMING_THRESHOLD;
+		}
+		else if (argv[i][0] != '-') {
+			baseline_path = argv[i];
+		}
+		else {
+			hal::log("usage: %s [baseline file] [--update-baseline] [--threshold fraction] [--no-timing]\n", argv[0]);
+			return 2;
+		}
+	}
+
+	return benchmark.run(baseline_path, update_baseline, threshold);
+}
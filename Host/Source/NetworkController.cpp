@@ -0,0 +1,25 @@
+#include "NetworkController.h"
+#include "Hal.h"
+
+// connection flag of the robot firmware (see Robot.cpp)
+extern volatile uint8_t is_connected;
+
+/*************************************************************************************************************************
+* Descrition: connect_to_wifi() function "associates" with the server network, the host is always associated
+* Pre: none
+* Post: is_connected is set
+**************************************************************************************************************************/
+void NetworkController::connect_to_wifi(const char*, const char*)
+{
+	is_connected = 1;
+}
+
+/*************************************************************************************************************************
+* Descrition: receive_udp_packet() function receives the next command datagram of the wifi stack
+* Pre: buffer holds udp_settings::UDP_BUFFER_SIZE bytes
+* Post: 0 is returned, the host has no wifi stack, the command datagrams arrive on the hal command socket of the robot
+**************************************************************************************************************************/
+uint32_t NetworkController::receive_udp_packet(uint8_t*)
+{
+	return 0;
+}
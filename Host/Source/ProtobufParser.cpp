@@ -0,0 +1,136 @@
+#include "ProtobufParser.h"
+#include <string.h>
+
+static const uint8_t WIRE_VARINT           = 0;
+static const uint8_t WIRE_FIXED64          = 1;
+static const uint8_t WIRE_LENGTH_DELIMITED = 2;
+static const uint8_t WIRE_FIXED32          = 5;
+
+// reads a varint of up to 64 bits, returns false if the packet ends inside it
+static bool read_varint(const uint8_t*& position, const uint8_t* end, uint64_t& value)
+{
+	value = 0;
+	for (uint8_t shift = 0; shift < 64; shift += 7) {
+		if (position == end) {
+			return false;
+		}
+		const uint8_t byte = *position++;
+		value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+		if (!(byte & 0x80)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+// skips a field of the given wire type, returns false if it is truncated or of an unknown type
+static bool skip_field(const uint8_t*& position, const uint8_t* end, uint8_t wire_type)
+{
+	uint64_t length = 0;
+
+	switch (wire_type) {
+	case WIRE_VARINT:
+		return read_varint(position, end, length);
+	case WIRE_FIXED64:
+		length = 8;
+		break;
+	case WIRE_FIXED32:
+		length = 4;
+		break;
+	case WIRE_LENGTH_DELIMITED:
+		if (!read_varint(position, end, length)) {
+			return false;
+		}
+		break;
+	default:
+		return false;
+	}
+	if (static_cast<uint64_t>(end - position) < length) {
+		return false;
+	}
+	position += length;
+	return true;
+}
+
+// decodes a submessage of three float fields, values[i] receives the field with tags[i]
+static bool parse_vector(const uint8_t* position, const uint8_t* end, const uint32_t tags[3], float* values[3])
+{
+	while (position < end) {
+		uint64_t key = 0;
+		if (!read_varint(position, end, key)) {
+			return false;
+		}
+		const uint8_t wire_type = key & 0x07;
+		const uint64_t field = key >> 3;
+
+		uint8_t index = 0;
+		while (index < 3 && tags[index] != field) {
+			index++;
+		}
+		if (index == 3 || wire_type != WIRE_FIXED32) {
+			if (!skip_field(position, end, wire_type)) {
+				return false;
+			}
+			continue;
+		}
+		if (end - position < 4) {
+			return false;
+		}
+		memcpy(values[index], position, sizeof(float));
+		position += sizeof(float);
+	}
+	return true;
+}
+
+/*************************************************************************************************************************
+* Descrition: parse_udp_packet() function decodes a Command from the protobuf wire format
+* Pre: buffer holds length bytes
+* Post: command holds the decoded fields (absent ones are zero), false is returned for a malformed packet
+**************************************************************************************************************************/
+bool ProtobufParser::parse_udp_packet(uint8_t* buffer, Command& command, uint32_t length)
+{
+	static const uint32_t MOVE_TAGS[3] = { Move_x_tag, Move_y_tag, Move_r_tag };
+	static const uint32_t ACTION_TAGS[3] = { Action_kick_tag, Action_chip_tag, Action_dribble_tag };
+	const Command zero_command = Command_init_zero;
+
+	const uint8_t* position = buffer;
+	const uint8_t* end = buffer + length;
+
+	command = zero_command;
+
+	while (position < end) {
+		uint64_t key = 0;
+		if (!read_varint(position, end, key)) {
+			return false;
+		}
+		const uint8_t wire_type = key & 0x07;
+		const uint64_t field = key >> 3;
+
+		if (wire_type == WIRE_LENGTH_DELIMITED && (field == Command_move_tag || field == Command_action_tag)) {
+			uint64_t message_length = 0;
+			if (!read_varint(position, end, message_length) || static_cast<uint64_t>(end - position) < message_length) {
+				return false;
+			}
+			float* move_values[3] = { &command.move.x, &command.move.y, &command.move.r };
+			float* action_values[3] = { &command.action.kick, &command.action.chip, &command.action.dribble };
+			const bool is_move = field == Command_move_tag;
+
+			if (!parse_vector(position, position + message_length, is_move ? MOVE_TAGS : ACTION_TAGS,
+				is_move ? move_values : action_values)) {
+				return false;
+			}
+			position += message_length;
+		}
+		else if (wire_type == WIRE_VARINT && field == Command_sequence_tag) {
+			uint64_t sequence = 0;
+			if (!read_varint(position, end, sequence)) {
+				return false;
+			}
+			command.sequence = static_cast<uint32_t>(sequence);
+		}
+		else if (!skip_field(position, end, wire_type)) {
+			return false;
+		}
+	}
+	return true;
+}
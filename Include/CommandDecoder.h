@@ -0,0 +1,27 @@
+#pragma once
+#include <stdint.h>
+#include "CommandSchema.h"
+
+/***********************************************************************************************/
+// CommandDecodeResult tells whether a packet was decoded or has to be passed to the generic parser
+enum CommandDecodeResult : uint8_t {
+	DECODE_OK,
+	DECODE_MALFORMED,         // truncated field, invalid varint or wire type
+	DECODE_UNSUPPORTED        // a known field has another wire type, i.e. a newer schema
+};
+/***********************************************************************************************/
+
+
+/***********************************************************************************************
+* CommandDecoder class decodes the Command message specialized for COMMAND_SCHEMA
+* This class implements following futures:
+* 1. Decodes move.x/y/r, action.kick/chip/dribble and the sequence number in a single pass
+*    directly from the packet, without allocation or intermediate copies
+* 2. Skips unknown fields and checks every length against the end of the packet
+* 3. Reports the packets it cannot decode, so they can be passed to ProtobufParser
+************************************************************************************************/
+class CommandDecoder
+{
+public:
+	static CommandDecodeResult decode(const uint8_t*, uint32_t, Command&);
+};
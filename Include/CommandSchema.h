@@ -0,0 +1,94 @@
+#pragma once
+#include <stdint.h>
+#include "ProtobufParser.h"
+#include "CommandSequence.h"
+
+/***********************************************************************************************/
+// COMMAND_SCHEMA namespace contains the protobuf wire layout of the Command message
+namespace COMMAND_SCHEMA {
+
+/***************************** wire types ************************************/
+	const uint8_t WIRE_VARINT           = 0;
+	const uint8_t WIRE_FIXED64          = 1;
+	const uint8_t WIRE_LENGTH_DELIMITED = 2;
+	const uint8_t WIRE_FIXED32          = 5;
+/*****************************************************************************/
+
+/**************************** field numbers **********************************/
+// taken from the tags of the nanopb generated header, without them the numbers are assumed
+// and the command decoder is left disabled (see Robot::set_command_decoder_enabled())
+#if defined(Command_move_tag) && defined(Command_action_tag) && \
+	defined(Move_x_tag) && defined(Move_y_tag) && defined(Move_r_tag) && \
+	defined(Action_kick_tag) && defined(Action_chip_tag) && defined(Action_dribble_tag)
+	const bool IS_SCHEMA_VERIFIED  = true;
+
+	const uint8_t COMMAND_MOVE     = Command_move_tag;       // Move message
+	const uint8_t COMMAND_ACTION   = Command_action_tag;     // Action message
+#ifdef Command_sequence_tag
+	const uint8_t COMMAND_SEQUENCE = Command_sequence_tag;   // uint32, only in schemas with sequence numbers
+#else
+	const uint8_t COMMAND_SEQUENCE = 0;                      // no field has the number 0
+#endif
+
+	const uint8_t MOVE_X           = Move_x_tag;             // float
+	const uint8_t MOVE_Y           = Move_y_tag;             // float
+	const uint8_t MOVE_R           = Move_r_tag;             // float
+
+	const uint8_t ACTION_KICK      = Action_kick_tag;        // float
+	const uint8_t ACTION_CHIP      = Action_chip_tag;        // float
+	const uint8_t ACTION_DRIBBLE   = Action_dribble_tag;     // float
+#else
+	const bool IS_SCHEMA_VERIFIED  = false;
+
+	const uint8_t COMMAND_MOVE     = 1;       // Move message
+	const uint8_t COMMAND_ACTION   = 2;       // Action message
+	const uint8_t COMMAND_SEQUENCE = 3;       // uint32, only in schemas with sequence numbers
+
+	const uint8_t MOVE_X           = 1;       // float
+	const uint8_t MOVE_Y           = 2;       // float
+	const uint8_t MOVE_R           = 3;       // float
+
+	const uint8_t ACTION_KICK      = 1;       // float
+	const uint8_t ACTION_CHIP      = 2;       // float
+	const uint8_t ACTION_DRIBBLE   = 3;       // float
+#endif
+
+	// the float fields of the Move and Action messages in the order of their members
+	const uint8_t MOVE_FIELDS[3]   = { MOVE_X, MOVE_Y, MOVE_R };
+	const uint8_t ACTION_FIELDS[3] = { ACTION_KICK, ACTION_CHIP, ACTION_DRIBBLE };
+
+	// the largest field number whose tag takes a single byte, as the decoder and MAX_ENCODED_SIZE assume
+	const uint8_t MAX_SINGLE_BYTE_FIELD = 15;
+/*****************************************************************************/
+
+	static_assert(COMMAND_MOVE >= 1 && COMMAND_MOVE <= MAX_SINGLE_BYTE_FIELD &&
+		COMMAND_ACTION >= 1 && COMMAND_ACTION <= MAX_SINGLE_BYTE_FIELD && COMMAND_SEQUENCE <= MAX_SINGLE_BYTE_FIELD,
+		"Command field numbers must have single byte tags");
+	static_assert(COMMAND_MOVE != COMMAND_ACTION && COMMAND_MOVE != COMMAND_SEQUENCE && COMMAND_ACTION != COMMAND_SEQUENCE,
+		"Command field numbers must be distinct");
+	static_assert(!has_command_sequence<Command>::value || COMMAND_SEQUENCE != 0,
+		"Command has a sequence field but no Command_sequence_tag");
+	static_assert(MOVE_X >= 1 && MOVE_X <= MAX_SINGLE_BYTE_FIELD && MOVE_Y >= 1 && MOVE_Y <= MAX_SINGLE_BYTE_FIELD &&
+		MOVE_R >= 1 && MOVE_R <= MAX_SINGLE_BYTE_FIELD, "Move field numbers must have single byte tags");
+	static_assert(MOVE_X != MOVE_Y && MOVE_X != MOVE_R && MOVE_Y != MOVE_R, "Move field numbers must be distinct");
+	static_assert(ACTION_KICK >= 1 && ACTION_KICK <= MAX_SINGLE_BYTE_FIELD && ACTION_CHIP >= 1 &&
+		ACTION_CHIP <= MAX_SINGLE_BYTE_FIELD && ACTION_DRIBBLE >= 1 && ACTION_DRIBBLE <= MAX_SINGLE_BYTE_FIELD,
+		"Action field numbers must have single byte tags");
+	static_assert(ACTION_KICK != ACTION_CHIP && ACTION_KICK != ACTION_DRIBBLE && ACTION_CHIP != ACTION_DRIBBLE,
+		"Action field numbers must be distinct");
+
+	// every field present: 2 x ([tag][length] + 3 x [tag][float]) + [tag][varint of 5 bytes]
+	const uint32_t MAX_ENCODED_SIZE = 2 * (2 + 3 * 5) + 6;
+};
+/***********************************************************************************************/
+
+
+/***********************************************************************************************
+* CommandEncoder class encodes a Command in the protobuf wire format sent by the server
+* zero fields are left out as proto3 does, used by the host tools and the benchmarks
+************************************************************************************************/
+class CommandEncoder
+{
+public:
+	static uint32_t encode(const Command&, uint32_t, uint8_t*, uint32_t);
+};
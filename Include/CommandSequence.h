@@ -0,0 +1,48 @@
+#pragma once
+#include <stdint.h>
+
+/***********************************************************************************************
+* command sequence helpers detect at compile time whether the Command message carries
+* a `sequence` field (uint32 incremented by the server for every command)
+* 1. has_command_sequence<T>::value is true if T has the field
+* 2. command_sequence() returns the field, or 0 if the message has no sequence
+* 3. set_command_sequence() writes the field, or does nothing if the message has no sequence
+************************************************************************************************/
+template <typename T>
+struct has_command_sequence
+{
+private:
+	template <typename U>
+	static char test(decltype(static_cast<uint32_t>(static_cast<U*>(nullptr)->sequence))*);
+	template <typename U>
+	static long test(...);
+
+public:
+	static const bool value = sizeof(test<T>(nullptr)) == sizeof(char);
+};
+
+template <typename T, bool = has_command_sequence<T>::value>
+struct command_sequence_access
+{
+	static uint32_t read(const T& command) { return static_cast<uint32_t>(command.sequence); }
+	static void write(T& command, uint32_t sequence) { command.sequence = sequence; }
+};
+
+template <typename T>
+struct command_sequence_access<T, false>
+{
+	static uint32_t read(const T&) { return 0; }
+	static void write(T&, uint32_t) {}
+};
+
+template <typename T>
+uint32_t command_sequence(const T& command)
+{
+	return command_sequence_access<T>::read(command);
+}
+
+template <typename T>
+void set_command_sequence(T& command, uint32_t sequence)
+{
+	command_sequence_access<T>::write(command, sequence);
+}
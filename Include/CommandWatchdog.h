@@ -0,0 +1,59 @@
+#pragma once
+#include <stdint.h>
+#include <atomic>
+
+/***********************************************************************************************/
+// WATCHDOG_SETTINGS namespace contains the settings of the command watchdog
+namespace WATCHDOG_SETTINGS {
+	const uint32_t DEFAULT_DEADLINE_MS  = 200;     // max time between two commands
+	const uint32_t CHECK_PERIOD_MS      = 5;       // watchdog task period
+	const uint32_t HALT_REPEAT_MS       = 100;     // halt is repeated while no commands arrive
+	const uint32_t TASK_PRIORITY        = 6;
+	const uint32_t TASK_STACK_SIZE      = 4096;
+	const int      TASK_CORE            = 1;
+};
+/***********************************************************************************************/
+
+
+/***********************************************************************************************/
+// WatchdogStatistics describes how often and how long commands were late
+struct WatchdogStatistics {
+	uint32_t expirations;          // number of times the deadline passed without a command
+	uint32_t late_commands;        // commands that arrived after the deadline
+	uint32_t max_late_ms;          // longest time past the deadline a command arrived
+	uint32_t total_late_ms;
+	uint32_t last_halt_latency_us; // time from the deadline to the completed halt
+	uint32_t max_halt_latency_us;
+};
+/***********************************************************************************************/
+
+
+/***********************************************************************************************
+* CommandWatchdog class halts the robot when commands stop arriving
+* This class implements following futures:
+* 1. Tracks the time of the last command on the monotonic hal clock
+* 2. Detects that the deadline passed without a command
+* 3. Records late commands and the latency of the halt
+* feed() and check() may be called from different tasks
+************************************************************************************************/
+class CommandWatchdog
+{
+public:
+	CommandWatchdog();
+
+	void set_deadline_ms(uint32_t);
+	uint32_t get_deadline_ms() const;
+	void feed(uint32_t);
+	bool check(uint32_t);
+	bool is_expired() const;
+	void record_halt(uint32_t);
+	WatchdogStatistics get_statistics() const;
+
+private:
+	std::atomic<uint32_t> deadline_ms;
+	std::atomic<uint32_t> last_feed_ms;
+	std::atomic<bool> fed;
+	std::atomic<bool> expired;
+	uint32_t expired_since_us = 0;      // hal::micros() when the deadline passed
+	WatchdogStatistics statistics = {};
+};
@@ -0,0 +1,21 @@
+#pragma once
+#include <stdint.h>
+
+/***********************************************************************************************/
+// crc16() computes the CRC-16/CCITT-FALSE (polynomial 0x1021, initial value 0xFFFF) of a buffer
+// it protects the framed sonic board protocol, a nibble table keeps it small and fast on the ESP32
+inline uint16_t crc16(const uint8_t* data, uint32_t length)
+{
+	static const uint16_t NIBBLE_TABLE[16] = {
+		0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+		0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF,
+	};
+	uint16_t crc = 0xFFFF;
+
+	for (uint32_t i = 0; i < length; i++) {
+		crc = (crc << 4) ^ NIBBLE_TABLE[(crc >> 12) ^ (data[i] >> 4)];
+		crc = (crc << 4) ^ NIBBLE_TABLE[(crc >> 12) ^ (data[i] & 0x0F)];
+	}
+	return crc;
+}
+/***********************************************************************************************/
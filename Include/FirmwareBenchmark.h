@@ -0,0 +1,79 @@
+#pragma once
+#include <stdint.h>
+#include "Robot.h"
+
+/***********************************************************************************************/
+// BENCHMARK_SETTINGS namespace contains the settings of the host benchmark suite
+namespace BENCHMARK_SETTINGS {
+	const uint32_t WARMUP_ITERATIONS    = 1000;
+	const uint8_t  REPETITIONS          = 5;          // the fastest repetition is reported
+	const uint32_t REPETITION_TIME_US   = 50000;      // min duration of a repetition
+	const uint32_t BATCH_ITERATIONS     = 64;         // iterations between two clock reads
+	const float    DEFAULT_THRESHOLD    = 0.15f;      // allowed ns/op increase over the baseline
+	const float    NO_TIMING_THRESHOLD  = -1.0f;      // ns/op is not checked
+	const uint32_t STACK_TOLERANCE      = 64;         // allowed stack bytes over the baseline (compiler versions)
+	const uint32_t STACK_PROBE_SIZE     = 8192;       // stack painted below the benchmark to measure its use
+};
+/***********************************************************************************************/
+
+
+/***********************************************************************************************/
+// BenchmarkId lists the benchmarked hot paths
+enum BenchmarkId : uint8_t {
+	BENCH_UPDATE_MOTORS,        // kinematics and frame building, spi backend mocked
+	BENCH_PARSE_COMMAND,        // ProtobufParser::parse_udp_packet() on representative commands
+	BENCH_DECODE_COMMAND,       // CommandDecoder::decode() on the same commands
+	BENCH_UPDATE_ROBOT,         // whole update_robot() cycle against the simulated boards
+	BENCH_HALT_ROBOT,           // halt_robot() while halted (steady state of a lost link)
+	BENCH_COUNT
+};
+
+// BenchmarkResult is the cost of one operation of a benchmark
+struct BenchmarkResult {
+	uint32_t iterations;
+	float ns_per_op;
+	float allocations_per_op;
+	float bus_bytes_per_op;     // 0 for benchmarks without bus traffic
+	uint32_t stack_bytes;       // measured for the decoders only, 0 otherwise
+};
+/***********************************************************************************************/
+
+
+/***********************************************************************************************
+* FirmwareBenchmark class measures the firmware hot paths on the host (host build only)
+* This class implements following futures:
+* 1. Runs every benchmark on the virtual clock, so the hal delays cost no time
+* 2. Reports ns/op, heap allocations/op, bus bytes/op and the stack used by the decoders
+* 3. Stores the results as a baseline file and fails when a later run regresses it:
+*    ns/op beyond the threshold, any increase of allocations or bus bytes, or stack beyond a tolerance
+* run() is the whole benchmark tool, the firmware_benchmark main() (FirmwareBenchmarkMain.cpp) passes its arguments
+************************************************************************************************/
+class FirmwareBenchmark
+{
+public:
+	int run(const char*, bool, float);
+	void run_all();
+	const BenchmarkResult& get_result(BenchmarkId) const;
+	void report() const;
+	bool save_baseline(const char*) const;
+	bool load_baseline(const char*);
+	uint8_t check_regressions(float) const;
+
+	static const char* get_name(BenchmarkId);
+
+private:
+	BenchmarkResult results[BENCH_COUNT] = {};
+	BenchmarkResult baseline[BENCH_COUNT] = {};
+	bool has_baseline[BENCH_COUNT] = {};
+
+	void run_update_motors();
+	void run_parse_command();
+	void run_decode_command();
+	void run_update_robot();
+	void run_halt_robot();
+
+	template <typename Operation, typename ByteCounter>
+	static BenchmarkResult measure(Operation, ByteCounter);
+	template <typename Operation>
+	static uint32_t measure_stack(Operation);
+};
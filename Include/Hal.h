@@ -0,0 +1,103 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+/***********************************************************************************************
+* hal namespace is a thin hardware abstraction layer used by the firmware
+* It covers following peripherals:
+* 1. spi bus
+* 2. gpio
+* 3. clock
+* 4. logging
+* 5. udp
+* 6. tasks and mutexes
+* 7. non-volatile storage
+* 8. files
+* HalEsp32.cpp implements it on top of the ESP32 arduino core,
+* HalLinux.cpp implements it on a linux host with simulated sonic boards (see HalSimulation.h)
+************************************************************************************************/
+namespace hal {
+
+/********************************** gpio *************************************/
+	const uint8_t GPIO_LOW  = 0;
+	const uint8_t GPIO_HIGH = 1;
+
+	void gpio_set_output(uint8_t);
+	void gpio_write(uint8_t, uint8_t);
+	// writes the output register directly, for pins toggled on every transaction (chip selects)
+	// pin must be configured with gpio_set_output() first
+	void gpio_fast_write(uint8_t, uint8_t);
+/*****************************************************************************/
+
+/********************************* spi bus ***********************************/
+	void spi_begin(uint32_t);
+	void spi_set_frequency(uint32_t);
+	uint8_t spi_transfer(uint8_t);
+	void spi_transfer_bytes(const uint8_t*, uint8_t*, uint32_t);
+/*****************************************************************************/
+
+/********************************** clock ************************************/
+	uint32_t millis();
+	uint32_t micros();
+	void delay_ms(uint32_t);
+	void delay_us(uint32_t);
+	// free running cpu cycle counter (wraps around), cycle_counter_frequency_mhz() ticks per microsecond
+	uint32_t cycle_counter();
+	uint32_t cycle_counter_frequency_mhz();
+/*****************************************************************************/
+
+/********************************* logging ***********************************/
+	void log(const char*, ...) __attribute__((format(printf, 1, 2)));
+/*****************************************************************************/
+
+/*********************************** udp *************************************/
+	// every socket has its own handle, so the command and the telemetry socket can be open at once
+	typedef int UdpHandle;
+
+	const UdpHandle INVALID_UDP_HANDLE = -1;
+
+	// returns INVALID_UDP_HANDLE if the port cannot be bound
+	UdpHandle udp_open(uint16_t);
+	void udp_close(UdpHandle);
+	// returns the length of the received datagram or 0 if there is no datagram waiting
+	uint32_t udp_receive(UdpHandle, uint8_t*, uint32_t);
+	// blocks until a datagram is waiting, false if timeout_ms elapsed first
+	bool udp_wait(UdpHandle, uint32_t);
+	bool udp_send(UdpHandle, const char*, uint16_t, const uint8_t*, uint32_t);
+/*****************************************************************************/
+
+/********************************** tasks ************************************/
+	typedef void* TaskHandle;
+	typedef void (*TaskFunction)(void*);
+
+	const uint32_t WAIT_FOREVER = 0xFFFFFFFF;
+
+	// core is ignored on targets without core affinity
+	TaskHandle task_create(const char*, TaskFunction, void*, uint32_t, uint32_t, int);
+	void task_notify(TaskHandle);
+	// returns false if timeout_ms elapsed without a notification
+	bool task_wait_notification(uint32_t);
+	void task_yield();
+	// ends the calling task, must be the last statement of a task function that returns
+	void task_exit();
+
+	typedef void* MutexHandle;
+
+	MutexHandle mutex_create();
+	void mutex_lock(MutexHandle);
+	void mutex_unlock(MutexHandle);
+/*****************************************************************************/
+
+/************************** non-volatile storage *****************************/
+	// keys are at most 15 characters long
+	// storage_read() returns false if the key is not stored or its value has another size
+	bool storage_read(const char*, void*, uint32_t);
+	bool storage_write(const char*, const void*, uint32_t);
+/*****************************************************************************/
+
+/********************************** files ************************************/
+	// writes data to the file at path (flash file system on the robot), replacing its content unless append is set
+	bool file_write(const char*, const void*, uint32_t, bool);
+/*****************************************************************************/
+
+};
@@ -0,0 +1,50 @@
+#pragma once
+#include "Hal.h"
+#include "SimulatedSonicBoard.h"
+
+/***********************************************************************************************
+* hal_sim namespace controls the simulated hardware behind the linux hal implementation
+* 1. Simulated sonic boards are attached to chip select pins
+* 2. Clock can run in real time or as virtual time advanced only by the hal delays
+* 3. LoopbackUdpServer plays the role of the server on the local host
+* 4. Spi bit errors can be injected above a clock rate
+* 5. Non-volatile storage is kept in memory and can be cleared to emulate a fresh device
+************************************************************************************************/
+namespace hal_sim {
+
+	const uint8_t MAX_SIMULATED_BOARDS = 4;
+
+	// board is driven while gpio cs_pin is low, nullptr detaches the pin
+	bool attach_sonic_board(uint8_t, SimulatedSonicBoard*);
+	void detach_all_sonic_boards();
+
+	void set_virtual_clock(bool);
+	void advance_clock_us(uint32_t);
+
+	uint32_t get_spi_frequency();
+	// above max_clean_frequency every byte in either direction gets a bit flipped with the given probability
+	void set_spi_signal_integrity(uint32_t, uint32_t);
+
+	// erases everything written with hal::storage_write()
+	void clear_storage();
+
+
+/***********************************************************************************************/
+// LoopbackUdpServer sends datagrams to the robot udp port on 127.0.0.1 and receives its replies
+	class LoopbackUdpServer
+	{
+	public:
+		~LoopbackUdpServer();
+
+		bool open(uint16_t, uint16_t);
+		void close();
+		bool send_to_robot(const uint8_t*, uint32_t);
+		uint32_t receive_from_robot(uint8_t*, uint32_t);
+
+	private:
+		int socket_fd = -1;
+		uint16_t robot_port = 0;
+	};
+/***********************************************************************************************/
+
+};
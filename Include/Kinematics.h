@@ -0,0 +1,146 @@
+#pragma once
+#include <stdint.h>
+
+/***********************************************************************************************/
+// compile time helpers used to fold the robot geometry into the mixing matrices
+// named apart from the PI and radians() macros of Arduino.h, which may be included before this header
+namespace kinematics_detail {
+	constexpr double KIN_PI = 3.14159265358979323846;
+	const int SERIES_TERMS = 12;
+
+	constexpr double sin_series(double x, double term, double sum, int n)
+	{
+		return n > SERIES_TERMS ? sum : sin_series(x, -term * x * x / ((2 * n) * (2 * n + 1)), sum + term, n + 1);
+	}
+
+	constexpr double cos_series(double x, double term, double sum, int n)
+	{
+		return n > SERIES_TERMS ? sum : cos_series(x, -term * x * x / ((2 * n - 1) * (2 * n)), sum + term, n + 1);
+	}
+
+	constexpr double sin(double x) { return sin_series(x, x, 0.0, 1); }
+	constexpr double cos(double x) { return cos_series(x, 1.0, 0.0, 1); }
+	constexpr double to_radians(double degrees) { return degrees * KIN_PI / 180.0; }
+};
+/***********************************************************************************************/
+
+
+/***********************************************************************************************/
+// DefaultRobotGeometry describes the wheel geometry of the robot
+struct DefaultRobotGeometry {
+	static constexpr double MOTOR_ANGLE_DEG = 40.0;             // angle of motors
+	static constexpr double WHEELBASE_CIRCUMFERENCE = 0.16375;  // motor circumference at wheelbase in meters
+	static constexpr double WHEEL_CIRCUMFERENCE = 0.05;         // circumference of wheel in meters
+};
+/***********************************************************************************************/
+
+
+/***********************************************************************************************
+* Kinematics class converts between body velocity and wheel rpm for the given geometry
+* This class implements following futures:
+* 1. Folds the geometry into a 4x3 mixing matrix at compile time
+* 2. Calculates wheel rpm from body velocity (forward, left, rotation)
+* 3. Calculates body velocity from wheel rpm and body displacement from encoder ticks (odometry)
+* Wheels are ordered as WHEEL_FL, WHEEL_FR, WHEEL_BL, WHEEL_BR
+************************************************************************************************/
+template <typename Geometry>
+class Kinematics
+{
+public:
+	static const uint8_t WHEEL_FL = 0;
+	static const uint8_t WHEEL_FR = 1;
+	static const uint8_t WHEEL_BL = 2;
+	static const uint8_t WHEEL_BR = 3;
+	static const uint8_t WHEEL_COUNT = 4;
+	static const uint8_t AXIS_COUNT = 3;
+
+	// rpm per m/s of the forward, left and rotation parts, from m/s to RPM is * 60 / wheel circumference
+	static constexpr double FORWARD_GAIN = 60.0 /
+		(Geometry::WHEEL_CIRCUMFERENCE * kinematics_detail::cos(kinematics_detail::to_radians(Geometry::MOTOR_ANGLE_DEG)));
+	static constexpr double LEFT_GAIN = 60.0 /
+		(Geometry::WHEEL_CIRCUMFERENCE * kinematics_detail::sin(kinematics_detail::to_radians(Geometry::MOTOR_ANGLE_DEG)));
+	static constexpr double ROTATION_GAIN = 60.0 *
+		(Geometry::WHEELBASE_CIRCUMFERENCE / 2 * kinematics_detail::KIN_PI) / Geometry::WHEEL_CIRCUMFERENCE;
+
+	// wheel rpm = MIXING_MATRIX * (forward, left, rotation)
+	static constexpr float MIXING_MATRIX[WHEEL_COUNT][AXIS_COUNT] = {
+		{  (float)FORWARD_GAIN, -(float)LEFT_GAIN, -(float)ROTATION_GAIN },    // front left
+		{ -(float)FORWARD_GAIN, -(float)LEFT_GAIN, -(float)ROTATION_GAIN },    // front right
+		{  (float)FORWARD_GAIN,  (float)LEFT_GAIN, -(float)ROTATION_GAIN },    // back left
+		{ -(float)FORWARD_GAIN,  (float)LEFT_GAIN, -(float)ROTATION_GAIN },    // back right
+	};
+
+	// columns of the mixing matrix are orthogonal, so its pseudo inverse is the transpose
+	// with every row divided by the squared norm of the column
+	static constexpr float INVERSE_MATRIX[AXIS_COUNT][WHEEL_COUNT] = {
+		{  (float)(1 / (4 * FORWARD_GAIN)), -(float)(1 / (4 * FORWARD_GAIN)),
+		   (float)(1 / (4 * FORWARD_GAIN)), -(float)(1 / (4 * FORWARD_GAIN)) },
+		{ -(float)(1 / (4 * LEFT_GAIN)), -(float)(1 / (4 * LEFT_GAIN)),
+		   (float)(1 / (4 * LEFT_GAIN)),  (float)(1 / (4 * LEFT_GAIN)) },
+		{ -(float)(1 / (4 * ROTATION_GAIN)), -(float)(1 / (4 * ROTATION_GAIN)),
+		  -(float)(1 / (4 * ROTATION_GAIN)), -(float)(1 / (4 * ROTATION_GAIN)) },
+	};
+
+	/************************************************************************************************************
+	* Descrition: body_to_wheels() function calculates the wheel rpm for the given body velocity
+	* Pre:  none
+	* Post: wheel_rpm holds the rpm of every wheel
+	*************************************************************************************************************/
+	static void body_to_wheels(float forward_speed, float left_speed, float rotation_speed, float (&wheel_rpm)[WHEEL_COUNT])
+	{
+		for (uint8_t wheel = 0; wheel < WHEEL_COUNT; wheel++) {
+			wheel_rpm[wheel] = MIXING_MATRIX[wheel][0] * forward_speed
+				+ MIXING_MATRIX[wheel][1] * left_speed
+				+ MIXING_MATRIX[wheel][2] * rotation_speed;
+		}
+	}
+
+	/************************************************************************************************************
+	* Descrition: wheels_to_body() function calculates the body velocity from the wheel rpm (least squares)
+	* Pre:  none
+	* Post: forward, left and rotation speed are calculated
+	*************************************************************************************************************/
+	static void wheels_to_body(const float (&wheel_rpm)[WHEEL_COUNT],
+		                       float& forward_speed, float& left_speed, float& rotation_speed)
+	{
+		float body[AXIS_COUNT] = { 0.0f, 0.0f, 0.0f };
+
+		for (uint8_t axis = 0; axis < AXIS_COUNT; axis++) {
+			for (uint8_t wheel = 0; wheel < WHEEL_COUNT; wheel++) {
+				body[axis] += INVERSE_MATRIX[axis][wheel] * wheel_rpm[wheel];
+			}
+		}
+
+		forward_speed = body[0];
+		left_speed = body[1];
+		rotation_speed = body[2];
+	}
+
+	/************************************************************************************************************
+	* Descrition: encoder_ticks_to_body() function calculates the body displacement from the encoder ticks
+	* counted by every wheel over the same interval
+	* Pre:  ticks_per_revolution is not zero
+	* Post: forward and left displacement (meters) and rotation are calculated
+	*************************************************************************************************************/
+	static void encoder_ticks_to_body(const int32_t (&wheel_ticks)[WHEEL_COUNT], float ticks_per_revolution,
+		                              float& forward, float& left, float& rotation)
+	{
+		float wheel_revolutions[WHEEL_COUNT];
+
+		// n revolutions in t seconds is an average of n * 60 / t rpm, so the displacement
+		// is the body velocity of n * 60 rpm times one second
+		for (uint8_t wheel = 0; wheel < WHEEL_COUNT; wheel++) {
+			wheel_revolutions[wheel] = wheel_ticks[wheel] * 60.0f / ticks_per_revolution;
+		}
+
+		wheels_to_body(wheel_revolutions, forward, left, rotation);
+	}
+};
+
+template <typename Geometry>
+constexpr float Kinematics<Geometry>::MIXING_MATRIX[Kinematics<Geometry>::WHEEL_COUNT][Kinematics<Geometry>::AXIS_COUNT];
+
+template <typename Geometry>
+constexpr float Kinematics<Geometry>::INVERSE_MATRIX[Kinematics<Geometry>::AXIS_COUNT][Kinematics<Geometry>::WHEEL_COUNT];
+
+typedef Kinematics<DefaultRobotGeometry> RobotKinematics;
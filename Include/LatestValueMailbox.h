@@ -0,0 +1,55 @@
+#pragma once
+#include <stdint.h>
+#include <atomic>
+
+/***********************************************************************************************
+* LatestValueMailbox class passes the latest value from one producer to one consumer
+* without locks (triple buffering)
+* 1. publish() never blocks and overwrites a value the consumer has not taken yet
+* 2. consume() never blocks and returns only values it has not returned before
+* The producer and the consumer each own one buffer, the third one is exchanged atomically
+************************************************************************************************/
+template <typename T>
+class LatestValueMailbox
+{
+public:
+	LatestValueMailbox() : shared_index(2) {}
+
+	/************************************************************************************************************
+	* Descrition: publish() function makes a value available to the consumer
+	* Pre:  called from the producer context only
+	* Post: value is the latest value of the mailbox, the previous one is dropped if it was not consumed
+	*************************************************************************************************************/
+	void publish(const T& value)
+	{
+		buffers[write_index] = value;
+		const uint8_t previous = shared_index.exchange(write_index | FRESH, std::memory_order_acq_rel);
+		write_index = previous & INDEX_MASK;
+	}
+
+	/************************************************************************************************************
+	* Descrition: consume() function takes the latest value from the mailbox
+	* Pre:  called from the consumer context only
+	* Post: if a new value was published it is copied to value and true is returned, otherwise false
+	*************************************************************************************************************/
+	bool consume(T& value)
+	{
+		if (!(shared_index.load(std::memory_order_relaxed) & FRESH)) {
+			return false;
+		}
+
+		const uint8_t previous = shared_index.exchange(read_index, std::memory_order_acq_rel);
+		read_index = previous & INDEX_MASK;
+		value = buffers[read_index];
+		return true;
+	}
+
+private:
+	static const uint8_t INDEX_MASK = 0x03;
+	static const uint8_t FRESH = 0x04;
+
+	T buffers[3];
+	uint8_t write_index = 0;             // owned by the producer
+	uint8_t read_index = 1;              // owned by the consumer
+	std::atomic<uint8_t> shared_index;   // buffer in exchange, FRESH if not consumed yet
+};
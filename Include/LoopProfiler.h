@@ -0,0 +1,100 @@
+#pragma once
+#include <stdint.h>
+#include <atomic>
+#include "Hal.h"
+
+// ROBOT_PROFILING = 0 removes the loop profiler instrumentation from the firmware
+#ifndef ROBOT_PROFILING
+#define ROBOT_PROFILING 1
+#endif
+
+/***********************************************************************************************/
+// ProfilerStage lists the timed stages of the robot loop
+enum ProfilerStage : uint8_t {
+	STAGE_UPDATE_ROBOT,         // whole update_robot() call
+	STAGE_CONTROL_CYCLE,        // whole cycle of the pipeline control task
+	STAGE_UDP_RECEIVE,
+	STAGE_PROTOBUF_PARSE,
+	STAGE_KINEMATICS,
+	STAGE_SPI_TRANSACTION,      // each transmit_receive_float() or batched frame
+	STAGE_BALL_CONTROLLER,
+	STAGE_ARRIVAL_TO_SPI,       // datagram arrival (event task wakeup or notify_datagram_arrival()) to the motor write
+	STAGE_COUNT
+};
+/***********************************************************************************************/
+
+
+/***********************************************************************************************/
+// StageSummary is the distribution of the duration of a stage in microseconds
+// percentiles are bucket upper bounds, so they overestimate by at most 1/4
+struct StageSummary {
+	uint32_t count;
+	float min_us;
+	float p50_us;
+	float p99_us;
+	float max_us;
+};
+/***********************************************************************************************/
+
+
+/***********************************************************************************************
+* LoopProfiler class keeps a duration histogram of every stage in static memory
+* This class implements following futures:
+* 1. Records stage durations measured with the cpu cycle counter
+* 2. Buckets them logarithmically (4 buckets per power of two) without allocation
+* 3. Summarizes and reports min/p50/p99/max per stage
+* 4. Records from any task without locks, every counter is updated atomically
+* Use PROFILE_STAGE(stage) at the start of a scope to time the rest of the scope
+************************************************************************************************/
+class LoopProfiler
+{
+public:
+	static const uint8_t SUB_BUCKETS = 4;
+	static const uint8_t BUCKET_COUNT = 32 * SUB_BUCKETS;
+
+	static void record(ProfilerStage, uint32_t);
+	static StageSummary summarize(ProfilerStage);
+	static void report();
+	static void reset();
+
+private:
+	// the minimum is kept inverted, so both extremes are maxima and the zeroed histogram is empty
+	struct StageHistogram {
+		std::atomic<uint32_t> buckets[BUCKET_COUNT];
+		std::atomic<uint32_t> count;
+		std::atomic<uint32_t> inverted_min_cycles;
+		std::atomic<uint32_t> max_cycles;
+	};
+
+	static StageHistogram histograms[STAGE_COUNT];
+
+	static void update_max(std::atomic<uint32_t>&, uint32_t);
+	static uint8_t bucket_index(uint32_t);
+	static uint32_t bucket_upper_bound(uint8_t);
+};
+/***********************************************************************************************/
+
+
+/***********************************************************************************************/
+// ProfilerScope records the cycles from its construction to its destruction
+class ProfilerScope
+{
+public:
+	explicit ProfilerScope(ProfilerStage profiled_stage)
+		: stage(profiled_stage), start_cycles(hal::cycle_counter()) {}
+	~ProfilerScope() { LoopProfiler::record(stage, hal::cycle_counter() - start_cycles); }
+
+private:
+	ProfilerStage stage;
+	uint32_t start_cycles;
+};
+
+#define PROFILER_CONCAT_(a, b) a##b
+#define PROFILER_CONCAT(a, b) PROFILER_CONCAT_(a, b)
+
+#if ROBOT_PROFILING
+#define PROFILE_STAGE(stage) ProfilerScope PROFILER_CONCAT(profiler_scope_, __LINE__)(stage)
+#else
+#define PROFILE_STAGE(stage)
+#endif
+/***********************************************************************************************/
@@ -0,0 +1,63 @@
+#pragma once
+#include <stdint.h>
+
+/***********************************************************************************************/
+// MOTION_PROFILE_SETTINGS namespace contains the default limits of the motion profile
+// the default velocity limits are the motor rpm limit of every axis (see MotionProfile())
+namespace MOTION_PROFILE_SETTINGS {
+	const float    MAX_LINEAR_ACCELERATION  = 4.0f;      // m/s^2
+	const float    MAX_LINEAR_JERK          = 80.0f;     // m/s^3
+	const float    MAX_ANGULAR_ACCELERATION = 30.0f;     // rotation units/s^2
+	const float    MAX_ANGULAR_JERK         = 600.0f;    // rotation units/s^3
+	const uint32_t MAX_PACKET_INTERVAL_US   = 100000;    // after longer intervals the new target is not interpolated
+};
+/***********************************************************************************************/
+
+
+/***********************************************************************************************/
+// MotionLimits holds the velocity, acceleration and jerk limit of every body axis (forward, left, rotation)
+struct MotionLimits {
+	float max_velocity[3];
+	float max_acceleration[3];
+	float max_jerk[3];
+};
+/***********************************************************************************************/
+
+
+/***********************************************************************************************
+* MotionProfile class shapes the body velocity between sparse server commands
+* This class implements following futures:
+* 1. Interpolates the goal velocity from its value at the arrival of a command to the commanded velocity
+*    over the measured packet interval, so the goal never leaves the range of the received commands
+* 2. Follows the goal velocity under velocity, acceleration and jerk limits at the control rate
+* Axes are ordered as forward, left, rotation
+************************************************************************************************/
+class MotionProfile
+{
+public:
+	static const uint8_t AXIS_COUNT = 3;
+
+	MotionProfile();
+
+	void set_limits(const MotionLimits&);
+	void set_target(float, float, float, uint32_t);
+	void step(uint32_t, float (&)[AXIS_COUNT]);
+	void reset();
+
+private:
+	MotionLimits limits;
+
+	// the goal ramps from ramp_start to target within ramp_duration_us after target_time_us
+	float target[AXIS_COUNT] = {};
+	float ramp_start[AXIS_COUNT] = {};
+	uint32_t target_time_us = 0;
+	uint32_t ramp_duration_us = 0;
+	bool has_target = false;
+
+	float velocity[AXIS_COUNT] = {};
+	float acceleration[AXIS_COUNT] = {};
+	uint32_t last_step_us = 0;
+	bool has_stepped = false;
+
+	float goal(uint8_t, uint32_t) const;
+};
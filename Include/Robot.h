@@ -3,11 +3,134 @@
 #include "NetworkController.h"
 #include "ProtobufParser.h"
 #include "BallController.h"
+#include "LatestValueMailbox.h"
+#include "CommandSequence.h"
+#include "CommandDecoder.h"
+#include "CommandWatchdog.h"
+#include "MotionProfile.h"
+#include "TelemetryUplink.h"
+#include "TrafficRecorder.h"
+#include "Hal.h"
+#include <atomic>
 #include <stdint.h>
 
 // to get udp buffer size
 using namespace udp_settings;
 
+/***********************************************************************************************/
+// PIPELINE_SETTINGS namespace contains the settings of the pipelined execution mode
+namespace PIPELINE_SETTINGS {
+	const int      NETWORK_CORE           = 0;
+	const int      CONTROL_CORE           = 1;
+	const uint32_t NETWORK_TASK_PRIORITY  = 3;
+	const uint32_t CONTROL_TASK_PRIORITY  = 4;
+	const uint32_t TASK_STACK_SIZE        = 4096;
+	const uint32_t CONTROL_PERIOD_US      = 1000;      // 1 kHz control rate, if the spi bus keeps up with it
+	const uint32_t MAX_BUS_LOAD_PERCENT   = 80;        // share of the control period a motor update may keep the spi bus busy
+	const uint32_t NETWORK_IDLE_DELAY_MS  = 1;         // wait when no packet is waiting
+};
+/***********************************************************************************************/
+
+
+/***********************************************************************************************/
+// EVENT_LOOP_SETTINGS namespace contains the settings of the event driven execution mode
+namespace EVENT_LOOP_SETTINGS {
+	const int      TASK_CORE              = 1;
+	const uint32_t TASK_PRIORITY          = 4;
+	const uint32_t TASK_STACK_SIZE        = 4096;
+	const uint32_t WAIT_TIMEOUT_MS        = 5;         // longest sleep of the event task, the watchdog deadline is checked in between
+};
+/***********************************************************************************************/
+
+
+/***********************************************************************************************/
+// INGESTION_SETTINGS namespace contains the settings of the udp command intake
+namespace INGESTION_SETTINGS {
+	const uint16_t COMMAND_PORT        = 10010;       // udp port of the command socket, not bound by the network controller
+	const uint8_t  MAX_DRAINED_PACKETS = 16;          // 1 receives a single packet per cycle
+	const uint32_t SEQUENCE_RESYNC_WINDOW = 1000;     // older sequence numbers mean the server restarted
+};
+/***********************************************************************************************/
+
+
+/***********************************************************************************************/
+// BOOT_SETTINGS namespace contains the settings of the wifi association that runs during init_robot()
+namespace BOOT_SETTINGS {
+	const int      WIFI_TASK_CORE       = 0;           // core of the wifi stack
+	const uint32_t WIFI_TASK_PRIORITY   = 2;
+	const uint32_t WIFI_TASK_STACK_SIZE = 4096;
+	const uint32_t WIFI_POLL_PERIOD_MS  = 1;
+};
+/***********************************************************************************************/
+
+
+/***********************************************************************************************/
+// SONIC_BOARD_SETTINGS namespace selects the sonic board protocol of the robot (see SonicBoardController)
+// the batched frame needs board firmware that supports SET_MODULE_MOTORS_RPM (0x11), the telemetry piggyback,
+// the write coalescing, one chip select per board, the spi queue and the framed protocol work on it only
+namespace SONIC_BOARD_SETTINGS {
+	const bool USE_BATCHED_FRAME      = true;
+	const bool USE_ASYNC_TRANSACTIONS = false;     // frames are written by the spi queue task (see SpiTransactionQueue)
+	const bool USE_FRAMED_PROTOCOL    = false;     // needs board firmware that supports the crc frames (0xA6)
+};
+/***********************************************************************************************/
+
+
+/***********************************************************************************************/
+// BootStatistics describes the phases of init_robot(), the wifi association overlaps the peripheral init
+struct BootStatistics {
+	uint32_t sonic_board_init_us;
+	uint32_t ball_controller_init_us;
+	uint32_t wifi_connect_us;       // duration of the association in the wifi task
+	uint32_t wifi_wait_us;          // time init_robot() waited for the association after the peripherals
+	uint32_t total_us;
+};
+/***********************************************************************************************/
+
+
+/***********************************************************************************************/
+// IngestionStatistics describes the udp command intake
+struct IngestionStatistics {
+	uint32_t received_packets;
+	uint32_t decoded_packets;
+	uint32_t superseded_packets;    // valid drained packets dropped because a newer valid one was drained with them
+	uint32_t invalid_packets;       // packets the protobuf parser rejected
+	uint32_t fallback_packets;      // packets the command decoder passed to the protobuf parser
+	uint32_t stale_packets;         // valid packets not newer than the last applied sequence number
+	uint32_t reordered_packets;     // stale packets older than the last applied sequence number
+};
+/***********************************************************************************************/
+
+
+/***********************************************************************************************/
+// EventLoopStatistics describes the event driven execution mode
+struct EventLoopStatistics {
+	uint32_t notifications;         // calls of notify_datagram_arrival()
+	uint32_t wakeups;               // robot task cycles started by a datagram on the socket or a notification
+	uint32_t timeouts;              // robot task cycles started by the wait timeout
+};
+/***********************************************************************************************/
+
+
+/***********************************************************************************************/
+// CommandMessage is a decoded command passed from the network task to the control task
+struct CommandMessage {
+	Command command;
+	uint32_t received_time_us;
+};
+
+// PipelineStatistics describes the hand-over between the network task and the control task
+struct PipelineStatistics {
+	uint32_t published_commands;
+	uint32_t applied_commands;
+	uint32_t control_cycles;
+	uint32_t overrun_cycles;        // control cycles that did not finish within the control period
+	uint32_t control_period_us;     // CONTROL_PERIOD_US or longer if a motor update takes longer on the spi bus
+	uint32_t last_latency_us;       // time from packet reception to motor update
+	uint32_t max_latency_us;
+};
+/***********************************************************************************************/
+
 /***********************************************************************
 * Robot class is the main class in the project. It is responsible for
 * robot initialization and robot state update
@@ -15,27 +138,136 @@ using namespace udp_settings;
 * 1. Manages all the robot peripherals (sonic boards, ball conroller...)
 * 2. Initializes the robot
 * 3. Updates the robot state
-* 3. Halts the robot if connection with the server is lost
+* 3. Halts the robot if no command arrives within the watchdog deadline
+* 4. Drains the udp socket and applies only the newest valid command, decoded
+*    by the schema specialized command decoder
+* 5. Optionally runs network intake and motor control as two pipelined
+*    tasks on separate cores, the control task shapes the commanded
+*    velocity with the motion profile at the control rate
+* 6. Optionally records the received datagrams and the bus traffic,
+*    and takes its datagrams from a replayed recording instead of wifi
+* 7. Optionally runs update_robot() from a task woken by the command socket
+*    on datagram arrival instead of polling it from the main loop
 ************************************************************************/
 class Robot
 {
 public:
 	void init_robot(const char*, const char*);
+	void init_replay(DatagramSource&);
 	void update_robot();
+	bool start_pipeline();
+	bool start_event_loop();
+	void notify_datagram_arrival();
+	EventLoopStatistics get_event_loop_statistics() const;
+	PipelineStatistics get_pipeline_statistics() const;
+	IngestionStatistics get_ingestion_statistics() const;
+	void set_max_drained_packets(uint8_t);
+	void set_command_decoder_enabled(bool);
+	void set_command_deadline_ms(uint32_t);
+	WatchdogStatistics get_watchdog_statistics() const;
+	void set_motion_profile_enabled(bool);
+	void set_motion_limits(const MotionLimits&);
+	bool start_telemetry_uplink(const char*, uint16_t);
+	TelemetryStatistics get_telemetry_statistics() const;
+	const BootStatistics& get_boot_statistics() const;
+	void set_traffic_recorder(TrafficRecorder*);
 
 private:
+	// measures the private hot paths (see FirmwareBenchmark.h)
+	friend class FirmwareBenchmark;
+
 	SonicBoardController sonic_board_controller;
 	NetworkController network_controller;
 	ProtobufParser protobuf_parser;
 	BallController ball_controller;
 
+	// wifi association started by init_robot()
+	const char* wifi_ssid = nullptr;
+	const char* wifi_password = nullptr;
+	std::atomic<bool> is_wifi_associated{ false };
+	BootStatistics boot_statistics = {};
+
 	// data structure that stores decoded protobuf data
 	Command robot_command = Command_init_zero;
 
 	// buffer that stores data received from server 
 	uint8_t udp_buffer[udp_settings::UDP_BUFFER_SIZE];
 
+	// udp intake state
+	uint8_t max_drained_packets = INGESTION_SETTINGS::MAX_DRAINED_PACKETS;
+	// when false every packet is decoded by the generic protobuf parser
+	// enabled only if the field numbers of COMMAND_SCHEMA are taken from the generated header
+	bool command_decoder_enabled = COMMAND_SCHEMA::IS_SCHEMA_VERIFIED;
+	bool has_applied_sequence = false;
+	uint32_t last_applied_sequence = 0;
+	IngestionStatistics ingestion_statistics = {};
+
+	// halts the robot from its own task when commands stop arriving
+	// without the task (replay) update_robot() checks the deadline
+	CommandWatchdog command_watchdog;
+	hal::TaskHandle watchdog_task_handle = nullptr;
+	uint32_t last_halt_ms = 0;
+	// serializes motor and ball controller writes of the robot tasks
+	hal::MutexHandle output_mutex = nullptr;
+
+	// shapes the velocity between commands in the control task
+	MotionProfile motion_profile;
+	bool motion_profile_enabled = true;
+
+	// latest command passed from the network task to the control task
+	LatestValueMailbox<CommandMessage> command_mailbox;
+	PipelineStatistics pipeline_statistics = {};
+	hal::TaskHandle network_task_handle = nullptr;
+	hal::TaskHandle control_task_handle = nullptr;
+
+	// task of the event driven mode, woken by the udp socket or by notify_datagram_arrival()
+	std::atomic<hal::TaskHandle> event_task_handle{ nullptr };
+	std::atomic<uint32_t> arrival_notifications{ 0 };
+	std::atomic<uint32_t> event_wakeups{ 0 };
+	std::atomic<uint32_t> event_timeouts{ 0 };
+	// time of the earliest arrival whose command was not written to the motors yet
+	std::atomic<uint32_t> arrival_time_us{ 0 };
+	std::atomic<bool> is_arrival_pending{ false };
+
+	// streams a decimated copy of the loop state to the server
+	TelemetryUplink telemetry_uplink;
+	uint32_t telemetry_sample_counter = 0;
+
+	// socket the commands are received on, the network controller receives them if it is not open
+	hal::UdpHandle command_socket = hal::INVALID_UDP_HANDLE;
+	// replaces the network when set (see init_replay())
+	DatagramSource* datagram_source = nullptr;
+	// logs the received datagrams when set
+	TrafficRecorder* traffic_recorder = nullptr;
+
+	void init_sonic_boards();
+	void connect_to_wifi();
+	void open_command_socket();
+	static void wifi_task(void*);
+	void report_boot_statistics() const;
 	void halt_robot();
+	void apply_command(const Command&);
+	void apply_profiled_command(const CommandMessage&);
+	void update_profiled_motors();
+	uint32_t get_control_period_us() const;
+	bool receive_latest_command();
+	bool decode_command(uint32_t, Command&);
+	static bool is_newer_sequence(uint32_t, uint32_t);
+	bool is_stale_command(const Command&);
+	void drop_command(const Command&);
+	void run_network_task();
+	void run_control_task();
+	void run_control_cycle(CommandMessage&);
+	void record_telemetry_sample(uint32_t);
+	static void network_task(void*);
+	static void control_task(void*);
+	void run_event_loop();
+	bool wait_for_datagram();
+	static void event_task(void*);
+	void record_arrival_latency();
+	void check_command_watchdog();
+	void run_watchdog_task();
+	static void watchdog_task(void*);
 };
 
 
@@ -0,0 +1,68 @@
+#pragma once
+#include <stdint.h>
+
+/***********************************************************************************************/
+// SimulatedMotorRegisters holds the state of one simulated motor controller
+struct SimulatedMotorRegisters {
+	float rpm;
+	float enable;
+	float brake;
+	float dac;
+	float kp;
+	float ki;
+	float kd;
+	float encoder_counter;
+	float temperature;
+};
+/***********************************************************************************************/
+
+
+/***********************************************************************************************
+* SimulatedSonicBoard class emulates the spi slave of a sonic board on the host
+* This class implements following futures:
+* 1. Understands the legacy two-transaction command protocol (SONIC_BOARD_CONST command set)
+* 2. Understands the batched frame protocol and replies with the telemetry requested by the previous frame
+* 3. Understands the framed protocol: executes only frames with a valid crc and acknowledges them in its replies,
+*    unless it emulates an older firmware
+* 4. Keeps the motor registers so tests can inspect what the firmware has written
+************************************************************************************************/
+class SimulatedSonicBoard
+{
+public:
+	static const uint8_t MOTOR_COUNT = 2;
+	static const uint8_t MAX_WINDOW_SIZE = 64;
+
+	SimulatedMotorRegisters motors[MOTOR_COUNT] = {};
+	uint32_t received_frames = 0;
+	uint32_t received_commands = 0;
+	uint32_t protocol_errors = 0;
+	uint32_t crc_errors = 0;
+	// false emulates a firmware without the framed protocol, it takes the framed frames for garbage
+	bool is_framed_protocol_supported = true;
+
+	void select();
+	void deselect();
+	uint8_t exchange(uint8_t);
+
+private:
+	bool command_pending = false;
+	uint8_t pending_command = 0;
+	uint8_t pending_motor_id = 0;
+	uint8_t requested_telemetry = 0;
+
+	// framed protocol state, the replies are framed once a framed frame was received
+	bool framed_mode = false;
+	uint8_t acknowledged_sequence = 0;
+	uint8_t frame_status = 0;
+	uint8_t reply_payload_size = MOTOR_COUNT * sizeof(float);
+
+	uint8_t window[MAX_WINDOW_SIZE] = {};
+	uint8_t window_size = 0;
+	uint8_t reply[MAX_WINDOW_SIZE] = {};
+
+	float* find_register(uint8_t, uint8_t);
+	void execute_command(uint8_t, uint8_t, float);
+	void execute_frame();
+	void execute_framed_frame();
+	void prepare_framed_reply();
+};
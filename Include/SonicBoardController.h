@@ -1,6 +1,11 @@
 #pragma once
-#include <SPI.h>
 #include <stdint.h>
+#include "SpiTransactionQueue.h"
+#include "Kinematics.h"
+#include "Crc16.h"
+#include <atomic>
+
+class TrafficRecorder;
 
 /***********************************************************************************************/
 // SONIC_BOARD_CONST namespace contains a set of constants for the sonic boards
@@ -41,6 +46,60 @@ namespace SONIC_BOARD_CONST {
 	const uint8_t GET_MOTOR_KD = 0x0E;                    
 	const uint8_t GET_MOTOR_ENCODER_COUNTER = 0x0F;       
 	const uint8_t GET_MOTOR_CONTROLLER_TEMPERATURE = 0x10;
+	const uint8_t SET_MODULE_MOTORS_RPM = 0x11;            // batched frame command
+/*****************************************************************************/
+
+/************************ batched frame layout *******************************/
+	// [FRAME_START][command][telemetry command][payload length][float for motor id 0][float for motor id 1]
+	// the whole frame is transmitted within a single chip select transaction
+	// during the payload the module clocks out the values requested by the telemetry command
+	// of its previous frame (DUMMY if nothing was requested)
+	const uint8_t FRAME_START = 0xA5;
+	const uint8_t FRAME_HEADER_SIZE = 4;
+	const uint8_t MOTORS_PER_MODULE = 2;
+	const uint8_t MAX_FRAME_PAYLOAD_SIZE = MOTORS_PER_MODULE * sizeof(float);
+/*****************************************************************************/
+
+/************************ framed protocol layout *****************************/
+	// optional batched frame with integrity check (see SonicBoardController::set_framed_protocol_enabled())
+	// tx: [FRAMED_FRAME_START][command][telemetry command][payload length][sequence][payload][crc16 lo][crc16 hi]
+	// rx: [FRAMED_REPLY_START][telemetry command][status][payload length][acknowledged sequence][payload][crc16 lo][crc16 hi]
+	// the crc16 (see Crc16.h) covers header and payload. A module executes only frames with a valid crc,
+	// the reply acknowledges the sequence of the last valid frame and flags a corrupted one in the status
+	const uint8_t FRAMED_FRAME_START = 0xA6;
+	const uint8_t FRAMED_REPLY_START = 0x5A;
+	const uint8_t FRAMED_HEADER_SIZE = 5;
+	const uint8_t FRAME_CRC_SIZE = 2;
+	const uint8_t FRAME_STATUS_CRC_ERROR = 0x01;     // previous frame was rejected
+
+	// buffer size that fits a frame of either layout
+	const uint8_t MAX_FRAME_SIZE = FRAMED_HEADER_SIZE + MAX_FRAME_PAYLOAD_SIZE + FRAME_CRC_SIZE;
+/*****************************************************************************/
+
+/************************ telemetry and coalescing ***************************/
+
+	// telemetry commands rotated through the frames that carry setpoints
+	const uint8_t TELEMETRY_COMMANDS[] = { GET_MOTOR_RPM, GET_MOTOR_ENCODER_COUNTER, GET_MOTOR_CONTROLLER_TEMPERATURE };
+	const uint8_t TELEMETRY_COMMAND_COUNT = sizeof(TELEMETRY_COMMANDS);
+
+	// default write coalescing settings (see SonicBoardController::set_write_coalescing())
+	const float    DEFAULT_RPM_DEAD_BAND     = 0.0f;
+	const uint32_t DEFAULT_REFRESH_PERIOD_MS = 100;
+/*****************************************************************************/
+
+/************************ boot handshake *************************************/
+	// a module is ready once it reports the configured pid gains back
+	const uint32_t HANDSHAKE_TIMEOUT_MS     = 2000;   // bound of the whole handshake, the former fixed boot delay
+	const uint32_t HANDSHAKE_POLL_PERIOD_MS = 5;
+
+	// gains used when no pid config is stored
+	const float DEFAULT_KP = 1.5f;
+	const float DEFAULT_KI = 0.0f;
+	const float DEFAULT_KD = 0.0f;
+
+	// non-volatile storage key and layout version of MotorPidConfig
+	const char* const PID_CONFIG_KEY = "motor_pid";
+	const uint32_t PID_CONFIG_VERSION = 1;
 /*****************************************************************************/
 
 };
@@ -52,6 +111,110 @@ namespace SPI_SETTINGS {
 	const uint8_t  SS_SONIC_BOARD_LEFT  = 2;          // gpio 2
 	const uint8_t  SS_SONIC_BOARD_RIGHT = 15;         // gpio 15
 	const uint32_t SPI_FREQUENCY        = 100000;     // 100 kHz
+	const uint32_t CS_SETUP_DELAY_US    = 50;         // delay between slave select and first byte
+	const uint32_t CS_RELEASE_DELAY_US  = 50;         // delay after slave deselect
+
+	// clock rates tried by the framed protocol, SPI_FREQUENCY is the fallback and is kept for unframed transactions
+	const uint32_t FRAMED_FREQUENCIES[] = { SPI_FREQUENCY, 250000, 500000, 1000000, 2000000, 4000000, 8000000 };
+	const uint8_t  FRAMED_FREQUENCY_COUNT = sizeof(FRAMED_FREQUENCIES) / sizeof(FRAMED_FREQUENCIES[0]);
+	const uint32_t CLOCK_PROBE_FRAMES     = 50;       // error free frames per module before a rate is accepted
+	const uint32_t ERROR_WINDOW_FRAMES    = 200;      // frames the error rate is measured over
+	const uint32_t MAX_WINDOW_ERRORS      = 4;        // more errors in a window step the clock down
+};
+/***********************************************************************************************/
+
+
+/***********************************************************************************************/
+// SONIC_BOARD_TOPOLOGY namespace describes the sonic boards on the spi bus and the motors they drive
+// motors are addressed by a motor index: the wheels take the indices RobotKinematics::WHEEL_*,
+// further motors (e.g. a dribbler on a third board) follow them
+namespace SONIC_BOARD_TOPOLOGY {
+
+	struct BoardDescriptor {
+		uint8_t cs_pin;
+		uint8_t motor_count;
+		uint8_t motors[SONIC_BOARD_CONST::MOTORS_PER_MODULE];    // motor index of every motor id
+	};
+
+	// indexed by module id (SONIC_BOARD_CONST::SONIC_MODULE_*), motors are listed by motor id (MOTOR_ID_*)
+	constexpr BoardDescriptor BOARDS[] = {
+		{ SPI_SETTINGS::SS_SONIC_BOARD_LEFT,  2, { RobotKinematics::WHEEL_FL, RobotKinematics::WHEEL_BL } },
+		{ SPI_SETTINGS::SS_SONIC_BOARD_RIGHT, 2, { RobotKinematics::WHEEL_BR, RobotKinematics::WHEEL_FR } },
+	};
+	constexpr uint8_t BOARD_COUNT = sizeof(BOARDS) / sizeof(BOARDS[0]);
+
+	constexpr uint8_t count_motors(uint8_t board = 0)
+	{
+		return board < BOARD_COUNT ? BOARDS[board].motor_count + count_motors(board + 1) : 0;
+	}
+	constexpr uint8_t MOTOR_COUNT = count_motors();
+
+	static_assert(MOTOR_COUNT >= RobotKinematics::WHEEL_COUNT, "every wheel needs a motor");
+	static_assert(SPI_QUEUE_CONST::QUEUE_DEPTH >= SPI_QUEUE_CONST::FRAMES_PER_MODULE * BOARD_COUNT + 1,
+		"the transaction queue must buffer two updates of every board");
+};
+/***********************************************************************************************/
+
+
+/***********************************************************************************************/
+// SpiBusStatistics accumulates the cost of the spi traffic generated by the controller
+struct SpiBusStatistics {
+	uint32_t transactions;     // number of transmit_receive_* calls
+	uint32_t bytes;            // number of bytes clocked on the bus
+	uint32_t cs_toggles;       // number of slave select edges
+	uint32_t delay_us;         // time spent in bus delays in microseconds
+	uint32_t skipped_writes;   // number of writes coalesced by the shadow register cache
+	uint32_t dropped_frames;   // number of frames not queued because the queue was full, resent with the next update
+};
+/***********************************************************************************************/
+
+
+/***********************************************************************************************/
+// BoardLinkStatistics counts the framed protocol errors of one module
+struct BoardLinkStatistics {
+	uint32_t frames;
+	uint32_t rx_errors;        // replies with a bad start byte or crc, their telemetry is dropped
+	uint32_t tx_errors;        // frames the module rejected or did not acknowledge, their setpoints are resent
+	uint32_t clock_backoffs;   // clock steps down caused by errors on this module
+};
+/***********************************************************************************************/
+
+
+/***********************************************************************************************/
+// MotorTelemetry is the latest feedback received from a motor with the time (hal::micros()) it was received
+struct MotorTelemetry {
+	float rpm;
+	uint32_t rpm_timestamp_us;
+	float encoder_counter;
+	uint32_t encoder_counter_timestamp_us;
+	float temperature;
+	uint32_t temperature_timestamp_us;
+};
+/***********************************************************************************************/
+
+
+/***********************************************************************************************/
+// MotorPidConfig holds the gains of every motor indexed by motor index (see SONIC_BOARD_TOPOLOGY)
+// it is cached in non-volatile storage and loaded on boot
+struct MotorPidConfig {
+	uint32_t version;
+	float kp[SONIC_BOARD_TOPOLOGY::MOTOR_COUNT];
+	float ki[SONIC_BOARD_TOPOLOGY::MOTOR_COUNT];
+	float kd[SONIC_BOARD_TOPOLOGY::MOTOR_COUNT];
+};
+/***********************************************************************************************/
+
+
+/***********************************************************************************************/
+// SonicBoardBootStatistics describes the phases of init(), times are measured from the start of init()
+struct SonicBoardBootStatistics {
+	uint32_t spi_init_us;
+	uint32_t module_ready_us[SONIC_BOARD_TOPOLOGY::BOARD_COUNT];   // 0 if the module timed out
+	uint32_t total_us;
+	uint32_t ready_modules;       // bit per module id
+	uint16_t handshake_polls;     // pid read back rounds of all modules
+	uint16_t pid_writes;          // gains that differed from the board and were written
+	bool pid_config_loaded;       // false if the default gains were used
 };
 /***********************************************************************************************/
 
@@ -62,20 +225,134 @@ namespace SPI_SETTINGS {
 * 1. Initializes spi communication between ESP32 and sonic boards
 * 2. Calculates motors rpm
 * 3. Transmits data from ESP32 to sonic boards and vice versa 
+* 4. Optionally packs the setpoints of both motors of a module into one batched frame
+* 5. Optionally queues the batched frames so update_motors() does not wait for the bus
+* 6. Collects motors telemetry from the bytes received with the batched frames
+* 7. Keeps a shadow of the motor registers and skips writes of values the motors already hold
+* 8. Waits on boot only until the modules answer and writes only the pid gains they do not hold yet
+* 9. Drives any number of boards and motors described by SONIC_BOARD_TOPOLOGY, accessing the bus
+*    board by board so every chip select is asserted once per update
+* 10. Optionally protects the batched frames with a sequence number and crc and raises the spi clock
+*     as far as the frames get through without errors
+* 11. Optionally logs every bus transaction to a traffic recorder
 ************************************************************************************************/
-class SonicBoardController
+class SonicBoardController : public SpiBusBackend
 {
 public:
+	SonicBoardController();
+
 	void init();
 	void update_motors(float, float, float);
 	float transmit_receive_float(uint8_t, uint8_t, uint8_t, float);
+	void transmit_receive_frame(uint8_t, uint8_t, const float*, float*, uint8_t);
 	void set_motors_kp(float, float, float, float);
 	void set_motors_ki(float, float, float, float);
 	void set_motors_kd(float, float, float, float);
+	void set_batched_frame_enabled(bool);
+	SpiBusStatistics get_bus_statistics() const;
+	void reset_bus_statistics();
+	bool enable_async_transactions(bool);
+	void disable_async_transactions();
+	void set_bus_backend(SpiBusBackend&);
+	SpiTransactionQueue& get_transaction_queue();
+	void transfer_frame(uint8_t, const uint8_t*, uint8_t*, uint8_t) override;
+	void set_telemetry_enabled(bool);
+	MotorTelemetry get_motor_telemetry(uint8_t) const;
+	float get_commanded_rpm(uint8_t) const;
+	void set_motor_rpm(uint8_t, float);
+	void set_motor_register(uint8_t, uint8_t, float);
+	void set_write_coalescing(bool, float, uint32_t);
+	void invalidate_shadow_registers();
+	const SonicBoardBootStatistics& get_boot_statistics() const;
+	const MotorPidConfig& get_pid_config() const;
+	bool save_pid_config(const MotorPidConfig&);
+	void set_framed_protocol_enabled(bool);
+	bool negotiate_spi_clock();
+	uint32_t get_spi_frequency() const;
+	uint32_t get_update_bus_time_us() const;
+	BoardLinkStatistics get_link_statistics(uint8_t) const;
+	void set_traffic_recorder(TrafficRecorder*);
 
 private:
+	// when false the legacy per-motor transactions are used to set motors rpm
+	// off by default for boards without SET_MODULE_MOTORS_RPM support, the robot selects it (see SONIC_BOARD_SETTINGS in Robot.h)
+	bool batched_frame_enabled = false;
+	// when true the batched frames are queued instead of transmitted in place
+	bool async_transactions_enabled = false;
+	// spi traffic counters (see SpiBusStatistics), updated from the caller and from the spi queue worker
+	std::atomic<uint32_t> bus_transactions{ 0 };
+	std::atomic<uint32_t> bus_bytes{ 0 };
+	std::atomic<uint32_t> bus_cs_toggles{ 0 };
+	std::atomic<uint32_t> bus_delay_us{ 0 };
+	std::atomic<uint32_t> bus_skipped_writes{ 0 };
+	std::atomic<uint32_t> bus_dropped_frames{ 0 };
+	SpiBusBackend* bus_backend;
+	SpiTransactionQueue transaction_queue;
+
+	// per motor state is kept as arrays indexed by motor index (see SONIC_BOARD_TOPOLOGY)
+	// module id and motor id of every motor, derived from SONIC_BOARD_TOPOLOGY::BOARDS
+	uint8_t motor_module[SONIC_BOARD_TOPOLOGY::MOTOR_COUNT] = {};
+	uint8_t motor_channel[SONIC_BOARD_TOPOLOGY::MOTOR_COUNT] = {};
+	// last rpm commanded to each motor, after the rpm limit
+	float commanded_rpm[SONIC_BOARD_TOPOLOGY::MOTOR_COUNT] = {};
+
+	// telemetry is guarded by a sequence lock because it is written from the context that drives the bus
+	bool telemetry_enabled = true;
+	uint8_t telemetry_rotation[SONIC_BOARD_TOPOLOGY::BOARD_COUNT] = {};
+	uint8_t requested_telemetry[SONIC_BOARD_TOPOLOGY::BOARD_COUNT] = {};
+	MotorTelemetry motor_telemetry[SONIC_BOARD_TOPOLOGY::MOTOR_COUNT] = {};
+	std::atomic<uint32_t> telemetry_sequence;
+
+	// shadow of the set commands from SET_MOTOR_RPM to SET_MOTOR_KD (rpm, enable, brake, dac, kp, ki, kd)
+	static const uint8_t SHADOW_REGISTER_COUNT = 7;
+
+	bool write_coalescing_enabled = true;
+	float coalescing_rpm_dead_band = SONIC_BOARD_CONST::DEFAULT_RPM_DEAD_BAND;
+	uint32_t coalescing_refresh_period_ms = SONIC_BOARD_CONST::DEFAULT_REFRESH_PERIOD_MS;
+	float shadow_value[SHADOW_REGISTER_COUNT][SONIC_BOARD_TOPOLOGY::MOTOR_COUNT] = {};
+	uint32_t shadow_write_time_ms[SHADOW_REGISTER_COUNT][SONIC_BOARD_TOPOLOGY::MOTOR_COUNT] = {};
+	uint8_t shadow_valid[SONIC_BOARD_TOPOLOGY::MOTOR_COUNT] = {};     // bit per register
+
+	// framed protocol state, written from the context that drives the bus
+	bool framed_protocol_enabled = false;
+	bool clock_negotiation_active = false;
+	uint8_t spi_frequency_index = 0;              // index in SPI_SETTINGS::FRAMED_FREQUENCIES
+	uint8_t tx_sequence[SONIC_BOARD_TOPOLOGY::BOARD_COUNT] = {};
+	bool is_ack_expected[SONIC_BOARD_TOPOLOGY::BOARD_COUNT] = {};
+	BoardLinkStatistics link_statistics[SONIC_BOARD_TOPOLOGY::BOARD_COUNT] = {};
+	uint32_t window_frames = 0;
+	uint32_t window_errors = 0;
+	// bit per module whose last setpoints were lost and must be sent again
+	std::atomic<uint32_t> resend_modules;
+
+	// logs every transaction when set
+	TrafficRecorder* traffic_recorder = nullptr;
+
+	// gains written to the motors on boot
+	MotorPidConfig pid_config = {};
+	SonicBoardBootStatistics boot_statistics = {};
+
+	bool load_pid_config();
+	bool sync_module_pid(uint8_t);
+	bool wait_for_module(uint8_t, uint32_t, uint32_t);
+	void write_motor_register(uint8_t, uint8_t, float);
+	bool is_write_required(uint8_t, uint8_t, float, uint32_t) const;
+	void update_shadow_register(uint8_t, uint8_t, float, uint32_t);
+	static uint8_t shadow_register_index(uint8_t);
+	uint8_t build_frame(uint8_t*, uint8_t, uint8_t, uint8_t, const float*, uint8_t);
+	uint8_t next_telemetry_command(uint8_t);
+	bool process_frame_reply(uint8_t, const uint8_t*, const uint8_t*);
+	bool check_framed_reply(uint8_t, const uint8_t*, const uint8_t*);
+	void record_link_result(uint8_t, bool);
+	void set_spi_frequency_index(uint8_t);
+	uint32_t probe_link_errors(uint32_t);
+	static void on_frame_complete(const SpiTransaction&, void*);
+
 	void set_motors_rpm(float, float, float, float);
+	void set_motors_rpm_batched();
+	void set_motors_rpm_legacy();
 	void select_module(uint8_t);
 	void deselect_module(uint8_t);
+	void bus_delay(uint32_t);
 };
 
@@ -0,0 +1,86 @@
+#pragma once
+#include <stdint.h>
+#include <atomic>
+
+/***********************************************************************************************/
+// SPI_QUEUE_CONST namespace contains a set of constants for the spi transaction queue
+namespace SPI_QUEUE_CONST {
+	const uint8_t  MAX_TRANSACTION_SIZE = 32;       // max frame size in bytes
+	const uint8_t  MAX_MODULES          = 4;        // sonic board modules on the bus
+	const uint8_t  FRAMES_PER_MODULE    = 2;        // buffered frames per module
+	// the ring keeps one slot empty to tell a full queue from an empty one
+	const uint8_t  QUEUE_DEPTH          = FRAMES_PER_MODULE * MAX_MODULES + 1;
+	const uint32_t WORKER_STACK_SIZE    = 2048;
+	const uint32_t WORKER_PRIORITY      = 5;
+	const int      WORKER_CORE          = 0;
+};
+/***********************************************************************************************/
+
+
+/***********************************************************************************************/
+// SpiBusBackend is the interface of the spi bus used by the transaction queue.
+// transfer_frame() performs a complete chip select transaction with the specified module.
+class SpiBusBackend
+{
+public:
+	virtual ~SpiBusBackend() {}
+	virtual void transfer_frame(uint8_t module_id, const uint8_t* tx_data, uint8_t* rx_data, uint8_t length) = 0;
+};
+/***********************************************************************************************/
+
+
+/***********************************************************************************************/
+struct SpiTransaction;
+
+// completion callback, called from the context that drives the bus
+typedef void (*SpiTransactionCallback)(const SpiTransaction&, void*);
+
+struct SpiTransaction {
+	uint8_t module_id;
+	uint8_t length;
+	uint8_t tx_data[SPI_QUEUE_CONST::MAX_TRANSACTION_SIZE];
+	uint8_t rx_data[SPI_QUEUE_CONST::MAX_TRANSACTION_SIZE];
+	SpiTransactionCallback callback;
+	void* context;
+};
+/***********************************************************************************************/
+
+
+/***********************************************************************************************
+* SpiTransactionQueue class decouples the producer of spi frames from the bus
+* This class implements following futures:
+* 1. Queues frames without blocking the producer (single producer, single consumer)
+* 2. Double-buffers the frames of each module so the next frame can be prepared
+*    while the previous one is on the wire
+* 3. Drives the bus from a worker task or from explicit service() calls
+* 4. Reports completion of each transaction through a callback
+************************************************************************************************/
+class SpiTransactionQueue
+{
+public:
+	explicit SpiTransactionQueue(SpiBusBackend&);
+
+	bool submit(uint8_t, const uint8_t*, uint8_t, SpiTransactionCallback, void*);
+	uint32_t service();
+	bool start_worker();
+	bool is_idle() const;
+	bool is_full() const;
+	void flush();
+	void set_backend(SpiBusBackend&);
+	uint32_t get_completed_count() const;
+	uint32_t get_overrun_count() const;
+
+private:
+	SpiBusBackend* backend;
+	SpiTransaction transactions[SPI_QUEUE_CONST::QUEUE_DEPTH];
+
+	// head is written by the producer, tail by the consumer
+	std::atomic<uint8_t> head;
+	std::atomic<uint8_t> tail;
+	std::atomic<bool> busy;
+	std::atomic<uint32_t> completed_count;
+	std::atomic<uint32_t> overrun_count;
+	void* worker_handle = nullptr;
+
+	static void worker_task(void*);
+};
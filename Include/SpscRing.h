@@ -0,0 +1,61 @@
+#pragma once
+#include <stdint.h>
+#include <atomic>
+
+/***********************************************************************************************
+* SpscRing class is a fixed size lock-free ring buffer for one producer and one consumer
+* 1. push() never blocks and fails when the ring is full
+* 2. pop() never blocks and fails when the ring is empty
+************************************************************************************************/
+template <typename T, uint32_t CAPACITY>
+class SpscRing
+{
+public:
+	SpscRing() : head(0), tail(0) {}
+
+	/************************************************************************************************************
+	* Descrition: push() function appends a value to the ring
+	* Pre:  called from the producer context only
+	* Post: true is returned if the value was stored, false if the ring is full
+	*************************************************************************************************************/
+	bool push(const T& value)
+	{
+		const uint32_t current_head = head.load(std::memory_order_relaxed);
+
+		if (current_head - tail.load(std::memory_order_acquire) >= CAPACITY) {
+			return false;
+		}
+
+		items[current_head % CAPACITY] = value;
+		head.store(current_head + 1, std::memory_order_release);
+		return true;
+	}
+
+	/************************************************************************************************************
+	* Descrition: pop() function removes the oldest value from the ring
+	* Pre:  called from the consumer context only
+	* Post: true is returned and the value is copied if the ring was not empty
+	*************************************************************************************************************/
+	bool pop(T& value)
+	{
+		const uint32_t current_tail = tail.load(std::memory_order_relaxed);
+
+		if (current_tail == head.load(std::memory_order_acquire)) {
+			return false;
+		}
+
+		value = items[current_tail % CAPACITY];
+		tail.store(current_tail + 1, std::memory_order_release);
+		return true;
+	}
+
+	uint32_t size() const
+	{
+		return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
+	}
+
+private:
+	T items[CAPACITY];
+	std::atomic<uint32_t> head;    // written by the producer
+	std::atomic<uint32_t> tail;    // written by the consumer
+};
@@ -0,0 +1,96 @@
+#pragma once
+#include <stdint.h>
+#include "Hal.h"
+#include "SpscRing.h"
+
+/***********************************************************************************************/
+// TELEMETRY_SETTINGS namespace contains the settings of the telemetry uplink
+namespace TELEMETRY_SETTINGS {
+	const uint16_t MAGIC                     = 0x5254;   // "RT"
+	const uint8_t  PROTOCOL_VERSION          = 1;
+	const uint32_t RING_CAPACITY             = 128;      // samples
+	const uint8_t  SAMPLE_DIVIDER            = 10;       // one sample every 10 control cycles
+	const uint8_t  MAX_SAMPLES_PER_DATAGRAM  = 10;
+	const uint32_t BATCH_PERIOD_MS           = 50;
+	const uint32_t MAX_DATAGRAMS_PER_SECOND  = 40;
+	const uint16_t LOCAL_PORT                = 10020;
+	const uint32_t TASK_PRIORITY             = 1;        // below the network and control tasks
+	const uint32_t TASK_STACK_SIZE           = 4096;
+	const int      TASK_CORE                 = 0;
+};
+/***********************************************************************************************/
+
+
+/***********************************************************************************************/
+// TelemetrySample is the robot state at one control cycle, wheels are ordered as RobotKinematics::WHEEL_*
+struct TelemetrySample {
+	uint32_t timestamp_us;
+	float commanded_rpm[4];
+	float measured_rpm[4];
+	float encoder_counter[4];
+	float temperature[4];
+	uint32_t loop_time_us;
+};
+/***********************************************************************************************/
+
+
+/***********************************************************************************************
+* TelemetryCodec class converts telemetry samples to and from the binary datagram format
+* datagram (little endian):
+*   [magic u16][version u8][sample count u8][datagram sequence u32][dropped samples u32]
+*   sample count x [timestamp us u32][commanded rpm x 4 i16, 0.1 rpm][measured rpm x 4 i16, 0.1 rpm]
+*                  [encoder counter x 4 i32][temperature x 4 i16, 0.01 C][loop time us u16]
+* decode() is used by the host tools that receive the datagrams
+************************************************************************************************/
+class TelemetryCodec
+{
+public:
+	static const uint8_t HEADER_SIZE = 12;
+	static const uint8_t SAMPLE_SIZE = 46;
+	static const uint32_t MAX_DATAGRAM_SIZE = HEADER_SIZE + SAMPLE_SIZE * TELEMETRY_SETTINGS::MAX_SAMPLES_PER_DATAGRAM;
+
+	static uint32_t encode(const TelemetrySample*, uint8_t, uint32_t, uint32_t, uint8_t*, uint32_t);
+	static uint8_t decode(const uint8_t*, uint32_t, TelemetrySample*, uint8_t, uint32_t&, uint32_t&);
+};
+/***********************************************************************************************/
+
+
+/***********************************************************************************************/
+// TelemetryStatistics describes the telemetry uplink
+struct TelemetryStatistics {
+	uint32_t recorded_samples;
+	uint32_t dropped_samples;      // samples lost because the ring was full
+	uint32_t sent_datagrams;
+	uint32_t failed_datagrams;
+};
+/***********************************************************************************************/
+
+
+/***********************************************************************************************
+* TelemetryUplink class streams telemetry samples from the robot to the server
+* This class implements following futures:
+* 1. Buffers samples in a lock-free ring filled at the control rate
+* 2. Batches them into versioned binary datagrams from a low priority task
+* 3. Limits the datagram rate so the uplink never competes with the command intake
+************************************************************************************************/
+class TelemetryUplink
+{
+public:
+	bool start(const char*, uint16_t);
+	bool is_running() const;
+	bool record(const TelemetrySample&);
+	TelemetryStatistics get_statistics() const;
+
+private:
+	SpscRing<TelemetrySample, TELEMETRY_SETTINGS::RING_CAPACITY> ring;
+	char server_ip[16] = {};
+	uint16_t server_port = 0;
+	hal::UdpHandle udp_socket = hal::INVALID_UDP_HANDLE;
+	hal::TaskHandle task_handle = nullptr;
+	uint32_t datagram_sequence = 0;
+	TelemetryStatistics statistics = {};
+
+	void run_task();
+	bool send_batch();
+	static void uplink_task(void*);
+};
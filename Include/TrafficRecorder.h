@@ -0,0 +1,95 @@
+#pragma once
+#include <stdint.h>
+#include <atomic>
+#include "Hal.h"
+
+/***********************************************************************************************/
+// TRAFFIC_RECORDER_SETTINGS namespace contains the settings and the file format of the traffic recorder
+namespace TRAFFIC_RECORDER_SETTINGS {
+	const uint32_t RING_SIZE              = 32768;      // bytes, the oldest records are dropped when full
+
+	// file: [magic u32][version u8][reserved x 3] followed by the records, oldest first (little endian)
+	const uint32_t FILE_MAGIC             = 0x43455252; // "RREC"
+	const uint8_t  FILE_VERSION           = 1;
+	const uint8_t  FILE_HEADER_SIZE       = 8;
+
+	// record: [type u8][timestamp us u32][payload length u16][payload]
+	const uint8_t  RECORD_HEADER_SIZE     = 7;
+	const uint8_t  RECORD_UDP_DATAGRAM    = 1;          // payload: datagram as received in udp_buffer
+	const uint8_t  RECORD_SPI_FLOAT       = 2;          // payload: [module][motor id][command][tx float][rx float]
+	const uint8_t  RECORD_SPI_FRAME       = 3;          // payload: [module][tx bytes][rx bytes], both of the same length
+	const uint8_t  SPI_FLOAT_PAYLOAD_SIZE = 11;
+};
+/***********************************************************************************************/
+
+
+/***********************************************************************************************/
+// TrafficRecord is a record parsed from the ring or a recording file, payload points into the parsed data
+struct TrafficRecord {
+	uint8_t type;
+	uint32_t timestamp_us;
+	uint16_t length;
+	const uint8_t* payload;
+};
+
+// TrafficRecorderStatistics describes the traffic recorder
+struct TrafficRecorderStatistics {
+	uint32_t recorded_records;
+	uint32_t overwritten_records;   // oldest records dropped to make room for new ones
+	uint32_t rejected_records;      // records not stored because the recorder was flushing
+	uint32_t flushed_bytes;
+};
+/***********************************************************************************************/
+
+
+/***********************************************************************************************
+* DatagramSource is a source of command datagrams that replaces the network (see Robot::init_replay())
+************************************************************************************************/
+class DatagramSource
+{
+public:
+	virtual ~DatagramSource() {}
+
+	// returns the length of the next datagram or 0 if no datagram is waiting
+	virtual uint32_t receive_datagram(uint8_t*, uint32_t) = 0;
+};
+
+
+/***********************************************************************************************
+* TrafficRecorder class logs the inbound command datagrams and the outbound sonic board
+* transactions so a field session can be replayed on the host (see TrafficReplayer.h)
+* This class implements following futures:
+* 1. Stores timestamped records in a compact binary format in a ram ring
+* 2. Drops the oldest records when the ring is full, so it always holds the latest traffic
+* 3. Flushes the ring to a file on the flash file system
+************************************************************************************************/
+class TrafficRecorder
+{
+public:
+	bool start();
+	void stop();
+	bool is_running() const;
+	void clear();
+	void record_udp_datagram(uint32_t, const uint8_t*, uint32_t);
+	void record_spi_float(uint8_t, uint8_t, uint8_t, float, float);
+	void record_spi_frame(uint8_t, const uint8_t*, const uint8_t*, uint8_t);
+	bool flush(const char*);
+	TrafficRecorderStatistics get_statistics() const;
+
+	static uint32_t parse_record(const uint8_t*, uint32_t, TrafficRecord&);
+
+private:
+	uint8_t ring[TRAFFIC_RECORDER_SETTINGS::RING_SIZE];
+	// free running byte positions, head - tail is the number of stored bytes
+	uint32_t head = 0;
+	uint32_t tail = 0;
+	hal::MutexHandle mutex = nullptr;
+	std::atomic<bool> is_recording{ false };
+	std::atomic<bool> is_flushing{ false };
+	TrafficRecorderStatistics statistics = {};
+
+	bool begin_record(uint8_t, uint32_t, uint32_t);
+	void end_record();
+	void write_ring(const uint8_t*, uint32_t);
+	void read_ring(uint32_t, uint8_t*, uint32_t) const;
+};
@@ -0,0 +1,64 @@
+#pragma once
+#include <stdint.h>
+#include <vector>
+#include "TrafficRecorder.h"
+#include "Robot.h"
+
+/***********************************************************************************************/
+// REPLAY_SETTINGS namespace contains the settings of the host traffic replayer
+namespace REPLAY_SETTINGS {
+	const uint32_t IDLE_CYCLE_PERIOD_US = 1000;    // update_robot() period between the recorded datagrams
+};
+/***********************************************************************************************/
+
+
+/***********************************************************************************************/
+// ReplayMode selects the clock of the replay
+enum ReplayMode {
+	REPLAY_REAL_TIME,       // datagrams are delivered at their recorded times on the real clock
+	REPLAY_FAST             // virtual clock jumps from one datagram to the next, as fast as possible
+};
+
+// ReplayStatistics describes a replay run
+struct ReplayStatistics {
+	uint32_t datagrams;
+	uint32_t undelivered_datagrams;  // not received by the robot, non zero if it does not replay from this replayer
+	uint32_t drains;                 // groups of datagrams the robot received within one cycle
+	uint32_t cycles;                 // update_robot() calls, including the idle cycles between drains
+	uint32_t recorded_duration_us;   // time from the first to the last datagram of the recording
+	uint64_t elapsed_us;             // host time the replay took
+	float datagrams_per_second;      // on the host clock
+};
+/***********************************************************************************************/
+
+
+/***********************************************************************************************
+* TrafficReplayer class feeds a recording of TrafficRecorder back through Robot::update_robot()
+* on the host against the simulated sonic boards (host build only)
+* This class implements following futures:
+* 1. Loads a recording flushed by the robot
+* 2. Delivers its datagrams to the robot in the groups they were received in, at the recorded
+*    times or as fast as possible on the virtual clock
+* 3. Compares the bus traffic of two recordings, so the output of two firmware versions
+*    replaying the same input can be checked to be byte identical
+************************************************************************************************/
+class TrafficReplayer : public DatagramSource
+{
+public:
+	bool load(const char*);
+	uint32_t get_datagram_count() const;
+	ReplayStatistics run(Robot&, ReplayMode);
+	uint32_t receive_datagram(uint8_t*, uint32_t) override;
+
+	static bool compare(const char*, const char*, uint32_t&);
+
+private:
+	std::vector<uint8_t> records;          // recording without the file header
+	std::vector<TrafficRecord> datagrams;  // payloads point into records
+	size_t next_datagram = 0;
+	size_t arrived_datagrams = 0;          // datagrams the robot can receive
+	uint32_t last_timestamp_us = 0;        // time of the last record
+
+	uint32_t run_idle_cycles(Robot&, uint32_t, uint32_t);
+	static bool read_recording(const char*, std::vector<uint8_t>&);
+};
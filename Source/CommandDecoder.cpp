@@ -0,0 +1,192 @@
+#include "CommandDecoder.h"
+#include "CommandSequence.h"
+#include <string.h>
+
+using namespace COMMAND_SCHEMA;
+
+// varints longer than this are invalid
+static const uint8_t MAX_VARINT_SIZE = 10;
+
+// reads a multi byte varint of at most 32 bits, false if it is truncated or longer
+static bool read_long_varint32(const uint8_t*& position, const uint8_t* end, uint32_t& value)
+{
+	value = 0;
+	for (uint8_t shift = 0; shift < 35; shift += 7) {
+		if (position == end) {
+			return false;
+		}
+		const uint8_t byte = *position++;
+		value |= static_cast<uint32_t>(byte & 0x7F) << shift;
+		if (!(byte & 0x80)) {
+			return shift < 28 || byte < 0x10;
+		}
+	}
+	return false;
+}
+
+// reads a varint of at most 32 bits (tags, lengths), false if it is truncated or longer
+// tags and lengths of this schema take a single byte, so that case is kept inline
+static inline bool read_varint32(const uint8_t*& position, const uint8_t* end, uint32_t& value)
+{
+	if (position != end && *position < 0x80) {
+		value = *position++;
+		return true;
+	}
+	return read_long_varint32(position, end, value);
+}
+
+// reads a varint of any width and keeps its low 32 bits, as protobuf does for uint32 fields
+static bool read_varint_low32(const uint8_t*& position, const uint8_t* end, uint32_t& value)
+{
+	value = 0;
+	for (uint8_t i = 0; i < MAX_VARINT_SIZE; i++) {
+		if (position == end) {
+			return false;
+		}
+		const uint8_t byte = *position++;
+		if (i < 5) {
+			value |= static_cast<uint32_t>(byte & 0x7F) << (7 * i);
+		}
+		if (!(byte & 0x80)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+// moves position past the value of a field, false if the value does not fit in the packet
+static bool skip_field(const uint8_t*& position, const uint8_t* end, uint8_t wire_type)
+{
+	uint32_t length = 0;
+
+	switch (wire_type) {
+	case WIRE_VARINT:
+		return read_varint_low32(position, end, length);
+	case WIRE_FIXED64:
+		length = 8;
+		break;
+	case WIRE_FIXED32:
+		length = 4;
+		break;
+	case WIRE_LENGTH_DELIMITED:
+		if (!read_varint32(position, end, length)) {
+			return false;
+		}
+		break;
+	default:
+		// groups are not used by proto3
+		return false;
+	}
+
+	if (static_cast<uint32_t>(end - position) < length) {
+		return false;
+	}
+	position += length;
+	return true;
+}
+
+typedef decltype(Command::move) MoveMessage;
+typedef decltype(Command::action) ActionMessage;
+
+// members of the float fields of the Move and Action messages, in the order of COMMAND_SCHEMA::MOVE_FIELDS and ACTION_FIELDS
+static float MoveMessage::* const MOVE_MEMBERS[3] = { &MoveMessage::x, &MoveMessage::y, &MoveMessage::r };
+static float ActionMessage::* const ACTION_MEMBERS[3] = { &ActionMessage::kick, &ActionMessage::chip, &ActionMessage::dribble };
+
+// decodes the three float fields of a Move or Action message
+template <typename Message>
+static CommandDecodeResult decode_vector(const uint8_t* position, const uint8_t* end, Message& message,
+	const uint8_t (&fields)[3], float Message::* const (&members)[3])
+{
+	while (position < end) {
+		uint32_t tag = 0;
+
+		if (!read_varint32(position, end, tag) || !(tag >> 3)) {
+			return DECODE_MALFORMED;
+		}
+
+		const uint32_t field = tag >> 3;
+		const uint8_t wire_type = tag & 0x07;
+		uint8_t member = 0;
+
+		while (member < 3 && fields[member] != field) {
+			member++;
+		}
+		if (member == 3) {
+			if (!skip_field(position, end, wire_type)) {
+				return DECODE_MALFORMED;
+			}
+			continue;
+		}
+		if (wire_type != WIRE_FIXED32) {
+			return DECODE_UNSUPPORTED;
+		}
+		if (end - position < 4) {
+			return DECODE_MALFORMED;
+		}
+		// the targets are little endian as the wire format
+		memcpy(&(message.*members[member]), position, sizeof(float));
+		position += sizeof(float);
+	}
+	return DECODE_OK;
+}
+
+/****************************************************************************************************************
+* Descrition: decode() function decodes a Command packet
+* Pre: none
+* Post: DECODE_OK is returned and command holds the packet, fields missing in the packet are zero
+*       otherwise command is undefined and the packet has to be passed to the generic parser
+*****************************************************************************************************************/
+CommandDecodeResult CommandDecoder::decode(const uint8_t* data, uint32_t length, Command& command)
+{
+	const Command zero_command = Command_init_zero;
+	const uint8_t* position = data;
+	const uint8_t* const end = data + length;
+
+	command = zero_command;
+
+	while (position < end) {
+		uint32_t tag = 0;
+
+		if (!read_varint32(position, end, tag) || !(tag >> 3)) {
+			return DECODE_MALFORMED;
+		}
+
+		const uint32_t field = tag >> 3;
+		const uint8_t wire_type = tag & 0x07;
+
+		if (field == COMMAND_MOVE || field == COMMAND_ACTION) {
+			uint32_t message_length = 0;
+
+			if (wire_type != WIRE_LENGTH_DELIMITED) {
+				return DECODE_UNSUPPORTED;
+			}
+			if (!read_varint32(position, end, message_length) || static_cast<uint32_t>(end - position) < message_length) {
+				return DECODE_MALFORMED;
+			}
+
+			const CommandDecodeResult result = field == COMMAND_MOVE
+				? decode_vector(position, position + message_length, command.move, MOVE_FIELDS, MOVE_MEMBERS)
+				: decode_vector(position, position + message_length, command.action, ACTION_FIELDS, ACTION_MEMBERS);
+
+			if (result != DECODE_OK) {
+				return result;
+			}
+			position += message_length;
+		}
+		else if (field == COMMAND_SEQUENCE && has_command_sequence<Command>::value) {
+			uint32_t sequence = 0;
+
+			if (wire_type != WIRE_VARINT) {
+				return DECODE_UNSUPPORTED;
+			}
+			if (!read_varint_low32(position, end, sequence)) {
+				return DECODE_MALFORMED;
+			}
+			set_command_sequence(command, sequence);
+		}
+		else if (!skip_field(position, end, wire_type)) {
+			return DECODE_MALFORMED;
+		}
+	}
+	return DECODE_OK;
+}
@@ -0,0 +1,67 @@
+#include "CommandSchema.h"
+#include <string.h>
+
+using namespace COMMAND_SCHEMA;
+
+static uint8_t make_tag(uint8_t field, uint8_t wire_type)
+{
+	return (field << 3) | wire_type;
+}
+
+// appends a float field unless it is zero, returns the new end of the buffer
+static uint8_t* write_float_field(uint8_t* buffer, uint8_t field, float value)
+{
+	if (value == 0.0f) {
+		return buffer;
+	}
+	*buffer++ = make_tag(field, WIRE_FIXED32);
+	memcpy(buffer, &value, sizeof(float));     // the target is little endian as the wire format
+	return buffer + sizeof(float);
+}
+
+// appends a submessage of three float fields (Move and Action) unless all of them are zero
+static uint8_t* write_vector_message(uint8_t* buffer, uint8_t field, const uint8_t (&fields)[3],
+	float first, float second, float third)
+{
+	uint8_t* length = buffer + 1;
+	uint8_t* end = buffer + 2;
+
+	end = write_float_field(end, fields[0], first);
+	end = write_float_field(end, fields[1], second);
+	end = write_float_field(end, fields[2], third);
+
+	if (end == buffer + 2) {
+		return buffer;
+	}
+	buffer[0] = make_tag(field, WIRE_LENGTH_DELIMITED);
+	*length = static_cast<uint8_t>(end - buffer - 2);
+	return end;
+}
+
+/****************************************************************************************************************
+* Descrition: encode() function encodes a command and its sequence number
+* Pre: capacity is at least COMMAND_SCHEMA::MAX_ENCODED_SIZE
+*      the sequence number is encoded only if Command has the sequence field
+* Post: length of the encoded message is returned, 0 if the buffer is too small
+*****************************************************************************************************************/
+uint32_t CommandEncoder::encode(const Command& command, uint32_t sequence, uint8_t* buffer, uint32_t capacity)
+{
+	if (capacity < MAX_ENCODED_SIZE) {
+		return 0;
+	}
+
+	uint8_t* end = buffer;
+
+	end = write_vector_message(end, COMMAND_MOVE, MOVE_FIELDS, command.move.x, command.move.y, command.move.r);
+	end = write_vector_message(end, COMMAND_ACTION, ACTION_FIELDS, command.action.kick, command.action.chip, command.action.dribble);
+
+	if (has_command_sequence<Command>::value && sequence) {
+		*end++ = make_tag(COMMAND_SEQUENCE, WIRE_VARINT);
+		while (sequence >= 0x80) {
+			*end++ = static_cast<uint8_t>(sequence) | 0x80;
+			sequence >>= 7;
+		}
+		*end++ = static_cast<uint8_t>(sequence);
+	}
+	return end - buffer;
+}
@@ -0,0 +1,120 @@
+#include "CommandWatchdog.h"
+#include "Hal.h"
+
+/****************************************************************************************************************
+* Descrition: CommandWatchdog() constructor creates an expired watchdog so the robot starts halted
+* Pre:  none
+* Post: deadline is DEFAULT_DEADLINE_MS
+*****************************************************************************************************************/
+CommandWatchdog::CommandWatchdog()
+	: deadline_ms(WATCHDOG_SETTINGS::DEFAULT_DEADLINE_MS), last_feed_ms(0), fed(false), expired(true)
+{
+}
+
+/****************************************************************************************************************
+* Descrition: set_deadline_ms() function sets the max time between two commands
+* Pre:  deadline is greater than zero
+* Post: next checks use the new deadline
+*****************************************************************************************************************/
+void CommandWatchdog::set_deadline_ms(uint32_t deadline)
+{
+	deadline_ms.store(deadline, std::memory_order_relaxed);
+}
+
+uint32_t CommandWatchdog::get_deadline_ms() const
+{
+	return deadline_ms.load(std::memory_order_relaxed);
+}
+
+/****************************************************************************************************************
+* Descrition: feed() function records that a command was applied
+* Pre:  now_ms is hal::millis()
+* Post: watchdog is not expired, lateness of the command is recorded if it missed the deadline
+*****************************************************************************************************************/
+void CommandWatchdog::feed(uint32_t now_ms)
+{
+	const uint32_t elapsed_ms = now_ms - last_feed_ms.load(std::memory_order_relaxed);
+	const uint32_t deadline = deadline_ms.load(std::memory_order_relaxed);
+
+	if (fed.load(std::memory_order_relaxed) && elapsed_ms > deadline) {
+		const uint32_t late_ms = elapsed_ms - deadline;
+
+		statistics.late_commands++;
+		statistics.total_late_ms += late_ms;
+		if (late_ms > statistics.max_late_ms) {
+			statistics.max_late_ms = late_ms;
+		}
+	}
+
+	last_feed_ms.store(now_ms, std::memory_order_relaxed);
+	fed.store(true, std::memory_order_relaxed);
+	expired.store(false, std::memory_order_release);
+}
+
+/****************************************************************************************************************
+* Descrition: check() function detects that the deadline passed without a command
+* Pre:  now_ms is hal::millis(), called periodically from a single context
+* Post: true is returned once when the watchdog expires, the expiration is counted
+*****************************************************************************************************************/
+bool CommandWatchdog::check(uint32_t now_ms)
+{
+	if (expired.load(std::memory_order_acquire)) {
+		return false;
+	}
+
+	const uint32_t elapsed_ms = now_ms - last_feed_ms.load(std::memory_order_relaxed);
+	const uint32_t deadline = deadline_ms.load(std::memory_order_relaxed);
+
+	// a command fed after now_ms was taken is not late, the difference wraps around
+	if (static_cast<int32_t>(elapsed_ms) < 0 || elapsed_ms <= deadline) {
+		return false;
+	}
+
+	expired.store(true, std::memory_order_release);
+
+	// a command applied meanwhile wins
+	if (last_feed_ms.load(std::memory_order_acquire) != now_ms - elapsed_ms) {
+		expired.store(false, std::memory_order_release);
+		return false;
+	}
+
+	// time the deadline actually passed, to measure the halt latency
+	expired_since_us = hal::micros() - (elapsed_ms - deadline) * 1000;
+	statistics.expirations++;
+	return true;
+}
+
+/****************************************************************************************************************
+* Descrition: is_expired() function checks whether the robot must stay halted
+* Pre:  none
+* Post: true is returned if no command was applied within the deadline
+*****************************************************************************************************************/
+bool CommandWatchdog::is_expired() const
+{
+	return expired.load(std::memory_order_acquire);
+}
+
+/****************************************************************************************************************
+* Descrition: record_halt() function records the completion of the halt that followed an expiration
+* Pre:  now_us is hal::micros() after the halt, check() returned true before the halt
+* Post: halt latency statistics are updated
+*****************************************************************************************************************/
+void CommandWatchdog::record_halt(uint32_t now_us)
+{
+	const uint32_t latency_us = now_us - expired_since_us;
+
+	statistics.last_halt_latency_us = latency_us;
+	if (latency_us > statistics.max_halt_latency_us) {
+		statistics.max_halt_latency_us = latency_us;
+	}
+}
+
+/****************************************************************************************************************
+* Descrition: get_statistics() function returns the watchdog statistics
+* Pre:  none
+* Post: none
+*****************************************************************************************************************/
+WatchdogStatistics CommandWatchdog::get_statistics() const
+{
+	return statistics;
+}
@@ -0,0 +1,480 @@
+#ifndef ARDUINO
+#include "FirmwareBenchmark.h"
+#include "CommandDecoder.h"
+#include "HalSimulation.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <algorithm>
+#include <chrono>
+#include <new>
+
+using namespace BENCHMARK_SETTINGS;
+
+// every heap allocation of the process is counted so the benchmarks can report allocations/op
+static std::atomic<uint64_t> allocation_count(0);
+
+void* operator new(size_t size)
+{
+	allocation_count.fetch_add(1, std::memory_order_relaxed);
+
+	void* memory = malloc(size ? size : 1);
+	if (!memory) {
+		throw std::bad_alloc();
+	}
+	return memory;
+}
+
+void operator delete(void* memory) noexcept
+{
+	free(memory);
+}
+
+namespace {
+
+	const char* const BENCHMARK_NAMES[BENCH_COUNT] = {
+		"update_motors",
+		"parse_command",
+		"decode_command",
+		"update_robot",
+		"halt_robot",
+	};
+
+	Command make_command(float x, float y, float r, float kick, float chip, float dribble)
+	{
+		Command command = Command_init_zero;
+
+		command.move.x = x;
+		command.move.y = y;
+		command.move.r = r;
+		command.action.kick = kick;
+		command.action.chip = chip;
+		command.action.dribble = dribble;
+		return command;
+	}
+
+	// commands as the server sends them during a match: driving, driving with the dribbler, kicking, stopped
+	const uint8_t REPRESENTATIVE_COMMAND_COUNT = 4;
+
+	const Command REPRESENTATIVE_COMMANDS[REPRESENTATIVE_COMMAND_COUNT] = {
+		make_command(0.8f, -0.35f, 1.2f, 0.0f, 0.0f, 0.0f),
+		make_command(0.25f, 0.1f, -0.4f, 0.0f, 0.0f, 1.0f),
+		make_command(-0.5f, 0.6f, 0.0f, 1.0f, 0.0f, 0.5f),
+		make_command(0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f),
+	};
+
+	uint8_t encoded_commands[REPRESENTATIVE_COMMAND_COUNT][COMMAND_SCHEMA::MAX_ENCODED_SIZE];
+	uint32_t encoded_lengths[REPRESENTATIVE_COMMAND_COUNT];
+	Command decoded_command = Command_init_zero;
+
+	void encode_representative_commands()
+	{
+		for (uint8_t i = 0; i < REPRESENTATIVE_COMMAND_COUNT; i++) {
+			encoded_lengths[i] = CommandEncoder::encode(REPRESENTATIVE_COMMANDS[i], i + 1, encoded_commands[i],
+				sizeof(encoded_commands[i]));
+		}
+	}
+
+	// fills the stack below the caller with a pattern
+	__attribute__((noinline)) void paint_stack()
+	{
+		volatile uint8_t probe[STACK_PROBE_SIZE];
+
+		for (uint32_t i = 0; i < STACK_PROBE_SIZE; i++) {
+			probe[i] = 0xA5;
+		}
+		(void)probe;
+	}
+
+	// returns how deep below the caller the pattern of paint_stack() was overwritten
+	__attribute__((noinline)) uint32_t painted_stack_used()
+	{
+		volatile uint8_t probe[STACK_PROBE_SIZE];
+		// read through a pointer, the probe is left as paint_stack() wrote it on purpose
+		volatile uint8_t* volatile painted = probe;
+		uint32_t untouched = 0;
+
+		while (untouched < STACK_PROBE_SIZE && painted[untouched] == 0xA5) {
+			untouched++;
+		}
+		return STACK_PROBE_SIZE - untouched;
+	}
+
+	// byte counter of the benchmarks that do not use the bus
+	uint32_t no_bus_bytes()
+	{
+		return 0;
+	}
+
+	// counts the bytes of the batched frames instead of clocking them on the bus
+	class MockBusBackend : public SpiBusBackend
+	{
+	public:
+		uint32_t bytes = 0;
+
+		void transfer_frame(uint8_t, const uint8_t*, uint8_t* rx_data, uint8_t length) override
+		{
+			bytes += length;
+			memset(rx_data, 0, length);
+		}
+	};
+
+	// delivers one representative command with a new sequence number per update_robot() call
+	class BenchmarkDatagramSource : public DatagramSource
+	{
+	public:
+		bool is_datagram_waiting = false;
+		uint32_t sequence = 0;
+
+		uint32_t receive_datagram(uint8_t* buffer, uint32_t capacity) override
+		{
+			if (!is_datagram_waiting) {
+				return 0;
+			}
+			is_datagram_waiting = false;
+			sequence++;
+			return CommandEncoder::encode(REPRESENTATIVE_COMMANDS[sequence % REPRESENTATIVE_COMMAND_COUNT],
+				sequence, buffer, capacity);
+		}
+	};
+
+	BenchmarkDatagramSource datagram_source;
+	SimulatedSonicBoard simulated_boards[SONIC_BOARD_TOPOLOGY::BOARD_COUNT];
+
+	// robot shared by the robot benchmarks, it takes its commands from datagram_source
+	Robot& get_benchmark_robot()
+	{
+		static Robot* robot = nullptr;
+
+		for (uint8_t module_id = 0; module_id < SONIC_BOARD_TOPOLOGY::BOARD_COUNT; module_id++) {
+			hal_sim::attach_sonic_board(SONIC_BOARD_TOPOLOGY::BOARDS[module_id].cs_pin, &simulated_boards[module_id]);
+		}
+		if (!robot) {
+			robot = new Robot();
+			robot->init_replay(datagram_source);
+		}
+		return *robot;
+	}
+}
+
+/****************************************************************************************************************
+* Descrition: run() function runs the benchmark tool: measures all the benchmarks and compares them with a baseline
+* Pre: no other robot or simulated board is in use in the process
+* Post: with update_baseline set, or if there is no baseline yet, the results are stored as the baseline
+*       0 is returned if no benchmark regressed (process exit code), 1 otherwise
+*****************************************************************************************************************/
+int FirmwareBenchmark::run(const char* baseline_path, bool update_baseline, float threshold)
+{
+	const bool has_baseline_file = load_baseline(baseline_path);
+
+	run_all();
+	report();
+
+	if (!update_baseline && !has_baseline_file) {
+		hal::log("no baseline in %s, storing this run as the baseline\n", baseline_path);
+		update_baseline = true;
+	}
+	if (update_baseline) {
+		return save_baseline(baseline_path) ? 0 : 1;
+	}
+	return check_regressions(threshold) ? 1 : 0;
+}
+
+/****************************************************************************************************************
+* Descrition: run_all() function measures all the benchmarks
+* Pre: no other robot or simulated board is in use in the process
+* Post: results are available from get_result(), the hal clock is left virtual, simulated boards are detached
+*****************************************************************************************************************/
+void FirmwareBenchmark::run_all()
+{
+	hal_sim::set_virtual_clock(true);
+
+	run_update_motors();
+	run_parse_command();
+	run_decode_command();
+	run_update_robot();
+	run_halt_robot();
+
+	hal_sim::detach_all_sonic_boards();
+}
+
+const BenchmarkResult& FirmwareBenchmark::get_result(BenchmarkId benchmark) const
+{
+	return results[benchmark];
+}
+
+const char* FirmwareBenchmark::get_name(BenchmarkId benchmark)
+{
+	return BENCHMARK_NAMES[benchmark];
+}
+
+/****************************************************************************************************************
+* Descrition: report() function logs the results next to the baseline
+* Pre: run_all() was called
+* Post: none
+*****************************************************************************************************************/
+void FirmwareBenchmark::report() const
+{
+	hal::log("%-16s %12s %12s %12s %12s %12s\n", "benchmark", "ns/op", "baseline", "allocs/op", "bus bytes/op", "stack bytes");
+	for (uint8_t benchmark = 0; benchmark < BENCH_COUNT; benchmark++) {
+		const BenchmarkResult& result = results[benchmark];
+		char baseline_text[16] = "-";
+
+		if (has_baseline[benchmark]) {
+			snprintf(baseline_text, sizeof(baseline_text), "%.1f", baseline[benchmark].ns_per_op);
+		}
+		hal::log("%-16s %12.1f %12s %12.2f %12.1f %12lu\n", BENCHMARK_NAMES[benchmark], result.ns_per_op, baseline_text,
+			result.allocations_per_op, result.bus_bytes_per_op, static_cast<unsigned long>(result.stack_bytes));
+	}
+}
+
+/****************************************************************************************************************
+* Descrition: save_baseline() function stores the results as the baseline
+* Pre: run_all() was called
+* Post: true is returned if the file was written, one line per benchmark:
+*       [name] [ns/op] [allocs/op] [bus bytes/op] [stack bytes]
+*****************************************************************************************************************/
+bool FirmwareBenchmark::save_baseline(const char* path) const
+{
+	char text[BENCH_COUNT * 80];
+	int length = 0;
+
+	for (uint8_t benchmark = 0; benchmark < BENCH_COUNT; benchmark++) {
+		const BenchmarkResult& result = results[benchmark];
+		length += snprintf(text + length, sizeof(text) - length, "%s %.2f %.4f %.2f %lu\n", BENCHMARK_NAMES[benchmark],
+			result.ns_per_op, result.allocations_per_op, result.bus_bytes_per_op,
+			static_cast<unsigned long>(result.stack_bytes));
+	}
+
+	const bool is_written = hal::file_write(path, text, length, false);
+	if (!is_written) {
+		hal::log("ERROR: failed to write benchmark baseline %s\n", path);
+	}
+	return is_written;
+}
+
+/****************************************************************************************************************
+* Descrition: load_baseline() function loads a baseline stored by save_baseline()
+* Pre: none
+* Post: true is returned if the file was read, benchmarks missing in the file are not checked
+*****************************************************************************************************************/
+bool FirmwareBenchmark::load_baseline(const char* path)
+{
+	FILE* file = fopen(path, "r");
+	char name[32];
+	unsigned long stack_bytes = 0;
+	BenchmarkResult entry = {};
+
+	memset(has_baseline, 0, sizeof(has_baseline));
+	if (!file) {
+		return false;
+	}
+
+	while (fscanf(file, "%31s %f %f %f %lu", name, &entry.ns_per_op, &entry.allocations_per_op, &entry.bus_bytes_per_op,
+		&stack_bytes) == 5) {
+		entry.stack_bytes = stack_bytes;
+		for (uint8_t benchmark = 0; benchmark < BENCH_COUNT; benchmark++) {
+			if (strcmp(name, BENCHMARK_NAMES[benchmark]) == 0) {
+				baseline[benchmark] = entry;
+				has_baseline[benchmark] = true;
+			}
+		}
+	}
+	fclose(file);
+	return true;
+}
+
+/****************************************************************************************************************
+* Descrition: check_regressions() function compares the results with the baseline
+* Pre: run_all() and load_baseline() were called, threshold is the allowed relative ns/op increase,
+*      NO_TIMING_THRESHOLD (negative) leaves ns/op unchecked
+* Post: number of regressed benchmarks is returned, every regression is logged
+*       allocations and bus bytes are deterministic, so any increase of them is a regression,
+*       the stack depends on the compiler version and may grow by STACK_TOLERANCE
+*****************************************************************************************************************/
+uint8_t FirmwareBenchmark::check_regressions(float threshold) const
+{
+	uint8_t regressions = 0;
+
+	for (uint8_t benchmark = 0; benchmark < BENCH_COUNT; benchmark++) {
+		if (!has_baseline[benchmark]) {
+			continue;
+		}
+
+		const BenchmarkResult& result = results[benchmark];
+		const BenchmarkResult& reference = baseline[benchmark];
+		const bool is_slower = threshold >= 0.0f && result.ns_per_op > reference.ns_per_op * (1.0f + threshold);
+		const bool allocates_more = result.allocations_per_op > reference.allocations_per_op + 0.001f;
+		const bool uses_more_bus = result.bus_bytes_per_op > reference.bus_bytes_per_op + 0.01f;
+		const bool uses_more_stack = result.stack_bytes > reference.stack_bytes + STACK_TOLERANCE;
+
+		if (is_slower || allocates_more || uses_more_bus || uses_more_stack) {
+			hal::log("REGRESSION: %s %.1f ns/op (baseline %.1f), %.2f allocs/op (%.2f), %.1f bus bytes/op (%.1f), "
+				"%lu stack bytes (%lu)\n",
+				BENCHMARK_NAMES[benchmark], result.ns_per_op, reference.ns_per_op, result.allocations_per_op,
+				reference.allocations_per_op, result.bus_bytes_per_op, reference.bus_bytes_per_op,
+				static_cast<unsigned long>(result.stack_bytes), static_cast<unsigned long>(reference.stack_bytes));
+			regressions++;
+		}
+	}
+	return regressions;
+}
+
+/****************************************************************************************************************
+* Descrition: run_update_motors() function measures update_motors() with the spi backend mocked
+* Pre: none
+* Post: the velocity changes every iteration, so no write is coalesced
+*****************************************************************************************************************/
+void FirmwareBenchmark::run_update_motors()
+{
+	static SonicBoardController controller;
+	static MockBusBackend backend;
+
+	// the backend only sees the batched frames, the legacy protocol would bypass it
+	controller.set_batched_frame_enabled(true);
+	controller.set_bus_backend(backend);
+
+	results[BENCH_UPDATE_MOTORS] = measure([](uint32_t iteration) {
+		const float phase = (iteration % 64) * 0.05f;
+		controller.update_motors(phase, 0.5f - phase, 0.2f);
+	}, [] { return backend.bytes; });
+}
+
+/****************************************************************************************************************
+* Descrition: run_parse_command() function measures the protobuf decoding of the representative commands
+* Pre: none
+* Post: none
+*****************************************************************************************************************/
+void FirmwareBenchmark::run_parse_command()
+{
+	static ProtobufParser parser;
+
+	encode_representative_commands();
+
+	const auto parse = [](uint32_t iteration) {
+		const uint8_t i = iteration % REPRESENTATIVE_COMMAND_COUNT;
+		parser.parse_udp_packet(encoded_commands[i], decoded_command, encoded_lengths[i]);
+	};
+
+	results[BENCH_PARSE_COMMAND] = measure(parse, no_bus_bytes);
+	results[BENCH_PARSE_COMMAND].stack_bytes = measure_stack(parse);
+}
+
+/****************************************************************************************************************
+* Descrition: run_decode_command() function measures the specialized command decoder on the commands
+* of run_parse_command(), so both decoders can be compared
+* Pre: none
+* Post: none
+*****************************************************************************************************************/
+void FirmwareBenchmark::run_decode_command()
+{
+	encode_representative_commands();
+
+	const auto decode = [](uint32_t iteration) {
+		const uint8_t i = iteration % REPRESENTATIVE_COMMAND_COUNT;
+		CommandDecoder::decode(encoded_commands[i], encoded_lengths[i], decoded_command);
+	};
+
+	results[BENCH_DECODE_COMMAND] = measure(decode, no_bus_bytes);
+	results[BENCH_DECODE_COMMAND].stack_bytes = measure_stack(decode);
+}
+
+/****************************************************************************************************************
+* Descrition: run_update_robot() function measures update_robot() with a new command every cycle
+* Pre: none
+* Post: none
+*****************************************************************************************************************/
+void FirmwareBenchmark::run_update_robot()
+{
+	Robot& robot = get_benchmark_robot();
+
+	results[BENCH_UPDATE_ROBOT] = measure([&robot](uint32_t) {
+		datagram_source.is_datagram_waiting = true;
+		robot.update_robot();
+	}, [&robot] { return robot.sonic_board_controller.get_bus_statistics().bytes; });
+}
+
+/****************************************************************************************************************
+* Descrition: run_halt_robot() function measures halt_robot() of a robot that is already halted,
+* which is what the watchdog repeats while the link is down
+* Pre: none
+* Post: none
+*****************************************************************************************************************/
+void FirmwareBenchmark::run_halt_robot()
+{
+	Robot& robot = get_benchmark_robot();
+
+	robot.halt_robot();
+
+	results[BENCH_HALT_ROBOT] = measure([&robot](uint32_t) {
+		robot.halt_robot();
+	}, [&robot] { return robot.sonic_board_controller.get_bus_statistics().bytes; });
+}
+
+/****************************************************************************************************************
+* Descrition: measure() function measures the cost of one call of an operation
+* Pre: operation takes the iteration number, bus_bytes returns the bytes clocked on the bus so far
+* Post: result of the fastest repetition is returned
+*****************************************************************************************************************/
+template <typename Operation, typename ByteCounter>
+BenchmarkResult FirmwareBenchmark::measure(Operation operation, ByteCounter bus_bytes)
+{
+	BenchmarkResult best = {};
+	uint32_t iteration = 0;
+
+	for (; iteration < WARMUP_ITERATIONS; iteration++) {
+		operation(iteration);
+	}
+
+	for (uint8_t repetition = 0; repetition < REPETITIONS; repetition++) {
+		const uint64_t start_allocations = allocation_count.load(std::memory_order_relaxed);
+		const uint32_t start_bytes = bus_bytes();
+		const std::chrono::steady_clock::time_point start_time = std::chrono::steady_clock::now();
+		uint32_t iterations = 0;
+		uint64_t elapsed_ns = 0;
+
+		do {
+			for (uint32_t i = 0; i < BATCH_ITERATIONS; i++) {
+				operation(iteration++);
+			}
+			iterations += BATCH_ITERATIONS;
+			elapsed_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+				std::chrono::steady_clock::now() - start_time).count();
+		} while (elapsed_ns < REPETITION_TIME_US * 1000ull);
+
+		const float ns_per_op = static_cast<float>(elapsed_ns) / iterations;
+
+		if (!repetition || ns_per_op < best.ns_per_op) {
+			best.iterations = iterations;
+			best.ns_per_op = ns_per_op;
+			best.allocations_per_op = static_cast<float>(allocation_count.load(std::memory_order_relaxed) - start_allocations) / iterations;
+			best.bus_bytes_per_op = static_cast<float>(bus_bytes() - start_bytes) / iterations;
+		}
+	}
+	return best;
+}
+
+/****************************************************************************************************************
+* Descrition: measure_stack() function measures the stack used by one call of an operation
+* Pre: operation uses less than STACK_PROBE_SIZE bytes of stack
+* Post: max stack bytes of the representative calls are returned, the overhead of the probe itself is subtracted,
+*       so uses smaller than that overhead read as 0
+*****************************************************************************************************************/
+template <typename Operation>
+uint32_t FirmwareBenchmark::measure_stack(Operation operation)
+{
+	uint32_t used_bytes = 0;
+
+	paint_stack();
+	const uint32_t probe_bytes = painted_stack_used();
+
+	for (uint32_t iteration = 0; iteration < REPRESENTATIVE_COMMAND_COUNT; iteration++) {
+		paint_stack();
+		operation(iteration);
+		const uint32_t operation_bytes = painted_stack_used();
+		used_bytes = std::max(used_bytes, operation_bytes > probe_bytes ? operation_bytes - probe_bytes : 0);
+	}
+	return used_bytes;
+}
+#endif
@@ -0,0 +1,289 @@
+#ifdef ARDUINO
+#include "Hal.h"
+#include <Arduino.h>
+#include <SPI.h>
+#include <Preferences.h>
+#include <SPIFFS.h>
+#include <soc/gpio_reg.h>
+#include <lwip/sockets.h>
+#include <stdarg.h>
+#include <stdio.h>
+
+// namespace of the keys written with hal::storage_write()
+static const char* STORAGE_NAMESPACE = "robot";
+
+// flash file system is mounted by the first hal::file_write()
+static bool is_file_system_mounted = false;
+
+/****************************************************************************************************************
+* gpio
+*****************************************************************************************************************/
+void hal::gpio_set_output(uint8_t pin)
+{
+	pinMode(pin, OUTPUT);
+}
+
+void hal::gpio_write(uint8_t pin, uint8_t level)
+{
+	digitalWrite(pin, level == GPIO_LOW ? LOW : HIGH);
+}
+
+void hal::gpio_fast_write(uint8_t pin, uint8_t level)
+{
+	// write one to set / write one to clear registers, gpio 32 and above live in the second bank
+	if (pin < 32) {
+		REG_WRITE(level == GPIO_LOW ? GPIO_OUT_W1TC_REG : GPIO_OUT_W1TS_REG, 1UL << pin);
+	}
+	else {
+		REG_WRITE(level == GPIO_LOW ? GPIO_OUT1_W1TC_REG : GPIO_OUT1_W1TS_REG, 1UL << (pin - 32));
+	}
+}
+
+/****************************************************************************************************************
+* spi bus
+*****************************************************************************************************************/
+void hal::spi_begin(uint32_t frequency)
+{
+	SPI.begin();
+	SPI.setFrequency(frequency);
+}
+
+void hal::spi_set_frequency(uint32_t frequency)
+{
+	SPI.setFrequency(frequency);
+}
+
+uint8_t hal::spi_transfer(uint8_t data)
+{
+	return SPI.transfer(data);
+}
+
+void hal::spi_transfer_bytes(const uint8_t* tx_data, uint8_t* rx_data, uint32_t length)
+{
+	SPI.transferBytes(tx_data, rx_data, length);
+}
+
+/****************************************************************************************************************
+* clock
+*****************************************************************************************************************/
+uint32_t hal::millis()
+{
+	return ::millis();
+}
+
+uint32_t hal::micros()
+{
+	return ::micros();
+}
+
+void hal::delay_ms(uint32_t delay_ms)
+{
+	::delay(delay_ms);
+}
+
+void hal::delay_us(uint32_t delay_us)
+{
+	::delayMicroseconds(delay_us);
+}
+
+uint32_t hal::cycle_counter()
+{
+	return xthal_get_ccount();
+}
+
+uint32_t hal::cycle_counter_frequency_mhz()
+{
+	return getCpuFrequencyMhz();
+}
+
+/****************************************************************************************************************
+* logging
+*****************************************************************************************************************/
+void hal::log(const char* format, ...)
+{
+	char message[128];
+	va_list arguments;
+
+	va_start(arguments, format);
+	vsnprintf(message, sizeof(message), format, arguments);
+	va_end(arguments);
+
+	Serial.print(message);
+}
+
+/****************************************************************************************************************
+* udp
+*****************************************************************************************************************/
+hal::UdpHandle hal::udp_open(uint16_t port)
+{
+	sockaddr_in address = {};
+	const int udp_socket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+
+	if (udp_socket < 0) {
+		return INVALID_UDP_HANDLE;
+	}
+
+	address.sin_family = AF_INET;
+	address.sin_port = htons(port);
+	address.sin_addr.s_addr = htonl(INADDR_ANY);
+
+	if (bind(udp_socket, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0) {
+		close(udp_socket);
+		return INVALID_UDP_HANDLE;
+	}
+
+	fcntl(udp_socket, F_SETFL, O_NONBLOCK);
+	return udp_socket;
+}
+
+void hal::udp_close(UdpHandle udp_socket)
+{
+	if (udp_socket != INVALID_UDP_HANDLE) {
+		close(udp_socket);
+	}
+}
+
+uint32_t hal::udp_receive(UdpHandle udp_socket, uint8_t* buffer, uint32_t capacity)
+{
+	if (udp_socket == INVALID_UDP_HANDLE) {
+		return 0;
+	}
+
+	int received = recv(udp_socket, buffer, capacity, MSG_DONTWAIT);
+	return received > 0 ? static_cast<uint32_t>(received) : 0;
+}
+
+// the calling task sleeps in lwip until the wifi task delivers a datagram to the socket
+bool hal::udp_wait(UdpHandle udp_socket, uint32_t timeout_ms)
+{
+	if (udp_socket == INVALID_UDP_HANDLE) {
+		return false;
+	}
+
+	fd_set readable;
+	timeval timeout = {};
+
+	timeout.tv_sec = timeout_ms / 1000;
+	timeout.tv_usec = (timeout_ms % 1000) * 1000;
+	FD_ZERO(&readable);
+	FD_SET(udp_socket, &readable);
+	return select(udp_socket + 1, &readable, nullptr, nullptr, &timeout) > 0;
+}
+
+bool hal::udp_send(UdpHandle udp_socket, const char* ip, uint16_t port, const uint8_t* data, uint32_t length)
+{
+	sockaddr_in address = {};
+
+	if (udp_socket == INVALID_UDP_HANDLE) {
+		return false;
+	}
+
+	address.sin_family = AF_INET;
+	address.sin_port = htons(port);
+	address.sin_addr.s_addr = inet_addr(ip);
+
+	return sendto(udp_socket, data, length, 0, reinterpret_cast<sockaddr*>(&address), sizeof(address)) ==
+		static_cast<int>(length);
+}
+
+/****************************************************************************************************************
+* tasks
+*****************************************************************************************************************/
+hal::TaskHandle hal::task_create(const char* name, TaskFunction function, void* parameter,
+	                             uint32_t stack_size, uint32_t priority, int core)
+{
+	TaskHandle_t handle = nullptr;
+
+	if (xTaskCreatePinnedToCore(function, name, stack_size, parameter, priority, &handle, core) != pdPASS) {
+		return nullptr;
+	}
+	return handle;
+}
+
+void hal::task_notify(TaskHandle handle)
+{
+	xTaskNotifyGive(static_cast<TaskHandle_t>(handle));
+}
+
+bool hal::task_wait_notification(uint32_t timeout_ms)
+{
+	const TickType_t timeout = timeout_ms == WAIT_FOREVER ? portMAX_DELAY : pdMS_TO_TICKS(timeout_ms);
+	return ulTaskNotifyTake(pdTRUE, timeout) != 0;
+}
+
+void hal::task_yield()
+{
+	taskYIELD();
+}
+
+void hal::task_exit()
+{
+	vTaskDelete(nullptr);
+}
+
+hal::MutexHandle hal::mutex_create()
+{
+	return xSemaphoreCreateMutex();
+}
+
+void hal::mutex_lock(MutexHandle handle)
+{
+	xSemaphoreTake(static_cast<SemaphoreHandle_t>(handle), portMAX_DELAY);
+}
+
+void hal::mutex_unlock(MutexHandle handle)
+{
+	xSemaphoreGive(static_cast<SemaphoreHandle_t>(handle));
+}
+
+/****************************************************************************************************************
+* non-volatile storage
+*****************************************************************************************************************/
+bool hal::storage_read(const char* key, void* data, uint32_t size)
+{
+	Preferences preferences;
+	bool is_read = false;
+
+	if (!preferences.begin(STORAGE_NAMESPACE, true)) {
+		return false;
+	}
+	if (preferences.getBytesLength(key) == size) {
+		is_read = preferences.getBytes(key, data, size) == size;
+	}
+	preferences.end();
+	return is_read;
+}
+
+bool hal::storage_write(const char* key, const void* data, uint32_t size)
+{
+	Preferences preferences;
+
+	if (!preferences.begin(STORAGE_NAMESPACE, false)) {
+		return false;
+	}
+	const bool is_written = preferences.putBytes(key, data, size) == size;
+	preferences.end();
+	return is_written;
+}
+
+/****************************************************************************************************************
+* files
+*****************************************************************************************************************/
+bool hal::file_write(const char* path, const void* data, uint32_t size, bool append)
+{
+	// formats the partition if it was never used
+	if (!is_file_system_mounted && !SPIFFS.begin(true)) {
+		return false;
+	}
+	is_file_system_mounted = true;
+
+	File file = SPIFFS.open(path, append ? FILE_APPEND : FILE_WRITE);
+
+	if (!file) {
+		return false;
+	}
+	const bool is_written = file.write(static_cast<const uint8_t*>(data), size) == size;
+	file.close();
+	return is_written;
+}
+#endif
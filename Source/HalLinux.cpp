@@ -0,0 +1,495 @@
+#ifndef ARDUINO
+#include "Hal.h"
+#include "HalSimulation.h"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+	struct SimulatedBoardSlot {
+		uint8_t cs_pin;
+		bool selected;
+		SimulatedSonicBoard* board;
+	};
+
+	SimulatedBoardSlot board_slots[hal_sim::MAX_SIMULATED_BOARDS] = {};
+	uint32_t spi_frequency = 0;
+
+	// bit errors injected into the bytes clocked above max_clean_spi_frequency
+	uint32_t max_clean_spi_frequency = 0xFFFFFFFF;
+	uint32_t corrupted_bytes_per_million = 0;
+	uint32_t corruption_random_state = 1;
+
+	bool virtual_clock = false;
+	std::atomic<uint64_t> virtual_time_us(0);
+	const std::chrono::steady_clock::time_point start_time = std::chrono::steady_clock::now();
+
+	// non-volatile storage lives in memory for the lifetime of the process
+	std::mutex storage_mutex;
+	std::map<std::string, std::vector<uint8_t>> storage;
+
+	// state of a task created with hal::task_create()
+	struct HostTask {
+		std::thread thread;
+		std::mutex mutex;
+		std::condition_variable condition;
+		uint32_t notifications = 0;
+	};
+
+	thread_local HostTask* current_task = nullptr;
+
+	uint64_t now_us()
+	{
+		if (virtual_clock) {
+			return virtual_time_us.load();
+		}
+		return std::chrono::duration_cast<std::chrono::microseconds>(
+			std::chrono::steady_clock::now() - start_time).count();
+	}
+
+	sockaddr_in make_address(const char* ip, uint16_t port)
+	{
+		sockaddr_in address = {};
+
+		address.sin_family = AF_INET;
+		address.sin_port = htons(port);
+		address.sin_addr.s_addr = inet_addr(ip);
+		return address;
+	}
+}
+
+/****************************************************************************************************************
+* gpio - chip select pins of the attached simulated boards drive their select state
+*****************************************************************************************************************/
+void hal::gpio_set_output(uint8_t)
+{
+}
+
+void hal::gpio_write(uint8_t pin, uint8_t level)
+{
+	for (SimulatedBoardSlot& slot : board_slots) {
+		if (!slot.board || slot.cs_pin != pin) {
+			continue;
+		}
+
+		const bool select = level == GPIO_LOW;
+		if (select && !slot.selected) {
+			slot.board->select();
+		}
+		else if (!select && slot.selected) {
+			slot.board->deselect();
+		}
+		slot.selected = select;
+	}
+}
+
+void hal::gpio_fast_write(uint8_t pin, uint8_t level)
+{
+	gpio_write(pin, level);
+}
+
+/****************************************************************************************************************
+* spi bus - bytes are exchanged with the selected simulated board, the bus floats high otherwise
+*****************************************************************************************************************/
+void hal::spi_begin(uint32_t frequency)
+{
+	spi_frequency = frequency;
+}
+
+void hal::spi_set_frequency(uint32_t frequency)
+{
+	spi_frequency = frequency;
+}
+
+// flips a random bit of a byte with the configured probability once the clock exceeds the clean limit
+static uint8_t corrupt_byte(uint8_t data)
+{
+	if (spi_frequency <= max_clean_spi_frequency || !corrupted_bytes_per_million) {
+		return data;
+	}
+
+	corruption_random_state = corruption_random_state * 1103515245 + 12345;
+	if ((corruption_random_state >> 8) % 1000000 >= corrupted_bytes_per_million) {
+		return data;
+	}
+	return data ^ (1 << ((corruption_random_state >> 4) & 0x07));
+}
+
+uint8_t hal::spi_transfer(uint8_t data)
+{
+	uint8_t received = 0xFF;
+
+	data = corrupt_byte(data);
+	for (SimulatedBoardSlot& slot : board_slots) {
+		if (slot.board && slot.selected) {
+			received = slot.board->exchange(data);
+		}
+	}
+	return corrupt_byte(received);
+}
+
+void hal::spi_transfer_bytes(const uint8_t* tx_data, uint8_t* rx_data, uint32_t length)
+{
+	for (uint32_t i = 0; i < length; i++) {
+		const uint8_t received = spi_transfer(tx_data ? tx_data[i] : 0xFF);
+		if (rx_data) {
+			rx_data[i] = received;
+		}
+	}
+}
+
+/****************************************************************************************************************
+* clock
+*****************************************************************************************************************/
+uint32_t hal::millis()
+{
+	return static_cast<uint32_t>(now_us() / 1000);
+}
+
+uint32_t hal::micros()
+{
+	return static_cast<uint32_t>(now_us());
+}
+
+void hal::delay_ms(uint32_t delay_ms)
+{
+	delay_us(delay_ms * 1000);
+}
+
+void hal::delay_us(uint32_t delay_us)
+{
+	if (virtual_clock) {
+		virtual_time_us += delay_us;
+		return;
+	}
+	std::this_thread::sleep_for(std::chrono::microseconds(delay_us));
+}
+
+// the host counts nanoseconds of the steady clock instead of cpu cycles
+uint32_t hal::cycle_counter()
+{
+	return static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now() - start_time).count());
+}
+
+uint32_t hal::cycle_counter_frequency_mhz()
+{
+	return 1000;
+}
+
+/****************************************************************************************************************
+* logging
+*****************************************************************************************************************/
+void hal::log(const char* format, ...)
+{
+	va_list arguments;
+
+	va_start(arguments, format);
+	vprintf(format, arguments);
+	va_end(arguments);
+}
+
+/****************************************************************************************************************
+* udp
+*****************************************************************************************************************/
+hal::UdpHandle hal::udp_open(uint16_t port)
+{
+	sockaddr_in address = make_address("0.0.0.0", port);
+	const int udp_socket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+
+	if (udp_socket < 0) {
+		return INVALID_UDP_HANDLE;
+	}
+
+	if (bind(udp_socket, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0) {
+		::close(udp_socket);
+		return INVALID_UDP_HANDLE;
+	}
+
+	fcntl(udp_socket, F_SETFL, O_NONBLOCK);
+	return udp_socket;
+}
+
+void hal::udp_close(UdpHandle udp_socket)
+{
+	if (udp_socket != INVALID_UDP_HANDLE) {
+		::close(udp_socket);
+	}
+}
+
+uint32_t hal::udp_receive(UdpHandle udp_socket, uint8_t* buffer, uint32_t capacity)
+{
+	if (udp_socket == INVALID_UDP_HANDLE) {
+		return 0;
+	}
+
+	const ssize_t received = recv(udp_socket, buffer, capacity, MSG_DONTWAIT);
+	return received > 0 ? static_cast<uint32_t>(received) : 0;
+}
+
+bool hal::udp_wait(UdpHandle udp_socket, uint32_t timeout_ms)
+{
+	if (udp_socket == INVALID_UDP_HANDLE) {
+		return false;
+	}
+
+	fd_set readable;
+	timeval timeout = { static_cast<time_t>(timeout_ms / 1000), static_cast<suseconds_t>((timeout_ms % 1000) * 1000) };
+
+	FD_ZERO(&readable);
+	FD_SET(udp_socket, &readable);
+	return select(udp_socket + 1, &readable, nullptr, nullptr, &timeout) > 0;
+}
+
+bool hal::udp_send(UdpHandle udp_socket, const char* ip, uint16_t port, const uint8_t* data, uint32_t length)
+{
+	sockaddr_in address = make_address(ip, port);
+
+	if (udp_socket == INVALID_UDP_HANDLE) {
+		return false;
+	}
+
+	return sendto(udp_socket, data, length, 0, reinterpret_cast<sockaddr*>(&address), sizeof(address)) ==
+		static_cast<ssize_t>(length);
+}
+
+/****************************************************************************************************************
+* tasks - every task is a detached std::thread, notifications are counted like freertos task notifications
+*****************************************************************************************************************/
+hal::TaskHandle hal::task_create(const char*, TaskFunction function, void* parameter, uint32_t, uint32_t, int)
+{
+	HostTask* task = new HostTask();
+
+	task->thread = std::thread([task, function, parameter]() {
+		current_task = task;
+		function(parameter);
+	});
+	task->thread.detach();
+	return task;
+}
+
+void hal::task_notify(TaskHandle handle)
+{
+	HostTask* task = static_cast<HostTask*>(handle);
+
+	{
+		std::lock_guard<std::mutex> lock(task->mutex);
+		task->notifications++;
+	}
+	task->condition.notify_one();
+}
+
+bool hal::task_wait_notification(uint32_t timeout_ms)
+{
+	if (!current_task) {
+		return false;
+	}
+
+	std::unique_lock<std::mutex> lock(current_task->mutex);
+	auto notified = [] { return current_task->notifications > 0; };
+
+	if (timeout_ms == WAIT_FOREVER) {
+		current_task->condition.wait(lock, notified);
+	}
+	else if (!current_task->condition.wait_for(lock, std::chrono::milliseconds(timeout_ms), notified)) {
+		return false;
+	}
+
+	current_task->notifications = 0;
+	return true;
+}
+
+void hal::task_yield()
+{
+	std::this_thread::yield();
+}
+
+void hal::task_exit()
+{
+	// the detached thread ends when the task function returns
+}
+
+hal::MutexHandle hal::mutex_create()
+{
+	return new std::mutex();
+}
+
+void hal::mutex_lock(MutexHandle handle)
+{
+	static_cast<std::mutex*>(handle)->lock();
+}
+
+void hal::mutex_unlock(MutexHandle handle)
+{
+	static_cast<std::mutex*>(handle)->unlock();
+}
+
+/****************************************************************************************************************
+* non-volatile storage
+*****************************************************************************************************************/
+bool hal::storage_read(const char* key, void* data, uint32_t size)
+{
+	std::lock_guard<std::mutex> lock(storage_mutex);
+	auto entry = storage.find(key);
+
+	if (entry == storage.end() || entry->second.size() != size) {
+		return false;
+	}
+	memcpy(data, entry->second.data(), size);
+	return true;
+}
+
+bool hal::storage_write(const char* key, const void* data, uint32_t size)
+{
+	std::lock_guard<std::mutex> lock(storage_mutex);
+	const uint8_t* bytes = static_cast<const uint8_t*>(data);
+
+	storage[key].assign(bytes, bytes + size);
+	return true;
+}
+
+/****************************************************************************************************************
+* files - paths are relative to the working directory
+*****************************************************************************************************************/
+bool hal::file_write(const char* path, const void* data, uint32_t size, bool append)
+{
+	FILE* file = fopen(path, append ? "ab" : "wb");
+
+	if (!file) {
+		return false;
+	}
+	const bool is_written = fwrite(data, 1, size, file) == size;
+	return fclose(file) == 0 && is_written;
+}
+
+/****************************************************************************************************************
+* simulation control
+*****************************************************************************************************************/
+bool hal_sim::attach_sonic_board(uint8_t cs_pin, SimulatedSonicBoard* board)
+{
+	for (SimulatedBoardSlot& slot : board_slots) {
+		if (slot.board && slot.cs_pin == cs_pin) {
+			slot.board = board;
+			slot.selected = false;
+			return true;
+		}
+	}
+
+	for (SimulatedBoardSlot& slot : board_slots) {
+		if (!slot.board) {
+			slot.cs_pin = cs_pin;
+			slot.selected = false;
+			slot.board = board;
+			return true;
+		}
+	}
+	return false;
+}
+
+void hal_sim::detach_all_sonic_boards()
+{
+	for (SimulatedBoardSlot& slot : board_slots) {
+		slot = SimulatedBoardSlot();
+	}
+}
+
+void hal_sim::set_virtual_clock(bool enabled)
+{
+	if (enabled && !virtual_clock) {
+		virtual_time_us = now_us();
+	}
+	virtual_clock = enabled;
+}
+
+void hal_sim::advance_clock_us(uint32_t elapsed_us)
+{
+	virtual_time_us += elapsed_us;
+}
+
+uint32_t hal_sim::get_spi_frequency()
+{
+	return spi_frequency;
+}
+
+void hal_sim::set_spi_signal_integrity(uint32_t max_clean_frequency, uint32_t bytes_per_million)
+{
+	max_clean_spi_frequency = max_clean_frequency;
+	corrupted_bytes_per_million = bytes_per_million;
+}
+
+void hal_sim::clear_storage()
+{
+	std::lock_guard<std::mutex> lock(storage_mutex);
+	storage.clear();
+}
+
+/****************************************************************************************************************
+* LoopbackUdpServer
+*****************************************************************************************************************/
+hal_sim::LoopbackUdpServer::~LoopbackUdpServer()
+{
+	close();
+}
+
+bool hal_sim::LoopbackUdpServer::open(uint16_t server_port, uint16_t target_robot_port)
+{
+	sockaddr_in address = make_address("127.0.0.1", server_port);
+
+	close();
+	socket_fd = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	if (socket_fd < 0) {
+		return false;
+	}
+
+	if (bind(socket_fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0) {
+		close();
+		return false;
+	}
+
+	fcntl(socket_fd, F_SETFL, O_NONBLOCK);
+	robot_port = target_robot_port;
+	return true;
+}
+
+void hal_sim::LoopbackUdpServer::close()
+{
+	if (socket_fd >= 0) {
+		::close(socket_fd);
+		socket_fd = -1;
+	}
+}
+
+bool hal_sim::LoopbackUdpServer::send_to_robot(const uint8_t* data, uint32_t length)
+{
+	sockaddr_in address = make_address("127.0.0.1", robot_port);
+
+	return socket_fd >= 0 &&
+		sendto(socket_fd, data, length, 0, reinterpret_cast<sockaddr*>(&address), sizeof(address)) ==
+		static_cast<ssize_t>(length);
+}
+
+uint32_t hal_sim::LoopbackUdpServer::receive_from_robot(uint8_t* buffer, uint32_t capacity)
+{
+	if (socket_fd < 0) {
+		return 0;
+	}
+
+	const ssize_t received = recv(socket_fd, buffer, capacity, MSG_DONTWAIT);
+	return received > 0 ? static_cast<uint32_t>(received) : 0;
+}
+#endif
@@ -0,0 +1,157 @@
+#include "LoopProfiler.h"
+
+LoopProfiler::StageHistogram LoopProfiler::histograms[STAGE_COUNT];
+
+// names of the stages in ProfilerStage order
+static const char* const STAGE_NAMES[STAGE_COUNT] = {
+	"update_robot",
+	"control_cycle",
+	"udp_receive",
+	"protobuf_parse",
+	"kinematics",
+	"spi_transaction",
+	"ball_controller",
+	"arrival_to_spi",
+};
+
+/****************************************************************************************************************
+* Descrition: record() function adds a stage duration to the histogram of the stage
+* Pre:  stage is less than STAGE_COUNT, may be called from several tasks at once
+* Post: histogram, min and max of the stage are updated
+*****************************************************************************************************************/
+void LoopProfiler::record(ProfilerStage stage, uint32_t cycles)
+{
+	StageHistogram& histogram = histograms[stage];
+
+	update_max(histogram.inverted_min_cycles, ~cycles);
+	update_max(histogram.max_cycles, cycles);
+	histogram.buckets[bucket_index(cycles)].fetch_add(1, std::memory_order_relaxed);
+	histogram.count.fetch_add(1, std::memory_order_relaxed);
+}
+
+/****************************************************************************************************************
+* Descrition: update_max() function raises a counter to a value unless it already holds a larger one
+* Pre:  none
+* Post: value is the maximum of its previous value and candidate
+*****************************************************************************************************************/
+void LoopProfiler::update_max(std::atomic<uint32_t>& value, uint32_t candidate)
+{
+	uint32_t current = value.load(std::memory_order_relaxed);
+
+	while (candidate > current && !value.compare_exchange_weak(current, candidate, std::memory_order_relaxed)) {
+	}
+}
+
+/****************************************************************************************************************
+* Descrition: summarize() function calculates the distribution of a stage
+* Pre:  stage is less than STAGE_COUNT
+* Post: summary in microseconds is returned, all zero if the stage was never recorded
+*       durations recorded meanwhile may be counted in some fields only
+*****************************************************************************************************************/
+StageSummary LoopProfiler::summarize(ProfilerStage stage)
+{
+	const StageHistogram& histogram = histograms[stage];
+	const float cycles_per_us = static_cast<float>(hal::cycle_counter_frequency_mhz());
+	StageSummary summary = {};
+
+	// the count is read first, record() counts a duration in its bucket before the count
+	const uint32_t count = histogram.count.load(std::memory_order_relaxed);
+	if (!count) {
+		return summary;
+	}
+
+	const uint32_t p50_rank = (count + 1) / 2;
+	const uint32_t p99_rank = count - count / 100;
+	uint32_t cumulative = 0;
+
+	summary.count = count;
+	summary.min_us = ~histogram.inverted_min_cycles.load(std::memory_order_relaxed) / cycles_per_us;
+	summary.max_us = histogram.max_cycles.load(std::memory_order_relaxed) / cycles_per_us;
+
+	for (uint8_t bucket = 0; bucket < BUCKET_COUNT; bucket++) {
+		const uint32_t previous = cumulative;
+		const float upper_us = bucket_upper_bound(bucket) / cycles_per_us;
+
+		cumulative += histogram.buckets[bucket].load(std::memory_order_relaxed);
+		if (previous < p50_rank && cumulative >= p50_rank) {
+			summary.p50_us = upper_us < summary.max_us ? upper_us : summary.max_us;
+		}
+		if (previous < p99_rank && cumulative >= p99_rank) {
+			summary.p99_us = upper_us < summary.max_us ? upper_us : summary.max_us;
+			break;
+		}
+	}
+
+	return summary;
+}
+
+/****************************************************************************************************************
+* Descrition: report() function logs the summary of every recorded stage
+* Pre:  none
+* Post: one line per stage is logged
+*****************************************************************************************************************/
+void LoopProfiler::report()
+{
+	hal::log("stage            count      min[us]  p50[us]  p99[us]  max[us]\n");
+
+	for (uint8_t stage = 0; stage < STAGE_COUNT; stage++) {
+		const StageSummary summary = summarize(static_cast<ProfilerStage>(stage));
+
+		if (summary.count) {
+			hal::log("%-16s %-10u %-8.1f %-8.1f %-8.1f %-8.1f\n", STAGE_NAMES[stage], summary.count,
+				summary.min_us, summary.p50_us, summary.p99_us, summary.max_us);
+		}
+	}
+}
+
+/****************************************************************************************************************
+* Descrition: reset() function clears all histograms
+* Pre:  none
+* Post: no stage is recorded
+*****************************************************************************************************************/
+void LoopProfiler::reset()
+{
+	for (StageHistogram& histogram : histograms) {
+		for (std::atomic<uint32_t>& bucket : histogram.buckets) {
+			bucket.store(0, std::memory_order_relaxed);
+		}
+		histogram.count.store(0, std::memory_order_relaxed);
+		histogram.inverted_min_cycles.store(0, std::memory_order_relaxed);
+		histogram.max_cycles.store(0, std::memory_order_relaxed);
+	}
+}
+
+/****************************************************************************************************************
+* Descrition: bucket_index() function maps a duration to its histogram bucket
+* Pre:  none
+* Post: index of the power of two of the duration and its SUB_BUCKETS fraction is returned
+*****************************************************************************************************************/
+uint8_t LoopProfiler::bucket_index(uint32_t cycles)
+{
+	if (cycles < SUB_BUCKETS) {
+		return cycles;
+	}
+
+	// position of the most significant bit and the two bits after it
+	const uint8_t octave = 31 - __builtin_clz(cycles);
+	const uint8_t fraction = (cycles >> (octave - 2)) & (SUB_BUCKETS - 1);
+	return (octave - 1) * SUB_BUCKETS + fraction;
+}
+
+/****************************************************************************************************************
+* Descrition: bucket_upper_bound() function returns the largest duration of a bucket
+* Pre:  bucket is less than BUCKET_COUNT
+* Post: upper bound in cycles is returned
+*****************************************************************************************************************/
+uint32_t LoopProfiler::bucket_upper_bound(uint8_t bucket)
+{
+	if (bucket < SUB_BUCKETS) {
+		return bucket;
+	}
+
+	const uint8_t octave = bucket / SUB_BUCKETS + 1;
+	const uint8_t fraction = bucket % SUB_BUCKETS;
+	const uint64_t lower = (static_cast<uint64_t>(SUB_BUCKETS + fraction)) << (octave - 2);
+	const uint64_t upper = lower + (1ULL << (octave - 2)) - 1;
+	return upper > 0xFFFFFFFFULL ? 0xFFFFFFFF : static_cast<uint32_t>(upper);
+}
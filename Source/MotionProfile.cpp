@@ -0,0 +1,130 @@
+#include "MotionProfile.h"
+#include "SonicBoardController.h"
+#include <algorithm>
+#include <math.h>
+
+/****************************************************************************************************************
+* Descrition: MotionProfile() constructor creates a profile at rest with the default limits
+* Pre:  none
+* Post: velocity is zero
+*****************************************************************************************************************/
+MotionProfile::MotionProfile()
+{
+	limits.max_velocity[0] = SONIC_BOARD_CONST::MAX_MOTOR_RPM / RobotKinematics::FORWARD_GAIN;
+	limits.max_velocity[1] = SONIC_BOARD_CONST::MAX_MOTOR_RPM / RobotKinematics::LEFT_GAIN;
+	limits.max_velocity[2] = SONIC_BOARD_CONST::MAX_MOTOR_RPM / RobotKinematics::ROTATION_GAIN;
+	limits.max_acceleration[0] = MOTION_PROFILE_SETTINGS::MAX_LINEAR_ACCELERATION;
+	limits.max_acceleration[1] = MOTION_PROFILE_SETTINGS::MAX_LINEAR_ACCELERATION;
+	limits.max_acceleration[2] = MOTION_PROFILE_SETTINGS::MAX_ANGULAR_ACCELERATION;
+	limits.max_jerk[0] = MOTION_PROFILE_SETTINGS::MAX_LINEAR_JERK;
+	limits.max_jerk[1] = MOTION_PROFILE_SETTINGS::MAX_LINEAR_JERK;
+	limits.max_jerk[2] = MOTION_PROFILE_SETTINGS::MAX_ANGULAR_JERK;
+}
+
+/****************************************************************************************************************
+* Descrition: set_limits() function sets the velocity, acceleration and jerk limits
+* Pre:  all limits are greater than zero
+* Post: next steps use the new limits
+*****************************************************************************************************************/
+void MotionProfile::set_limits(const MotionLimits& motion_limits)
+{
+	limits = motion_limits;
+}
+
+/****************************************************************************************************************
+* Descrition: set_target() function sets the velocity commanded by the server
+* Pre:  now_us is hal::micros() when the command was received
+* Post: the goal ramps from its current value to the new target (within the velocity limits) over the interval
+*       since the previous target, after the first target or a longer interval than MAX_PACKET_INTERVAL_US
+*       the goal is the new target right away
+*****************************************************************************************************************/
+void MotionProfile::set_target(float forward_speed, float left_speed, float rotation_speed, uint32_t now_us)
+{
+	const float new_target[AXIS_COUNT] = { forward_speed, left_speed, rotation_speed };
+	const uint32_t interval_us = now_us - target_time_us;
+
+	for (uint8_t axis = 0; axis < AXIS_COUNT; axis++) {
+		const float max_velocity = limits.max_velocity[axis];
+
+		ramp_start[axis] = goal(axis, now_us);
+		target[axis] = std::max(-max_velocity, std::min(new_target[axis], max_velocity));
+	}
+
+	ramp_duration_us = has_target && interval_us < MOTION_PROFILE_SETTINGS::MAX_PACKET_INTERVAL_US ? interval_us : 0;
+	target_time_us = now_us;
+	has_target = true;
+}
+
+/****************************************************************************************************************
+* Descrition: goal() function returns the velocity the profile follows on an axis at the specified time
+* Pre:  none
+* Post: goal is between the start of the ramp and the target, 0 if no target was set
+*****************************************************************************************************************/
+float MotionProfile::goal(uint8_t axis, uint32_t now_us) const
+{
+	const int32_t elapsed_us = static_cast<int32_t>(now_us - target_time_us);
+
+	if (!has_target) {
+		return 0.0f;
+	}
+	if (elapsed_us >= static_cast<int32_t>(ramp_duration_us)) {
+		return target[axis];
+	}
+	if (elapsed_us <= 0) {
+		return ramp_start[axis];
+	}
+	return ramp_start[axis] + (target[axis] - ramp_start[axis]) * (static_cast<float>(elapsed_us) / ramp_duration_us);
+}
+
+/****************************************************************************************************************
+* Descrition: step() function advances the profile to the specified time
+* Pre:  now_us is hal::micros(), called at the control rate
+* Post: profiled body velocity is stored in body_velocity
+*****************************************************************************************************************/
+void MotionProfile::step(uint32_t now_us, float (&body_velocity)[AXIS_COUNT])
+{
+	const float dt = has_stepped ? (now_us - last_step_us) * 1e-6f : 0.0f;
+
+	last_step_us = now_us;
+	has_stepped = true;
+
+	for (uint8_t axis = 0; axis < AXIS_COUNT; axis++) {
+		const float goal_velocity = goal(axis, now_us);
+		const float error = goal_velocity - velocity[axis];
+		const float max_acceleration = limits.max_acceleration[axis];
+		const float max_jerk = limits.max_jerk[axis];
+
+		// largest acceleration that can still be ramped down to zero before reaching the goal
+		const float reachable_acceleration = std::min(max_acceleration, sqrtf(2.0f * max_jerk * fabsf(error)));
+		const float desired_acceleration = error >= 0.0f ? reachable_acceleration : -reachable_acceleration;
+		const float max_change = max_jerk * dt;
+
+		acceleration[axis] += std::max(-max_change, std::min(desired_acceleration - acceleration[axis], max_change));
+		velocity[axis] += acceleration[axis] * dt;
+
+		// do not overshoot the goal
+		if ((error >= 0.0f && velocity[axis] > goal_velocity) || (error < 0.0f && velocity[axis] < goal_velocity)) {
+			velocity[axis] = goal_velocity;
+			acceleration[axis] = 0.0f;
+		}
+
+		body_velocity[axis] = velocity[axis];
+	}
+}
+
+/****************************************************************************************************************
+* Descrition: reset() function stops the profile immediately (e.g. after the robot was halted)
+* Pre:  none
+* Post: velocity, acceleration and target are zero
+*****************************************************************************************************************/
+void MotionProfile::reset()
+{
+	for (uint8_t axis = 0; axis < AXIS_COUNT; axis++) {
+		target[axis] = 0.0f;
+		ramp_start[axis] = 0.0f;
+		velocity[axis] = 0.0f;
+		acceleration[axis] = 0.0f;
+	}
+	has_target = false;
+	has_stepped = false;
+}
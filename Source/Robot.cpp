@@ -1,21 +1,175 @@
 #include "Robot.h"
+#include "LoopProfiler.h"
 
 // global variable to monitor the wifi connection status between robot and server
+// commands are received only while connected, halting is decided by the command watchdog
 volatile uint8_t is_connected;
 
 /*************************************************************************************************************************
 * Description: init_robot() function initializes gpio pins, spi bus, motors and wifi
-* Pre:  ssid and password must match with server network ssid and password
+* Pre:  ssid and password must match with server network ssid and password and stay valid until init_robot() returns
 * Post: gpio's are initialized 
 *       spi is configured to it's default settings and is ready for data transmission
-*       motors pid is set to default
+*       motors pid is set to the stored config
 *       wifi connection is established between robot and server       
+*       command watchdog is running, the robot is halted until the first command arrives
+*       duration of the boot phases is logged (see get_boot_statistics())
 **************************************************************************************************************************/
 void Robot::init_robot(const char* ssid, const char* password)
 {
-	sonic_board_controller.init();
+	const uint32_t start_us = hal::micros();
+
+	output_mutex = hal::mutex_create();
+
+	// the association takes most of the boot time, so it runs while the peripherals are initialized
+	wifi_ssid = ssid;
+	wifi_password = password;
+	is_wifi_associated = false;
+	const bool wifi_task_failed = !hal::task_create("wifi_connect", wifi_task, this,
+		BOOT_SETTINGS::WIFI_TASK_STACK_SIZE, BOOT_SETTINGS::WIFI_TASK_PRIORITY, BOOT_SETTINGS::WIFI_TASK_CORE);
+	if (wifi_task_failed) {
+		hal::log("ERROR: failed to start wifi task, connecting after the peripherals\n");
+	}
+
+	uint32_t phase_start_us = hal::micros();
+	init_sonic_boards();
+	boot_statistics.sonic_board_init_us = hal::micros() - phase_start_us;
+
+	phase_start_us = hal::micros();
 	ball_controller.init();
-	network_controller.connect_to_wifi(ssid, password);
+	boot_statistics.ball_controller_init_us = hal::micros() - phase_start_us;
+
+	watchdog_task_handle = hal::task_create("robot_watchdog", watchdog_task, this, WATCHDOG_SETTINGS::TASK_STACK_SIZE,
+		WATCHDOG_SETTINGS::TASK_PRIORITY, WATCHDOG_SETTINGS::TASK_CORE);
+	if (!watchdog_task_handle) {
+		hal::log("ERROR: failed to start command watchdog\n");
+	}
+
+	phase_start_us = hal::micros();
+	if (wifi_task_failed) {
+		connect_to_wifi();
+	}
+	while (!is_wifi_associated.load(std::memory_order_acquire)) {
+		hal::delay_ms(BOOT_SETTINGS::WIFI_POLL_PERIOD_MS);
+	}
+	boot_statistics.wifi_wait_us = hal::micros() - phase_start_us;
+	boot_statistics.total_us = hal::micros() - start_us;
+
+	report_boot_statistics();
+}
+
+/*************************************************************************************************************************
+* Descrition: init_replay() function initializes the robot for a replay on the host: the datagrams are taken from
+* the source instead of wifi and the command deadline is checked by update_robot() instead of the watchdog task
+* Pre: source outlives the robot, the simulated boards are attached
+* Post: gpio's, spi bus and motors are initialized as in init_robot(), the robot is halted until the first command
+**************************************************************************************************************************/
+void Robot::init_replay(DatagramSource& source)
+{
+	const uint32_t start_us = hal::micros();
+
+	output_mutex = hal::mutex_create();
+	datagram_source = &source;
+
+	uint32_t phase_start_us = hal::micros();
+	init_sonic_boards();
+	boot_statistics.sonic_board_init_us = hal::micros() - phase_start_us;
+
+	phase_start_us = hal::micros();
+	ball_controller.init();
+	boot_statistics.ball_controller_init_us = hal::micros() - phase_start_us;
+
+	last_halt_ms = hal::millis();
+	boot_statistics.total_us = hal::micros() - start_us;
+}
+
+/*************************************************************************************************************************
+* Descrition: init_sonic_boards() function selects the sonic board protocol (see SONIC_BOARD_SETTINGS) and initializes
+* the sonic boards
+* Pre: the boards run a firmware that supports the selected protocol
+* Post: spi bus and motors are initialized, the motors are set with the selected protocol
+**************************************************************************************************************************/
+void Robot::init_sonic_boards()
+{
+	sonic_board_controller.set_batched_frame_enabled(SONIC_BOARD_SETTINGS::USE_BATCHED_FRAME);
+	sonic_board_controller.set_framed_protocol_enabled(SONIC_BOARD_SETTINGS::USE_BATCHED_FRAME &&
+		SONIC_BOARD_SETTINGS::USE_FRAMED_PROTOCOL);
+
+	sonic_board_controller.init();
+
+	if (SONIC_BOARD_SETTINGS::USE_BATCHED_FRAME && SONIC_BOARD_SETTINGS::USE_ASYNC_TRANSACTIONS &&
+		!sonic_board_controller.enable_async_transactions(true)) {
+		hal::log("ERROR: failed to start spi queue task, the frames are written in place\n");
+	}
+}
+
+/*************************************************************************************************************************
+* Descrition: connect_to_wifi() function associates with the server network and measures how long it took
+* Pre: wifi_ssid and wifi_password are set
+* Post: wifi connection is established, is_wifi_associated is set
+**************************************************************************************************************************/
+void Robot::connect_to_wifi()
+{
+	const uint32_t start_us = hal::micros();
+
+	network_controller.connect_to_wifi(wifi_ssid, wifi_password);
+	open_command_socket();
+	boot_statistics.wifi_connect_us = hal::micros() - start_us;
+	is_wifi_associated.store(true, std::memory_order_release);
+}
+
+/*************************************************************************************************************************
+* Descrition: open_command_socket() function opens the hal udp socket the commands are received on
+* Pre: wifi is associated
+* Post: command_socket receives on INGESTION_SETTINGS::COMMAND_PORT, if the port is not available the commands
+*       are received by the network controller and the event loop cannot be started
+**************************************************************************************************************************/
+void Robot::open_command_socket()
+{
+	command_socket = hal::udp_open(INGESTION_SETTINGS::COMMAND_PORT);
+	if (command_socket == hal::INVALID_UDP_HANDLE) {
+		hal::log("WARNING: command port %u is not available, commands are received by the network controller\n",
+			INGESTION_SETTINGS::COMMAND_PORT);
+	}
+}
+
+void Robot::wifi_task(void* parameter)
+{
+	static_cast<Robot*>(parameter)->connect_to_wifi();
+	hal::task_exit();
+}
+
+/*************************************************************************************************************************
+* Descrition: report_boot_statistics() function logs the duration of the boot phases
+* Pre: init_robot() finished
+* Post: none
+**************************************************************************************************************************/
+void Robot::report_boot_statistics() const
+{
+	const SonicBoardBootStatistics& sonic_board = sonic_board_controller.get_boot_statistics();
+
+	hal::log("boot time: %lu us\n", static_cast<unsigned long>(boot_statistics.total_us));
+	hal::log("  sonic boards:    %lu us (spi %lu us, %u polls)\n",
+		static_cast<unsigned long>(boot_statistics.sonic_board_init_us),
+		static_cast<unsigned long>(sonic_board.spi_init_us), sonic_board.handshake_polls);
+	for (uint8_t module_id = 0; module_id < SONIC_BOARD_TOPOLOGY::BOARD_COUNT; module_id++) {
+		hal::log("    module %u ready: %lu us\n", module_id,
+			static_cast<unsigned long>(sonic_board.module_ready_us[module_id]));
+	}
+	hal::log("  ball controller: %lu us\n", static_cast<unsigned long>(boot_statistics.ball_controller_init_us));
+	hal::log("  wifi:            %lu us (waited %lu us after the peripherals)\n",
+		static_cast<unsigned long>(boot_statistics.wifi_connect_us),
+		static_cast<unsigned long>(boot_statistics.wifi_wait_us));
+}
+
+/*************************************************************************************************************************
+* Descrition: get_boot_statistics() function returns the duration of the init_robot() phases
+* Pre: init_robot() was called
+* Post: none
+**************************************************************************************************************************/
+const BootStatistics& Robot::get_boot_statistics() const
+{
+	return boot_statistics;
 }
 
 /*************************************************************************************************************************
@@ -25,27 +179,22 @@ void Robot::init_robot(const char* ssid, const char* password)
 **************************************************************************************************************************/
 void Robot::update_robot()
 {
-	if (is_connected) {
-		uint32_t received_data_length = 0;
-		bool is_protobuf_packet = false;
-
-		received_data_length = network_controller.receive_udp_packet(udp_buffer);
-		
-		if (received_data_length) {
+	const uint32_t start_time_us = hal::micros();
 
-			is_protobuf_packet = protobuf_parser.parse_udp_packet(udp_buffer, robot_command, received_data_length);
+	{
+		PROFILE_STAGE(STAGE_UPDATE_ROBOT);
 
-			if (is_protobuf_packet) {
-				sonic_board_controller.update_motors(robot_command.move.x, robot_command.move.y, robot_command.move.r);
-				ball_controller.write_data_to_ball_controller(robot_command.action.kick, robot_command.action.chip, 
-					                                          robot_command.action.dribble);
-			}
+		// if the connection with the server is lost no commands arrive and the watchdog halts the robot
+		if ((is_connected || datagram_source) && receive_latest_command()) {
+			apply_command(robot_command);
 		}
 	}
-	// if the wifi connection with the server is lost halt the robot
-	else {
-		halt_robot();
+
+	if (!watchdog_task_handle) {
+		check_command_watchdog();
 	}
+
+	record_telemetry_sample(hal::micros() - start_time_us);
 }
 
 /*************************************************************************************************************************
@@ -55,6 +204,689 @@ void Robot::update_robot()
 **************************************************************************************************************************/
 void Robot::halt_robot()
 {
+	hal::mutex_lock(output_mutex);
 	sonic_board_controller.update_motors(0.0f, 0.0f, 0.0f);
-	ball_controller.write_data_to_ball_controller(0.0f, 0.0f, 0.0f);
+	{
+		PROFILE_STAGE(STAGE_BALL_CONTROLLER);
+		ball_controller.write_data_to_ball_controller(0.0f, 0.0f, 0.0f);
+	}
+	hal::mutex_unlock(output_mutex);
+}
+
+
+/*************************************************************************************************************************
+* Descrition: apply_command() function writes a decoded command to the motors and the ball controller
+* Pre: none
+* Post: motors and ball controller are updated, command watchdog is fed
+**************************************************************************************************************************/
+void Robot::apply_command(const Command& command)
+{
+	hal::mutex_lock(output_mutex);
+	sonic_board_controller.update_motors(command.move.x, command.move.y, command.move.r);
+	record_arrival_latency();
+	{
+		PROFILE_STAGE(STAGE_BALL_CONTROLLER);
+		ball_controller.write_data_to_ball_controller(command.action.kick, command.action.chip, command.action.dribble);
+	}
+	hal::mutex_unlock(output_mutex);
+
+	command_watchdog.feed(hal::millis());
+}
+
+/*************************************************************************************************************************
+* Descrition: start_pipeline() function starts the pipelined execution mode: the network task receives and parses
+* packets on NETWORK_CORE, the control task applies the latest command at the control rate on CONTROL_CORE
+* Pre: init_robot() was called, update_robot() is not called any more
+* Post: both tasks are running, true is returned on success
+*       the control period is logged, it is longer than CONTROL_PERIOD_US if the spi bus does not keep up
+**************************************************************************************************************************/
+bool Robot::start_pipeline()
+{
+	if (network_task_handle || control_task_handle) {
+		return true;
+	}
+
+	pipeline_statistics.control_period_us = get_control_period_us();
+	hal::log("control period %lu us, motor update %lu us on the spi bus\n",
+		static_cast<unsigned long>(pipeline_statistics.control_period_us),
+		static_cast<unsigned long>(sonic_board_controller.get_update_bus_time_us()));
+
+	control_task_handle = hal::task_create("robot_control", control_task, this, PIPELINE_SETTINGS::TASK_STACK_SIZE,
+		PIPELINE_SETTINGS::CONTROL_TASK_PRIORITY, PIPELINE_SETTINGS::CONTROL_CORE);
+	network_task_handle = hal::task_create("robot_network", network_task, this, PIPELINE_SETTINGS::TASK_STACK_SIZE,
+		PIPELINE_SETTINGS::NETWORK_TASK_PRIORITY, PIPELINE_SETTINGS::NETWORK_CORE);
+
+	if (!control_task_handle || !network_task_handle) {
+		hal::log("ERROR: failed to start robot pipeline\n");
+		return false;
+	}
+	return true;
+}
+
+/*************************************************************************************************************************
+* Descrition: start_event_loop() function starts the event driven execution mode: a task on EVENT_LOOP_SETTINGS::TASK_CORE
+* sleeps until a datagram is waiting on the command socket, or until notify_datagram_arrival() signals a replayed one,
+* and runs update_robot() right away
+* the task also wakes up every WAIT_TIMEOUT_MS, so the command deadline is checked while no datagram arrives
+* Pre: init_robot() or init_replay() was called, update_robot() is not called from the main loop any more
+* Post: event task is running, true is returned on success
+*       false is returned without the command socket, the task would only poll every WAIT_TIMEOUT_MS
+**************************************************************************************************************************/
+bool Robot::start_event_loop()
+{
+	if (event_task_handle.load()) {
+		return true;
+	}
+	if (!datagram_source && command_socket == hal::INVALID_UDP_HANDLE) {
+		hal::log("ERROR: robot event loop needs the command socket (init_robot() not called or command port %u busy)\n",
+			INGESTION_SETTINGS::COMMAND_PORT);
+		return false;
+	}
+
+	const hal::TaskHandle handle = hal::task_create("robot_event", event_task, this, EVENT_LOOP_SETTINGS::TASK_STACK_SIZE,
+		EVENT_LOOP_SETTINGS::TASK_PRIORITY, EVENT_LOOP_SETTINGS::TASK_CORE);
+
+	if (!handle) {
+		hal::log("ERROR: failed to start robot event loop\n");
+		return false;
+	}
+	event_task_handle.store(handle);
+	return true;
+}
+
+/*************************************************************************************************************************
+* Descrition: notify_datagram_arrival() function signals a datagram arrival, it is called by the event task when
+* the command socket wakes it up and by the sources of datagrams that do not arrive on the socket (DatagramSource)
+* Pre: called from a task, not from an interrupt
+* Post: event task waiting for a notification is woken up, the earliest arrival since the last motor write is kept
+*       to measure the latency to the motor write in every mode
+**************************************************************************************************************************/
+void Robot::notify_datagram_arrival()
+{
+#if ROBOT_PROFILING
+	// micros() is the same clock on both cores, the cycle counter is not
+	if (!is_arrival_pending.load(std::memory_order_acquire)) {
+		arrival_time_us.store(hal::micros(), std::memory_order_relaxed);
+		is_arrival_pending.store(true, std::memory_order_release);
+	}
+#endif
+	arrival_notifications.fetch_add(1, std::memory_order_relaxed);
+
+	// the event task sleeping on the command socket is woken by the socket
+	const hal::TaskHandle handle = event_task_handle.load();
+	if (handle && command_socket == hal::INVALID_UDP_HANDLE) {
+		hal::task_notify(handle);
+	}
+}
+
+/*************************************************************************************************************************
+* Descrition: get_event_loop_statistics() function returns the statistics of the event driven execution mode
+* Pre: none
+* Post: none
+**************************************************************************************************************************/
+EventLoopStatistics Robot::get_event_loop_statistics() const
+{
+	EventLoopStatistics statistics = {};
+
+	statistics.notifications = arrival_notifications.load(std::memory_order_relaxed);
+	statistics.wakeups = event_wakeups.load(std::memory_order_relaxed);
+	statistics.timeouts = event_timeouts.load(std::memory_order_relaxed);
+	return statistics;
+}
+
+/*************************************************************************************************************************
+* Descrition: run_event_loop() function runs update_robot() whenever a datagram arrives
+* Pre: called from the event task only
+* Post: never returns
+**************************************************************************************************************************/
+void Robot::run_event_loop()
+{
+	for (;;) {
+		if (wait_for_datagram()) {
+			event_wakeups.fetch_add(1, std::memory_order_relaxed);
+		}
+		else {
+			event_timeouts.fetch_add(1, std::memory_order_relaxed);
+		}
+		update_robot();
+	}
+}
+
+/*************************************************************************************************************************
+* Descrition: wait_for_datagram() function sleeps until a datagram arrives, at most EVENT_LOOP_SETTINGS::WAIT_TIMEOUT_MS
+* Pre: called from the event task only
+* Post: true is returned if a datagram arrived, the arrival on the command socket is notified
+**************************************************************************************************************************/
+bool Robot::wait_for_datagram()
+{
+	if (command_socket != hal::INVALID_UDP_HANDLE) {
+		if (!hal::udp_wait(command_socket, EVENT_LOOP_SETTINGS::WAIT_TIMEOUT_MS)) {
+			return false;
+		}
+		notify_datagram_arrival();
+		return true;
+	}
+	return hal::task_wait_notification(EVENT_LOOP_SETTINGS::WAIT_TIMEOUT_MS);
+}
+
+void Robot::event_task(void* parameter)
+{
+	static_cast<Robot*>(parameter)->run_event_loop();
+}
+
+/*************************************************************************************************************************
+* Descrition: record_arrival_latency() function records the time from the last datagram arrival to the motor write
+* Pre: called right after the motors were updated with a received command
+* Post: the latency is recorded once per notified arrival (STAGE_ARRIVAL_TO_SPI)
+**************************************************************************************************************************/
+void Robot::record_arrival_latency()
+{
+#if ROBOT_PROFILING
+	if (is_arrival_pending.exchange(false, std::memory_order_acquire)) {
+		const uint32_t latency_us = hal::micros() - arrival_time_us.load(std::memory_order_relaxed);
+		LoopProfiler::record(STAGE_ARRIVAL_TO_SPI, latency_us * hal::cycle_counter_frequency_mhz());
+	}
+#endif
+}
+
+/*************************************************************************************************************************
+* Descrition: get_pipeline_statistics() function returns the statistics of the pipelined execution mode
+* Pre: none
+* Post: none
+**************************************************************************************************************************/
+PipelineStatistics Robot::get_pipeline_statistics() const
+{
+	return pipeline_statistics;
+}
+
+/*************************************************************************************************************************
+* Descrition: run_network_task() function receives and parses packets and publishes the latest command
+* Pre: called from the network task only
+* Post: never returns
+**************************************************************************************************************************/
+void Robot::run_network_task()
+{
+	CommandMessage message = {};
+
+	for (;;) {
+		const uint32_t received_packets = ingestion_statistics.received_packets;
+
+		if ((is_connected || datagram_source) && receive_latest_command()) {
+			message.received_time_us = hal::micros();
+			message.command = robot_command;
+			command_mailbox.publish(message);
+			pipeline_statistics.published_commands++;
+		}
+
+		if (received_packets == ingestion_statistics.received_packets) {
+			hal::delay_ms(PIPELINE_SETTINGS::NETWORK_IDLE_DELAY_MS);
+		}
+	}
+}
+
+/*************************************************************************************************************************
+* Descrition: run_control_task() function applies the latest command at the control rate (see get_control_period_us()),
+* with the motion profile enabled the motors are updated every cycle
+* Pre: called from the control task only
+* Post: never returns
+**************************************************************************************************************************/
+void Robot::run_control_task()
+{
+	CommandMessage message = {};
+	uint32_t next_cycle_us = hal::micros();
+
+	for (;;) {
+		run_control_cycle(message);
+
+		// wait for the next cycle, skip the missed ones
+		pipeline_statistics.control_period_us = get_control_period_us();
+		next_cycle_us += pipeline_statistics.control_period_us;
+		const int32_t remaining_us = static_cast<int32_t>(next_cycle_us - hal::micros());
+
+		if (remaining_us <= 0) {
+			pipeline_statistics.overrun_cycles++;
+			next_cycle_us = hal::micros();
+			hal::task_yield();
+			continue;
+		}
+		// sleep the whole milliseconds so other tasks can run, wait the rest
+		hal::delay_ms(remaining_us / 1000);
+		hal::delay_us(remaining_us % 1000);
+	}
+}
+
+/*************************************************************************************************************************
+* Descrition: get_control_period_us() function returns the period of the control task: CONTROL_PERIOD_US, or longer
+* so a motor update keeps the spi bus busy for at most MAX_BUS_LOAD_PERCENT of the period. The legacy per-motor
+* transactions take about 2.5 ms at the default clock, a 1 kHz control task would overrun every cycle
+* Pre: none
+* Post: none, the period follows the protocol and the spi clock selected by the sonic board controller
+**************************************************************************************************************************/
+uint32_t Robot::get_control_period_us() const
+{
+	const uint32_t bus_time_us = sonic_board_controller.get_update_bus_time_us();
+	const uint32_t min_period_us = (bus_time_us * 100 + PIPELINE_SETTINGS::MAX_BUS_LOAD_PERCENT - 1) /
+		PIPELINE_SETTINGS::MAX_BUS_LOAD_PERCENT;
+
+	return min_period_us > PIPELINE_SETTINGS::CONTROL_PERIOD_US ? min_period_us : PIPELINE_SETTINGS::CONTROL_PERIOD_US;
+}
+
+/*************************************************************************************************************************
+* Descrition: run_control_cycle() function performs one cycle of the control task
+* Pre: called from the control task only, message holds the last consumed command
+* Post: new command (if any) is applied, profiled motors are updated
+**************************************************************************************************************************/
+void Robot::run_control_cycle(CommandMessage& message)
+{
+	PROFILE_STAGE(STAGE_CONTROL_CYCLE);
+
+	const uint32_t start_time_us = hal::micros();
+
+	const bool is_new_command = command_mailbox.consume(message);
+
+	if (is_new_command && motion_profile_enabled) {
+		apply_profiled_command(message);
+	}
+	else if (is_new_command) {
+		apply_command(message.command);
+	}
+
+	if (motion_profile_enabled) {
+		update_profiled_motors();
+	}
+
+	if (is_new_command) {
+		const uint32_t latency_us = hal::micros() - message.received_time_us;
+		pipeline_statistics.applied_commands++;
+		pipeline_statistics.last_latency_us = latency_us;
+		if (latency_us > pipeline_statistics.max_latency_us) {
+			pipeline_statistics.max_latency_us = latency_us;
+		}
+	}
+	pipeline_statistics.control_cycles++;
+
+	record_telemetry_sample(hal::micros() - start_time_us);
+}
+
+/*************************************************************************************************************************
+* Descrition: apply_profiled_command() function makes a command the target of the motion profile
+* and writes its action to the ball controller
+* Pre: called from the control task only
+* Post: motion profile follows the commanded velocity, ball controller is updated, command watchdog is fed
+**************************************************************************************************************************/
+void Robot::apply_profiled_command(const CommandMessage& message)
+{
+	const Command& command = message.command;
+
+	motion_profile.set_target(command.move.x, command.move.y, command.move.r, message.received_time_us);
+
+	hal::mutex_lock(output_mutex);
+	{
+		PROFILE_STAGE(STAGE_BALL_CONTROLLER);
+		ball_controller.write_data_to_ball_controller(command.action.kick, command.action.chip, command.action.dribble);
+	}
+	hal::mutex_unlock(output_mutex);
+
+	command_watchdog.feed(hal::millis());
+}
+
+/*************************************************************************************************************************
+* Descrition: update_profiled_motors() function advances the motion profile and writes its velocity to the motors
+* Pre: called from the control task only
+* Post: motors follow the profiled velocity, while the watchdog is expired the profile is reset
+*       and the motors are left to the watchdog halt
+**************************************************************************************************************************/
+void Robot::update_profiled_motors()
+{
+	float body_velocity[MotionProfile::AXIS_COUNT];
+
+	// the watchdog marks the expiry before it halts under output_mutex, so checking it in the critical section
+	// of the write keeps the halt from being overwritten with the profiled velocity
+	hal::mutex_lock(output_mutex);
+	if (command_watchdog.is_expired()) {
+		motion_profile.reset();
+	}
+	else {
+		motion_profile.step(hal::micros(), body_velocity);
+		sonic_board_controller.update_motors(body_velocity[0], body_velocity[1], body_velocity[2]);
+	}
+	hal::mutex_unlock(output_mutex);
+}
+
+/*************************************************************************************************************************
+* Descrition: run_watchdog_task() function checks the command deadline at a fixed rate and halts the robot
+* when it passes, independently of update_robot() and the pipeline tasks
+* Pre: called from the watchdog task only
+* Post: never returns
+**************************************************************************************************************************/
+void Robot::run_watchdog_task()
+{
+	last_halt_ms = hal::millis();
+
+	for (;;) {
+		check_command_watchdog();
+		hal::delay_ms(WATCHDOG_SETTINGS::CHECK_PERIOD_MS);
+	}
+}
+
+/*************************************************************************************************************************
+* Descrition: check_command_watchdog() function halts the robot if the command deadline passed
+* Pre: called from a single context (the watchdog task or update_robot())
+* Post: robot is halted when the deadline passes and the halt is repeated while no commands arrive
+**************************************************************************************************************************/
+void Robot::check_command_watchdog()
+{
+	const uint32_t now_ms = hal::millis();
+
+	if (command_watchdog.check(now_ms)) {
+		halt_robot();
+		command_watchdog.record_halt(hal::micros());
+		last_halt_ms = now_ms;
+	}
+	// keep the robot halted in case a halt write was lost
+	else if (command_watchdog.is_expired() && now_ms - last_halt_ms >= WATCHDOG_SETTINGS::HALT_REPEAT_MS) {
+		halt_robot();
+		last_halt_ms = now_ms;
+	}
+}
+
+/*************************************************************************************************************************
+* Descrition: set_command_deadline_ms() function sets the max time between two commands before the robot is halted
+* Pre: deadline is greater than zero
+* Post: none
+**************************************************************************************************************************/
+void Robot::set_command_deadline_ms(uint32_t deadline_ms)
+{
+	command_watchdog.set_deadline_ms(deadline_ms);
+}
+
+/*************************************************************************************************************************
+* Descrition: get_watchdog_statistics() function returns how often and how long commands were late
+* Pre: none
+* Post: none
+**************************************************************************************************************************/
+WatchdogStatistics Robot::get_watchdog_statistics() const
+{
+	return command_watchdog.get_statistics();
+}
+
+void Robot::network_task(void* parameter)
+{
+	static_cast<Robot*>(parameter)->run_network_task();
+}
+
+void Robot::control_task(void* parameter)
+{
+	static_cast<Robot*>(parameter)->run_control_task();
+}
+
+void Robot::watchdog_task(void* parameter)
+{
+	static_cast<Robot*>(parameter)->run_watchdog_task();
+}
+
+/*************************************************************************************************************************
+* Descrition: receive_latest_command() function drains the udp socket (or the datagram source)
+* and keeps the newest packet that decodes
+* Pre: connection with the server is established
+* Post: if a valid command newer than the last applied one was received it is stored in robot_command
+*       and true is returned, the newest command is the one with the highest sequence number (the last one received
+*       without sequence numbers), the other valid packets of the same cycle are dropped as superseded,
+*       or as stale if they are not newer than the last applied command
+*       a malformed packet is counted as invalid and does not hide the valid packets received before it
+*       every received packet is recorded with the time of the drain while a traffic recorder is set
+**************************************************************************************************************************/
+bool Robot::receive_latest_command()
+{
+	Command latest_command = Command_init_zero;
+	Command decoded_command = Command_init_zero;
+	uint8_t received_packets = 0;
+	uint8_t valid_packets = 0;
+	const uint32_t drain_time_us = traffic_recorder ? hal::micros() : 0;
+
+	// every packet is decoded as it is drained, the newest packet alone may be malformed
+	while (received_packets < max_drained_packets) {
+		uint32_t received_data_length = 0;
+		{
+			PROFILE_STAGE(STAGE_UDP_RECEIVE);
+			if (datagram_source) {
+				received_data_length = datagram_source->receive_datagram(udp_buffer, sizeof(udp_buffer));
+			}
+			else if (command_socket != hal::INVALID_UDP_HANDLE) {
+				received_data_length = hal::udp_receive(command_socket, udp_buffer, sizeof(udp_buffer));
+			}
+			else {
+				received_data_length = network_controller.receive_udp_packet(udp_buffer);
+			}
+		}
+		if (!received_data_length) {
+			break;
+		}
+		received_packets++;
+
+		if (traffic_recorder) {
+			traffic_recorder->record_udp_datagram(drain_time_us, udp_buffer, received_data_length);
+		}
+
+		bool is_protobuf_packet = false;
+		{
+			PROFILE_STAGE(STAGE_PROTOBUF_PARSE);
+			is_protobuf_packet = decode_command(received_data_length, decoded_command);
+		}
+
+		if (!is_protobuf_packet) {
+			ingestion_statistics.invalid_packets++;
+			continue;
+		}
+		valid_packets++;
+
+		// datagrams may be reordered on the way, the drain order does not tell which command is the newest
+		if (valid_packets == 1 ||
+			is_newer_sequence(command_sequence(decoded_command), command_sequence(latest_command))) {
+			if (valid_packets > 1) {
+				drop_command(latest_command);
+			}
+			latest_command = decoded_command;
+		}
+		else {
+			drop_command(decoded_command);
+		}
+	}
+
+	ingestion_statistics.received_packets += received_packets;
+	if (!valid_packets) {
+		return false;
+	}
+
+	if (is_stale_command(latest_command)) {
+		ingestion_statistics.stale_packets++;
+		return false;
+	}
+
+	has_applied_sequence = true;
+	last_applied_sequence = command_sequence(latest_command);
+	robot_command = latest_command;
+	ingestion_statistics.decoded_packets++;
+	return true;
+}
+
+/*************************************************************************************************************************
+* Descrition: decode_command() function decodes the packet in udp_buffer with the command decoder,
+* packets it cannot decode (malformed or of a newer schema) are passed to the generic protobuf parser
+* Pre: udp_buffer holds a packet of the specified length
+* Post: true is returned if the packet was decoded into command, command is undefined otherwise
+**************************************************************************************************************************/
+bool Robot::decode_command(uint32_t length, Command& command)
+{
+	if (command_decoder_enabled) {
+		if (CommandDecoder::decode(udp_buffer, length, command) == DECODE_OK) {
+			return true;
+		}
+		ingestion_statistics.fallback_packets++;
+	}
+	return protobuf_parser.parse_udp_packet(udp_buffer, command, length);
+}
+
+/*************************************************************************************************************************
+* Descrition: is_newer_sequence() function compares two sequence numbers of the server
+* Pre: none
+* Post: true is returned if sequence is newer than reference, far older sequence numbers mean the server restarted
+*       its counter and are newer, without sequence numbers (both 0) every command is newer
+**************************************************************************************************************************/
+bool Robot::is_newer_sequence(uint32_t sequence, uint32_t reference)
+{
+	if (!has_command_sequence<Command>::value) {
+		return true;
+	}
+
+	const int32_t distance = static_cast<int32_t>(sequence - reference);
+	return distance > 0 || static_cast<uint32_t>(-distance) >= INGESTION_SETTINGS::SEQUENCE_RESYNC_WINDOW;
+}
+
+/*************************************************************************************************************************
+* Descrition: is_stale_command() function compares the sequence number of a command with the last applied one
+* Pre: none
+* Post: true is returned if the command is not newer than the last applied command,
+*       stale commands older than the last applied one are counted as reordered
+*       commands without sequence number are never stale
+**************************************************************************************************************************/
+bool Robot::is_stale_command(const Command& command)
+{
+	const uint32_t sequence = command_sequence(command);
+
+	if (!has_applied_sequence || is_newer_sequence(sequence, last_applied_sequence)) {
+		return false;
+	}
+	if (sequence != last_applied_sequence) {
+		ingestion_statistics.reordered_packets++;
+	}
+	return true;
+}
+
+/*************************************************************************************************************************
+* Descrition: drop_command() function counts a valid packet of a drain that is not applied
+* Pre: a newer command of the same drain is kept
+* Post: the packet is counted as stale if it is not newer than the last applied command, as superseded otherwise
+**************************************************************************************************************************/
+void Robot::drop_command(const Command& command)
+{
+	if (is_stale_command(command)) {
+		ingestion_statistics.stale_packets++;
+	}
+	else {
+		ingestion_statistics.superseded_packets++;
+	}
+}
+
+/*************************************************************************************************************************
+* Descrition: get_ingestion_statistics() function returns the statistics of the udp command intake
+* Pre: none
+* Post: none
+**************************************************************************************************************************/
+IngestionStatistics Robot::get_ingestion_statistics() const
+{
+	return ingestion_statistics;
+}
+
+/*************************************************************************************************************************
+* Descrition: set_max_drained_packets() function limits the number of packets received per cycle
+* Pre: max_packets is at least 1
+* Post: 1 restores the intake of a single packet per cycle (oldest command first)
+**************************************************************************************************************************/
+void Robot::set_max_drained_packets(uint8_t max_packets)
+{
+	max_drained_packets = max_packets ? max_packets : 1;
+}
+
+/*************************************************************************************************************************
+* Descrition: set_command_decoder_enabled() function selects whether packets are decoded by the specialized command decoder
+* Pre: none
+* Post: when disabled every packet is decoded by the generic protobuf parser
+*       enabling it without the field numbers of the generated header relies on the assumed ones
+**************************************************************************************************************************/
+void Robot::set_command_decoder_enabled(bool enabled)
+{
+	if (enabled && !COMMAND_SCHEMA::IS_SCHEMA_VERIFIED) {
+		hal::log("WARNING: command decoder enabled with assumed field numbers, the generated header has no tags\n");
+	}
+	command_decoder_enabled = enabled;
+}
+
+/*************************************************************************************************************************
+* Descrition: set_motion_profile_enabled() function selects whether the control task shapes the commanded velocity
+* Pre: pipeline is not started yet
+* Post: when disabled every command is applied to the motors as a step change
+**************************************************************************************************************************/
+void Robot::set_motion_profile_enabled(bool enabled)
+{
+	motion_profile_enabled = enabled;
+}
+
+/*************************************************************************************************************************
+* Descrition: set_motion_limits() function sets the velocity, acceleration and jerk limits of the motion profile
+* Pre: pipeline is not started yet
+* Post: none
+**************************************************************************************************************************/
+void Robot::set_motion_limits(const MotionLimits& limits)
+{
+	motion_profile.set_limits(limits);
+}
+
+/*************************************************************************************************************************
+* Descrition: start_telemetry_uplink() function starts streaming loop telemetry to the server
+* Pre: wifi is connected, ip is the server address in dotted decimal notation
+* Post: every TELEMETRY_SETTINGS::SAMPLE_DIVIDER-th loop is recorded and sent in batches, true is returned on success
+**************************************************************************************************************************/
+bool Robot::start_telemetry_uplink(const char* ip, uint16_t port)
+{
+	return telemetry_uplink.start(ip, port);
+}
+
+/*************************************************************************************************************************
+* Descrition: get_telemetry_statistics() function returns the recorded, dropped and sent telemetry counters
+* Pre: none
+* Post: none
+**************************************************************************************************************************/
+TelemetryStatistics Robot::get_telemetry_statistics() const
+{
+	return telemetry_uplink.get_statistics();
+}
+
+/*************************************************************************************************************************
+* Descrition: record_telemetry_sample() function queues the commanded and measured motor state of one loop
+* Pre: called from the loop that drives the motors (update_robot() or the control task)
+* Post: a sample is queued every TELEMETRY_SETTINGS::SAMPLE_DIVIDER-th call while the uplink runs
+**************************************************************************************************************************/
+void Robot::record_telemetry_sample(uint32_t loop_time_us)
+{
+	if (!telemetry_uplink.is_running() || ++telemetry_sample_counter < TELEMETRY_SETTINGS::SAMPLE_DIVIDER) {
+		return;
+	}
+	telemetry_sample_counter = 0;
+
+	TelemetrySample sample;
+	sample.timestamp_us = hal::micros();
+	sample.loop_time_us = loop_time_us;
+
+	for (uint8_t wheel = 0; wheel < RobotKinematics::WHEEL_COUNT; wheel++) {
+		const MotorTelemetry telemetry = sonic_board_controller.get_motor_telemetry(wheel);
+
+		sample.commanded_rpm[wheel] = sonic_board_controller.get_commanded_rpm(wheel);
+		sample.measured_rpm[wheel] = telemetry.rpm;
+		sample.encoder_counter[wheel] = telemetry.encoder_counter;
+		sample.temperature[wheel] = telemetry.temperature;
+	}
+
+	telemetry_uplink.record(sample);
+}
+
+/*************************************************************************************************************************
+* Descrition: set_traffic_recorder() function logs the received datagrams and the sonic board transactions
+* Pre: recorder outlives the robot and is started, nullptr stops logging
+* Post: none
+**************************************************************************************************************************/
+void Robot::set_traffic_recorder(TrafficRecorder* recorder)
+{
+	traffic_recorder = recorder;
+	sonic_board_controller.set_traffic_recorder(recorder);
 }
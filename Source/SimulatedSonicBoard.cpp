@@ -0,0 +1,243 @@
+#ifndef ARDUINO
+#include "SimulatedSonicBoard.h"
+#include "SonicBoardController.h"
+#include <string.h>
+
+/****************************************************************************************************************
+* Descrition: select() function starts a chip select window
+* Pre:  none
+* Post: if a legacy command is pending the reply for its data phase is prepared,
+*       otherwise the telemetry requested by the previous frame is prepared for the frame payload
+*       (framed if the last frame used the framed protocol)
+*****************************************************************************************************************/
+void SimulatedSonicBoard::select()
+{
+	window_size = 0;
+	memset(reply, 0, sizeof(reply));
+
+	if (command_pending) {
+		float* value = find_register(pending_command, pending_motor_id);
+		if (value) {
+			memcpy(reply, value, sizeof(float));
+		}
+		return;
+	}
+
+	if (framed_mode) {
+		prepare_framed_reply();
+		return;
+	}
+
+	for (uint8_t motor_id = 0; motor_id < MOTOR_COUNT; motor_id++) {
+		float* value = find_register(requested_telemetry, motor_id);
+		if (value) {
+			memcpy(reply + SONIC_BOARD_CONST::FRAME_HEADER_SIZE + motor_id * sizeof(float), value, sizeof(float));
+		}
+	}
+}
+
+/****************************************************************************************************************
+* Descrition: deselect() function ends a chip select window and executes what was received in it
+* Pre:  select() was called
+* Post: legacy command phase is latched, legacy data phase, batched frame or framed frame is executed
+*****************************************************************************************************************/
+void SimulatedSonicBoard::deselect()
+{
+	if (command_pending) {
+		float data = 0.0f;
+
+		command_pending = false;
+		if (window_size != sizeof(float)) {
+			protocol_errors++;
+			return;
+		}
+		memcpy(&data, window, sizeof(float));
+		execute_command(pending_command, pending_motor_id, data);
+	}
+	else if (window_size > 0 && window[0] == SONIC_BOARD_CONST::FRAME_START) {
+		framed_mode = false;
+		execute_frame();
+	}
+	else if (window_size > 0 && window[0] == SONIC_BOARD_CONST::FRAMED_FRAME_START && is_framed_protocol_supported) {
+		framed_mode = true;
+		execute_framed_frame();
+	}
+	else if (window_size == 2) {
+		pending_command = window[0];
+		pending_motor_id = window[1];
+		command_pending = true;
+	}
+	else if (window_size > 0) {
+		protocol_errors++;
+	}
+}
+
+/****************************************************************************************************************
+* Descrition: exchange() function clocks one byte in each direction
+* Pre:  board is selected
+* Post: received byte is stored in the window, byte clocked out by the board is returned
+*****************************************************************************************************************/
+uint8_t SimulatedSonicBoard::exchange(uint8_t data)
+{
+	if (window_size >= MAX_WINDOW_SIZE) {
+		protocol_errors++;
+		return 0;
+	}
+
+	window[window_size] = data;
+	return reply[window_size++];
+}
+
+/****************************************************************************************************************
+* Descrition: find_register() function maps a command to the motor register it reads or writes
+* Pre:  none
+* Post: pointer to the register is returned, nullptr if the motor or command is unknown
+*****************************************************************************************************************/
+float* SimulatedSonicBoard::find_register(uint8_t command, uint8_t motor_id)
+{
+	if (motor_id >= MOTOR_COUNT) {
+		return nullptr;
+	}
+
+	SimulatedMotorRegisters& motor = motors[motor_id];
+
+	switch (command) {
+	case SONIC_BOARD_CONST::SET_MOTOR_RPM:
+	case SONIC_BOARD_CONST::GET_MOTOR_RPM:                    return &motor.rpm;
+	case SONIC_BOARD_CONST::SET_MOTOR_ENABLE:
+	case SONIC_BOARD_CONST::GET_MOTOR_ENABLE:                 return &motor.enable;
+	case SONIC_BOARD_CONST::SET_MOTOR_BRAKE:
+	case SONIC_BOARD_CONST::GET_MOTOR_BRAKE:                  return &motor.brake;
+	case SONIC_BOARD_CONST::SET_MOTOR_DAC:
+	case SONIC_BOARD_CONST::GET_MOTOR_DAC:                    return &motor.dac;
+	case SONIC_BOARD_CONST::SET_MOTOR_KP:
+	case SONIC_BOARD_CONST::GET_MOTOR_KP:                     return &motor.kp;
+	case SONIC_BOARD_CONST::SET_MOTOR_KI:
+	case SONIC_BOARD_CONST::GET_MOTOR_KI:                     return &motor.ki;
+	case SONIC_BOARD_CONST::SET_MOTOR_KD:
+	case SONIC_BOARD_CONST::GET_MOTOR_KD:                     return &motor.kd;
+	case SONIC_BOARD_CONST::GET_MOTOR_ENCODER_COUNTER:        return &motor.encoder_counter;
+	case SONIC_BOARD_CONST::GET_MOTOR_CONTROLLER_TEMPERATURE: return &motor.temperature;
+	default:                                                  return nullptr;
+	}
+}
+
+/****************************************************************************************************************
+* Descrition: execute_command() function executes a legacy command after its data phase
+* Pre:  none
+* Post: register is written for set commands, unknown commands are counted as protocol errors
+*****************************************************************************************************************/
+void SimulatedSonicBoard::execute_command(uint8_t command, uint8_t motor_id, float data)
+{
+	float* value = find_register(command, motor_id);
+
+	received_commands++;
+	if (!value) {
+		if (command != SONIC_BOARD_CONST::DUMMY) {
+			protocol_errors++;
+		}
+		return;
+	}
+
+	// set commands are odd, get commands are even
+	if (command & 0x01) {
+		*value = data;
+	}
+}
+
+/****************************************************************************************************************
+* Descrition: execute_frame() function executes a batched frame
+* Pre:  window holds a frame starting with FRAME_START
+* Post: motor registers are written, malformed frames are counted as protocol errors
+*****************************************************************************************************************/
+void SimulatedSonicBoard::execute_frame()
+{
+	const uint8_t payload_size = window_size - SONIC_BOARD_CONST::FRAME_HEADER_SIZE;
+
+	if (window_size < SONIC_BOARD_CONST::FRAME_HEADER_SIZE || window[3] != payload_size ||
+		payload_size % sizeof(float) != 0) {
+		protocol_errors++;
+		return;
+	}
+
+	received_frames++;
+	requested_telemetry = window[2];
+	if (window[1] != SONIC_BOARD_CONST::SET_MODULE_MOTORS_RPM) {
+		protocol_errors++;
+		return;
+	}
+
+	for (uint8_t motor_id = 0; motor_id < payload_size / sizeof(float) && motor_id < MOTOR_COUNT; motor_id++) {
+		memcpy(&motors[motor_id].rpm, window + SONIC_BOARD_CONST::FRAME_HEADER_SIZE + motor_id * sizeof(float),
+			sizeof(float));
+	}
+}
+
+/****************************************************************************************************************
+* Descrition: execute_framed_frame() function checks and executes a framed frame
+* Pre:  window holds a frame starting with FRAMED_FRAME_START
+* Post: a frame with a valid crc is executed and acknowledged by the next reply,
+*       a corrupted frame is dropped and flagged in the status of the next reply
+*****************************************************************************************************************/
+void SimulatedSonicBoard::execute_framed_frame()
+{
+	const uint8_t payload_size = window[3];
+	const uint8_t crc_offset = SONIC_BOARD_CONST::FRAMED_HEADER_SIZE + payload_size;
+
+	if (window_size < SONIC_BOARD_CONST::FRAMED_HEADER_SIZE + SONIC_BOARD_CONST::FRAME_CRC_SIZE ||
+		window_size != crc_offset + SONIC_BOARD_CONST::FRAME_CRC_SIZE ||
+		crc16(window, crc_offset) != (window[crc_offset] | (window[crc_offset + 1] << 8))) {
+		crc_errors++;
+		frame_status = SONIC_BOARD_CONST::FRAME_STATUS_CRC_ERROR;
+		return;
+	}
+
+	received_frames++;
+	frame_status = 0;
+	acknowledged_sequence = window[4];
+	requested_telemetry = window[2];
+	reply_payload_size = payload_size;
+
+	if (window[1] == SONIC_BOARD_CONST::DUMMY) {
+		return;
+	}
+	if (window[1] != SONIC_BOARD_CONST::SET_MODULE_MOTORS_RPM || payload_size % sizeof(float) != 0) {
+		protocol_errors++;
+		return;
+	}
+
+	for (uint8_t motor_id = 0; motor_id < payload_size / sizeof(float) && motor_id < MOTOR_COUNT; motor_id++) {
+		memcpy(&motors[motor_id].rpm, window + SONIC_BOARD_CONST::FRAMED_HEADER_SIZE + motor_id * sizeof(float),
+			sizeof(float));
+	}
+}
+
+/****************************************************************************************************************
+* Descrition: prepare_framed_reply() function prepares the framed reply with the requested telemetry
+* Pre:  called from select()
+* Post: reply holds header, telemetry and crc sized like the payload of the last valid frame
+*****************************************************************************************************************/
+void SimulatedSonicBoard::prepare_framed_reply()
+{
+	const uint8_t crc_offset = SONIC_BOARD_CONST::FRAMED_HEADER_SIZE + reply_payload_size;
+	bool has_telemetry = false;
+
+	for (uint8_t motor_id = 0; motor_id < MOTOR_COUNT && (motor_id + 1) * sizeof(float) <= reply_payload_size; motor_id++) {
+		float* value = find_register(requested_telemetry, motor_id);
+		if (value) {
+			memcpy(reply + SONIC_BOARD_CONST::FRAMED_HEADER_SIZE + motor_id * sizeof(float), value, sizeof(float));
+			has_telemetry = true;
+		}
+	}
+
+	reply[0] = SONIC_BOARD_CONST::FRAMED_REPLY_START;
+	reply[1] = has_telemetry ? requested_telemetry : SONIC_BOARD_CONST::DUMMY;
+	reply[2] = frame_status;
+	reply[3] = reply_payload_size;
+	reply[4] = acknowledged_sequence;
+
+	const uint16_t crc = crc16(reply, crc_offset);
+	reply[crc_offset] = crc & 0xFF;
+	reply[crc_offset + 1] = crc >> 8;
+}
+#endif
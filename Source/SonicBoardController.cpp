@@ -1,38 +1,198 @@
 #include "SonicBoardController.h"
-#include <SPI.h>
-#include <Arduino.h>
+#include "Hal.h"
+#include "LoopProfiler.h"
+#include "TrafficRecorder.h"
 #include <algorithm>
+#include <math.h>
+#include <string.h>
+
+using SONIC_BOARD_TOPOLOGY::BOARDS;
+using SONIC_BOARD_TOPOLOGY::BOARD_COUNT;
+using SONIC_BOARD_TOPOLOGY::MOTOR_COUNT;
+
+// limits the rpm to the range supported by the motors
+static float constrain_rpm(float rpm)
+{
+	return std::max(SONIC_BOARD_CONST::MIN_MOTOR_RPM, std::min(rpm, SONIC_BOARD_CONST::MAX_MOTOR_RPM));
+}
+
+/****************************************************************************************************************
+* Descrition: SonicBoardController() constructor uses the controller itself as the spi bus backend
+* and resolves the module of every motor from the board table
+* Pre: none
+* Post: frames are transmitted synchronously on the hardware spi bus
+*****************************************************************************************************************/
+SonicBoardController::SonicBoardController()
+	: bus_backend(this), transaction_queue(*this), telemetry_sequence(0), resend_modules(0)
+{
+	for (uint8_t module_id = 0; module_id < BOARD_COUNT; module_id++) {
+		for (uint8_t motor_id = 0; motor_id < BOARDS[module_id].motor_count; motor_id++) {
+			motor_module[BOARDS[module_id].motors[motor_id]] = module_id;
+			motor_channel[BOARDS[module_id].motors[motor_id]] = motor_id;
+		}
+	}
+}
 
 /****************************************************************************************************************
-* Descrition: init() function initializes spi bus, sets the motors pid to default
+* Descrition: init() function initializes spi bus and brings the motors pid to the stored config
 * Pre: none
 * Post: spi is configured to it's default [CPOL = 0, CPHA = 0] settings and is ready for data transmission   
-        motors pid is set to default
+        every module that answered within HANDSHAKE_TIMEOUT_MS holds the stored (or default) pid gains
+        if the framed protocol is enabled the spi clock is negotiated
 *****************************************************************************************************************/
 void SonicBoardController::init()
 {
-	Serial.println();
-	Serial.println("initializing sonic board controller");
+	const uint32_t start_us = hal::micros();
+	const uint32_t start_ms = hal::millis();
+
+	hal::log("\ninitializing sonic board controller\n");
+	boot_statistics = SonicBoardBootStatistics();
 
 	/**********configure the spi pins and settings*************/
-	pinMode(SPI_SETTINGS::SS_SONIC_BOARD_LEFT, OUTPUT);
-	pinMode(SPI_SETTINGS::SS_SONIC_BOARD_RIGHT, OUTPUT);
-	digitalWrite(SPI_SETTINGS::SS_SONIC_BOARD_LEFT, HIGH);
-	digitalWrite(SPI_SETTINGS::SS_SONIC_BOARD_RIGHT, HIGH);
-	SPI.begin();
-	SPI.setFrequency(SPI_SETTINGS::SPI_FREQUENCY);
+	for (const SONIC_BOARD_TOPOLOGY::BoardDescriptor& board : BOARDS) {
+		hal::gpio_set_output(board.cs_pin);
+		hal::gpio_write(board.cs_pin, hal::GPIO_HIGH);
+	}
+	hal::spi_begin(SPI_SETTINGS::SPI_FREQUENCY);
+	spi_frequency_index = 0;
 	/************************************************************/
+	boot_statistics.spi_init_us = hal::micros() - start_us;
 
-	/***********set motors pid to default ***********************/
-	Serial.println("setting motors pid to default:");
-	set_motors_kp(1.5f, 1.5f, 1.5f, 1.5f);
-	set_motors_ki(0, 0, 0, 0);
-	set_motors_kd(0, 0, 0, 0);
-	Serial.println("done setting motors pid to default");
-	Serial.println("**************************************");
+	/**********wait for the modules and sync the motors pid******/
+	boot_statistics.pid_config_loaded = load_pid_config();
+	for (uint8_t module_id = 0; module_id < BOARD_COUNT; module_id++) {
+		if (wait_for_module(module_id, start_ms, SONIC_BOARD_CONST::HANDSHAKE_TIMEOUT_MS)) {
+			boot_statistics.module_ready_us[module_id] = hal::micros() - start_us;
+			boot_statistics.ready_modules |= 1 << module_id;
+		}
+		else {
+			hal::log("ERROR: sonic board module %u did not answer\n", module_id);
+		}
+	}
 	/************************************************************/
+	if (framed_protocol_enabled) {
+		negotiate_spi_clock();
+	}
+	boot_statistics.total_us = hal::micros() - start_us;
+
+	hal::log("motors pid %s, %u gains written\n", boot_statistics.pid_config_loaded ? "loaded" : "set to default",
+		boot_statistics.pid_writes);
+}
+
+/****************************************************************************************************************
+* Descrition: wait_for_module() function polls a module until it holds the configured pid gains
+* Pre:  module id indexes SONIC_BOARD_TOPOLOGY::BOARDS, start_ms is the hal::millis() time the handshake started
+* Post: true is returned once the module reports every gain back,
+*       false if timeout_ms elapsed since start_ms
+*****************************************************************************************************************/
+bool SonicBoardController::wait_for_module(uint8_t module_id, uint32_t start_ms, uint32_t timeout_ms)
+{
+	for (;;) {
+		// completes a command phase the module may have latched before the controller was reset
+		transmit_receive_float(module_id, 0, SONIC_BOARD_CONST::DUMMY, 0);
+
+		boot_statistics.handshake_polls++;
+		if (sync_module_pid(module_id)) {
+			return true;
+		}
+
+		if (hal::millis() - start_ms >= timeout_ms) {
+			return false;
+		}
+		hal::delay_ms(SONIC_BOARD_CONST::HANDSHAKE_POLL_PERIOD_MS);
+	}
+}
+
+/****************************************************************************************************************
+* Descrition: sync_module_pid() function reads the pid gains of the motors of a module
+* and writes the ones that differ from the config
+* Pre:  module id indexes SONIC_BOARD_TOPOLOGY::BOARDS
+* Post: true is returned if the module reported every configured gain (nothing was written)
+*       a module that is not running yet reads back garbage, so true also means the module answers
+*****************************************************************************************************************/
+bool SonicBoardController::sync_module_pid(uint8_t module_id)
+{
+	const uint8_t set_commands[] = {
+		SONIC_BOARD_CONST::SET_MOTOR_KP, SONIC_BOARD_CONST::SET_MOTOR_KI, SONIC_BOARD_CONST::SET_MOTOR_KD };
+	const uint32_t now_ms = hal::millis();
+	bool is_synced = true;
+
+	for (uint8_t motor_id = 0; motor_id < BOARDS[module_id].motor_count; motor_id++) {
+		const uint8_t motor = BOARDS[module_id].motors[motor_id];
+		const float gains[] = { pid_config.kp[motor], pid_config.ki[motor], pid_config.kd[motor] };
+
+		for (uint8_t i = 0; i < sizeof(set_commands); i++) {
+			// get commands follow their set commands
+			const float reported = transmit_receive_float(module_id, motor_id, set_commands[i] + 1, 0);
+
+			if (reported == gains[i]) {
+				update_shadow_register(motor, set_commands[i], gains[i], now_ms);
+				continue;
+			}
+
+			transmit_receive_float(module_id, motor_id, set_commands[i], gains[i]);
+			boot_statistics.pid_writes++;
+			is_synced = false;
+		}
+	}
+
+	return is_synced;
+}
+
+/****************************************************************************************************************
+* Descrition: load_pid_config() function loads the pid gains from non-volatile storage
+* Pre:  none
+* Post: pid_config holds the stored gains, or the default gains if nothing valid is stored
+*       true is returned if the stored gains were loaded
+*****************************************************************************************************************/
+bool SonicBoardController::load_pid_config()
+{
+	if (hal::storage_read(SONIC_BOARD_CONST::PID_CONFIG_KEY, &pid_config, sizeof(pid_config)) &&
+		pid_config.version == SONIC_BOARD_CONST::PID_CONFIG_VERSION) {
+		return true;
+	}
+
+	pid_config.version = SONIC_BOARD_CONST::PID_CONFIG_VERSION;
+	for (uint8_t motor = 0; motor < MOTOR_COUNT; motor++) {
+		pid_config.kp[motor] = SONIC_BOARD_CONST::DEFAULT_KP;
+		pid_config.ki[motor] = SONIC_BOARD_CONST::DEFAULT_KI;
+		pid_config.kd[motor] = SONIC_BOARD_CONST::DEFAULT_KD;
+	}
+	return false;
+}
+
+/****************************************************************************************************************
+* Descrition: save_pid_config() function stores new pid gains and writes them to the motors
+* Pre:  init() was called
+* Post: gains are used from the next boot on, true is returned if they were stored
+*****************************************************************************************************************/
+bool SonicBoardController::save_pid_config(const MotorPidConfig& config)
+{
+	pid_config = config;
+	pid_config.version = SONIC_BOARD_CONST::PID_CONFIG_VERSION;
+
+	for (uint8_t motor = 0; motor < MOTOR_COUNT; motor++) {
+		write_motor_register(motor, SONIC_BOARD_CONST::SET_MOTOR_KP, pid_config.kp[motor]);
+		write_motor_register(motor, SONIC_BOARD_CONST::SET_MOTOR_KI, pid_config.ki[motor]);
+		write_motor_register(motor, SONIC_BOARD_CONST::SET_MOTOR_KD, pid_config.kd[motor]);
+	}
+
+	return hal::storage_write(SONIC_BOARD_CONST::PID_CONFIG_KEY, &pid_config, sizeof(pid_config));
+}
 
-	delay(2000);
+const MotorPidConfig& SonicBoardController::get_pid_config() const
+{
+	return pid_config;
+}
+
+/****************************************************************************************************************
+* Descrition: get_boot_statistics() function returns the duration of the init() phases
+* Pre:  init() was called
+* Post: none
+*****************************************************************************************************************/
+const SonicBoardBootStatistics& SonicBoardController::get_boot_statistics() const
+{
+	return boot_statistics;
 }
 
 /****************************************************************************************************************
@@ -42,46 +202,24 @@ void SonicBoardController::init()
 *****************************************************************************************************************/
 void SonicBoardController::update_motors(float forward_speed, float left_speed, float rotation_speed)
 {
-	/***********************************************************************************************
-	* Calculate motor speeds
-	* (40*PI)/180 is 40 degrees (angle of motors) in radians
-	* 0.16375 is motor circumference at wheelbase in meters
-	* 0.05 is circumference of wheel in meters
-	************************************************************************************************/
-
-	/* Front left motor */
-	float wheel_speed_fl = (((forward_speed / cos((40 * PI) / 180))    // Forward speed part in m/s
-		- (left_speed / sin((40 * PI) / 180))                          // Left speed part in m/s
-		- ((rotation_speed*0.16375) / 2 * PI))                         // Rotation part in m/s
-		/ 0.05) * 60;                                                  // From m/s to RPM
-
-	/* Front right motor */
-	float wheel_speed_fr = -(((forward_speed / cos((40 * PI) / 180))   // Forward speed part in m/s
-		+ (left_speed / sin((40 * PI) / 180))                          // Left speed part in m/s
-		+ ((rotation_speed*0.16375) / 2 * PI))                         // Rotation part in m/s
-		/ 0.05) * 60;                                                  // From m/s to RPM
-
-    /* Back left motor */
-	float wheel_speed_bl = (((forward_speed / cos((40 * PI) / 180))    // Forward speed part in m/s
-		+ (left_speed / sin((40 * PI) / 180))                          // Left speed part in m/s
-		- ((rotation_speed*0.16375) / 2 * PI))                         // Rotation part in m/s
-		/ 0.05) * 60;                                                  // From m/s to RPM
-
-    /* Back right motor */
-	float wheel_speed_br = -(((forward_speed / cos((40 * PI) / 180))   // Forward speed part in m/s
-		- (left_speed / sin((40 * PI) / 180))                          // Left speed part in m/s
-		+ ((rotation_speed*0.16375) / 2 * PI))                         // Rotation part in m/s
-		/ 0.05) * 60;                                                  // From m/s to RPM
+	// wheel geometry is folded into the mixing matrix at compile time (see Kinematics.h)
+	float wheel_rpm[RobotKinematics::WHEEL_COUNT];
+
+	{
+		PROFILE_STAGE(STAGE_KINEMATICS);
+		RobotKinematics::body_to_wheels(forward_speed, left_speed, rotation_speed, wheel_rpm);
+	}
 
 	// transmit calculated wheel speed to the sonic boards
-	set_motors_rpm(wheel_speed_fl, wheel_speed_fr, wheel_speed_bl, wheel_speed_br);
+	set_motors_rpm(wheel_rpm[RobotKinematics::WHEEL_FL], wheel_rpm[RobotKinematics::WHEEL_FR],
+		wheel_rpm[RobotKinematics::WHEEL_BL], wheel_rpm[RobotKinematics::WHEEL_BR]);
 }
 
 /****************************************************************************************************************
 * Descrition: transmit_receive_float() function is used to 
 * transmit and receive commands and float data to and from the sonic boards
-* Pre:  module id is in range from 0 to 1
-*       motor id is in range from 0 to 1
+* Pre:  module id indexes SONIC_BOARD_TOPOLOGY::BOARDS
+*       motor id is in range from 0 to the motor count of the module
 *       command exists (refer to sonic board commands list)
 * Post: command and float data is transmited to the specified module
 *       float data is received from the specified module
@@ -99,64 +237,240 @@ float SonicBoardController::transmit_receive_float(uint8_t module_id, uint8_t mo
 
 	float_data.value = data;
 
+	// the queued frames must leave the bus before it is used directly
+	if (async_transactions_enabled) {
+		transaction_queue.flush();
+	}
+
+	// these transactions have no integrity check, so they never run above the default clock
+	if (spi_frequency_index) {
+		hal::spi_set_frequency(SPI_SETTINGS::SPI_FREQUENCY);
+	}
+
+	PROFILE_STAGE(STAGE_SPI_TRANSACTION);
+
+	bus_transactions.fetch_add(1, std::memory_order_relaxed);
+	bus_bytes.fetch_add(6, std::memory_order_relaxed);
+
 	select_module(module_id);
-	delayMicroseconds(50);
+	bus_delay(SPI_SETTINGS::CS_SETUP_DELAY_US);
 	// sending command 
-	SPI.transfer(command);
+	hal::spi_transfer(command);
 	// sending command parameter
-	SPI.transfer(motor_id);
+	hal::spi_transfer(motor_id);
 
 	deselect_module(module_id);
-	delayMicroseconds(50);
+	bus_delay(SPI_SETTINGS::CS_RELEASE_DELAY_US);
 	select_module(module_id);
 
 	// sending float data
-	receivedData[0] = SPI.transfer(float_data.bytes[0]);
-	receivedData[1] = SPI.transfer(float_data.bytes[1]);
-	receivedData[2] = SPI.transfer(float_data.bytes[2]);
-	receivedData[3] = SPI.transfer(float_data.bytes[3]);
+	receivedData[0] = hal::spi_transfer(float_data.bytes[0]);
+	receivedData[1] = hal::spi_transfer(float_data.bytes[1]);
+	receivedData[2] = hal::spi_transfer(float_data.bytes[2]);
+	receivedData[3] = hal::spi_transfer(float_data.bytes[3]);
 
 	deselect_module(module_id);
-	delayMicroseconds(50);
+	bus_delay(SPI_SETTINGS::CS_RELEASE_DELAY_US);
+
+	if (spi_frequency_index) {
+		hal::spi_set_frequency(SPI_SETTINGS::FRAMED_FREQUENCIES[spi_frequency_index]);
+	}
 
 	// copy received data to the union in order to convert it to the float value
 	std::copy(receivedData, receivedData + 4, float_data.bytes);
 
+	if (traffic_recorder) {
+		traffic_recorder->record_spi_float(module_id, motor_id, command, data, float_data.value);
+	}
+
 	// return received data as float
 	return float_data.value;
 }
 
 /****************************************************************************************************************
-* Descrition: set_motors_rpm() function sends rpm values to the motors
+* Descrition: transmit_receive_frame() function transmits a batched frame to the specified module
+* within a single chip select transaction and receives the same amount of float data back
+* (the telemetry requested with the previous frame to this module)
+* Pre:  module id indexes SONIC_BOARD_TOPOLOGY::BOARDS
+*       count is in range from 1 to MOTORS_PER_MODULE
+*       tx_data holds count floats, rx_data has room for count floats (may be nullptr)
+* Post: frame is transmited to the specified module
+*       float data clocked out by the module during the payload is stored in rx_data,
+*       rx_data is zeroed if the framed protocol rejected the reply
+*****************************************************************************************************************/
+void SonicBoardController::transmit_receive_frame(uint8_t module_id, uint8_t command,
+	                                              const float* tx_data, float* rx_data, uint8_t count)
+{
+	uint8_t tx_frame[SONIC_BOARD_CONST::MAX_FRAME_SIZE] = { 0 };
+	uint8_t rx_frame[SONIC_BOARD_CONST::MAX_FRAME_SIZE] = { 0 };
+
+	if (async_transactions_enabled) {
+		transaction_queue.flush();
+	}
+
+	const uint8_t frame_size = build_frame(tx_frame, module_id, command, next_telemetry_command(module_id), tx_data, count);
+	const uint8_t payload_offset = tx_frame[0] == SONIC_BOARD_CONST::FRAMED_FRAME_START ?
+		SONIC_BOARD_CONST::FRAMED_HEADER_SIZE : SONIC_BOARD_CONST::FRAME_HEADER_SIZE;
+
+	bus_backend->transfer_frame(module_id, tx_frame, rx_frame, frame_size);
+	const bool is_reply_valid = process_frame_reply(module_id, tx_frame, rx_frame);
+
+	if (rx_data && is_reply_valid) {
+		memcpy(rx_data, rx_frame + payload_offset, tx_frame[3]);
+	}
+	else if (rx_data) {
+		memset(rx_data, 0, tx_frame[3]);
+	}
+}
+
+/****************************************************************************************************************
+* Descrition: build_frame() function fills the frame buffer with the batched frame header and payload,
+* framed with sequence number and crc if the framed protocol is enabled
+* Pre:  frame has room for MAX_FRAME_SIZE bytes
+*       module id indexes SONIC_BOARD_TOPOLOGY::BOARDS
+*       count is in range from 1 to MOTORS_PER_MODULE
+* Post: frame holds the batched frame, frame size is returned
+*****************************************************************************************************************/
+uint8_t SonicBoardController::build_frame(uint8_t* frame, uint8_t module_id, uint8_t command,
+	                                      uint8_t telemetry_command, const float* tx_data, uint8_t count)
+{
+	count = std::min(count, SONIC_BOARD_CONST::MOTORS_PER_MODULE);
+	const uint8_t payload_size = count * sizeof(float);
+
+	frame[1] = command;
+	frame[2] = telemetry_command;
+	frame[3] = payload_size;
+
+	if (!framed_protocol_enabled) {
+		frame[0] = SONIC_BOARD_CONST::FRAME_START;
+		memcpy(frame + SONIC_BOARD_CONST::FRAME_HEADER_SIZE, tx_data, payload_size);
+		return SONIC_BOARD_CONST::FRAME_HEADER_SIZE + payload_size;
+	}
+
+	const uint8_t crc_offset = SONIC_BOARD_CONST::FRAMED_HEADER_SIZE + payload_size;
+
+	frame[0] = SONIC_BOARD_CONST::FRAMED_FRAME_START;
+	frame[4] = tx_sequence[module_id]++;
+	memcpy(frame + SONIC_BOARD_CONST::FRAMED_HEADER_SIZE, tx_data, payload_size);
+
+	const uint16_t crc = crc16(frame, crc_offset);
+	frame[crc_offset] = crc & 0xFF;
+	frame[crc_offset + 1] = crc >> 8;
+	return crc_offset + SONIC_BOARD_CONST::FRAME_CRC_SIZE;
+}
+
+/****************************************************************************************************************
+* Descrition: transfer_frame() function transmits a prepared frame within a single chip select transaction
+* Pre:  module id is in range from 0 to 1
+* Post: frame is transmited to the specified module, received bytes are stored in rx_data
+*****************************************************************************************************************/
+void SonicBoardController::transfer_frame(uint8_t module_id, const uint8_t* tx_data, uint8_t* rx_data, uint8_t length)
+{
+	PROFILE_STAGE(STAGE_SPI_TRANSACTION);
+
+	bus_transactions.fetch_add(1, std::memory_order_relaxed);
+	bus_bytes.fetch_add(length, std::memory_order_relaxed);
+
+	select_module(module_id);
+	bus_delay(SPI_SETTINGS::CS_SETUP_DELAY_US);
+	hal::spi_transfer_bytes(tx_data, rx_data, length);
+	deselect_module(module_id);
+	bus_delay(SPI_SETTINGS::CS_RELEASE_DELAY_US);
+
+	if (traffic_recorder) {
+		traffic_recorder->record_spi_frame(module_id, tx_data, rx_data, length);
+	}
+}
+
+/****************************************************************************************************************
+* Descrition: set_motors_rpm() function sends rpm values to the wheel motors
+* together with the rpm staged for the other motors (see set_motor_rpm())
+* using the batched frame if it is enabled
 * Pre:
 * Post: rmp data is transmited to the motors
 *****************************************************************************************************************/
 void SonicBoardController::set_motors_rpm(float wheel_speed_fl, float wheel_speed_fr, 
 	                                      float wheel_speed_bl, float wheel_speed_br)
 {
-	transmit_receive_float(
-		SONIC_BOARD_CONST::SONIC_MODULE_RIGHT,
-		SONIC_BOARD_CONST::MOTOR_ID_FR,
-		SONIC_BOARD_CONST::SET_MOTOR_RPM,
-		constrain(wheel_speed_fr, SONIC_BOARD_CONST::MIN_MOTOR_RPM, SONIC_BOARD_CONST::MAX_MOTOR_RPM) );
+	commanded_rpm[RobotKinematics::WHEEL_FL] = constrain_rpm(wheel_speed_fl);
+	commanded_rpm[RobotKinematics::WHEEL_FR] = constrain_rpm(wheel_speed_fr);
+	commanded_rpm[RobotKinematics::WHEEL_BL] = constrain_rpm(wheel_speed_bl);
+	commanded_rpm[RobotKinematics::WHEEL_BR] = constrain_rpm(wheel_speed_br);
 
-	transmit_receive_float(
-		SONIC_BOARD_CONST::SONIC_MODULE_LEFT,
-		SONIC_BOARD_CONST::MOTOR_ID_FL,
-		SONIC_BOARD_CONST::SET_MOTOR_RPM,
-		constrain(wheel_speed_fl, SONIC_BOARD_CONST::MIN_MOTOR_RPM, SONIC_BOARD_CONST::MAX_MOTOR_RPM) );
+	if (batched_frame_enabled) {
+		set_motors_rpm_batched();
+	}
+	else {
+		set_motors_rpm_legacy();
+	}
+}
 
-	transmit_receive_float(
-		SONIC_BOARD_CONST::SONIC_MODULE_LEFT,
-		SONIC_BOARD_CONST::MOTOR_ID_BL,
-		SONIC_BOARD_CONST::SET_MOTOR_RPM,
-		constrain(wheel_speed_bl, SONIC_BOARD_CONST::MIN_MOTOR_RPM, SONIC_BOARD_CONST::MAX_MOTOR_RPM) );
+/****************************************************************************************************************
+* Descrition: set_motors_rpm_batched() function sends the commanded rpm to the motors, one frame per module
+* Pre:  sonic boards support SET_MODULE_MOTORS_RPM command
+* Post: rmp data is transmited to the motors, every module is selected at most once
+*****************************************************************************************************************/
+void SonicBoardController::set_motors_rpm_batched()
+{
+	const uint32_t now_ms = hal::millis();
+	const uint32_t resend = resend_modules.exchange(0);
 
-	transmit_receive_float(
-		SONIC_BOARD_CONST::SONIC_MODULE_RIGHT,
-		SONIC_BOARD_CONST::MOTOR_ID_BR,
-		SONIC_BOARD_CONST::SET_MOTOR_RPM,
-		constrain(wheel_speed_br, SONIC_BOARD_CONST::MIN_MOTOR_RPM, SONIC_BOARD_CONST::MAX_MOTOR_RPM) );
+	for (uint8_t module_id = 0; module_id < BOARD_COUNT; module_id++) {
+		const SONIC_BOARD_TOPOLOGY::BoardDescriptor& board = BOARDS[module_id];
+		// payload is indexed by motor id
+		float module_rpm[SONIC_BOARD_CONST::MOTORS_PER_MODULE];
+		// the frames carry the telemetry requests, so none is coalesced while the telemetry is enabled
+		bool write_required = telemetry_enabled || ((resend >> module_id) & 1);
+
+		for (uint8_t motor_id = 0; motor_id < board.motor_count; motor_id++) {
+			const uint8_t motor = board.motors[motor_id];
+			module_rpm[motor_id] = commanded_rpm[motor];
+			write_required |= is_write_required(motor, SONIC_BOARD_CONST::SET_MOTOR_RPM, module_rpm[motor_id], now_ms);
+		}
+
+		if (!write_required) {
+			bus_skipped_writes.fetch_add(1, std::memory_order_relaxed);
+			continue;
+		}
+
+		if (async_transactions_enabled) {
+			// checked before the frame is built, building it consumes a telemetry request and a sequence number
+			if (transaction_queue.is_full()) {
+				bus_dropped_frames.fetch_add(1, std::memory_order_relaxed);
+				resend_modules.fetch_or(1u << module_id);
+				continue;
+			}
+
+			uint8_t frame[SONIC_BOARD_CONST::MAX_FRAME_SIZE];
+			const uint8_t frame_size = build_frame(frame, module_id, SONIC_BOARD_CONST::SET_MODULE_MOTORS_RPM,
+				next_telemetry_command(module_id), module_rpm, board.motor_count);
+
+			transaction_queue.submit(module_id, frame, frame_size, on_frame_complete, this);
+		}
+		else {
+			transmit_receive_frame(module_id, SONIC_BOARD_CONST::SET_MODULE_MOTORS_RPM,
+				module_rpm, nullptr, board.motor_count);
+		}
+
+		for (uint8_t motor_id = 0; motor_id < board.motor_count; motor_id++) {
+			update_shadow_register(board.motors[motor_id], SONIC_BOARD_CONST::SET_MOTOR_RPM, module_rpm[motor_id], now_ms);
+		}
+	}
+}
+
+/****************************************************************************************************************
+* Descrition: set_motors_rpm_legacy() function sends the commanded rpm to the motors one by one
+* Pre:
+* Post: rmp data is transmited to the motors, module by module
+*****************************************************************************************************************/
+void SonicBoardController::set_motors_rpm_legacy()
+{
+	for (const SONIC_BOARD_TOPOLOGY::BoardDescriptor& board : BOARDS) {
+		for (uint8_t motor_id = 0; motor_id < board.motor_count; motor_id++) {
+			const uint8_t motor = board.motors[motor_id];
+			write_motor_register(motor, SONIC_BOARD_CONST::SET_MOTOR_RPM, commanded_rpm[motor]);
+		}
+	}
 }
 
 /****************************************************************************************************************
@@ -166,33 +480,17 @@ void SonicBoardController::set_motors_rpm(float wheel_speed_fl, float wheel_spee
 *****************************************************************************************************************/
 void SonicBoardController::set_motors_kp(float kp_fr, float kp_fl, float kp_bl, float kp_br)
 {
-	Serial.print(" setting front right motor kp to: ");
-	Serial.println(kp_fr);
-	transmit_receive_float(
-		SONIC_BOARD_CONST::SONIC_MODULE_RIGHT,
-		SONIC_BOARD_CONST::MOTOR_ID_FR,
-		SONIC_BOARD_CONST::SET_MOTOR_KP, kp_fr);
+	hal::log(" setting front right motor kp to: %.2f\n", kp_fr);
+	write_motor_register(RobotKinematics::WHEEL_FR, SONIC_BOARD_CONST::SET_MOTOR_KP, kp_fr);
 
-	Serial.print(" setting front left  motor kp to: ");
-	Serial.println(kp_fl);
-	transmit_receive_float(
-		SONIC_BOARD_CONST::SONIC_MODULE_LEFT,
-		SONIC_BOARD_CONST::MOTOR_ID_FL,
-		SONIC_BOARD_CONST::SET_MOTOR_KP, kp_fl);
+	hal::log(" setting front left  motor kp to: %.2f\n", kp_fl);
+	write_motor_register(RobotKinematics::WHEEL_FL, SONIC_BOARD_CONST::SET_MOTOR_KP, kp_fl);
 
-	Serial.print(" setting back left  motor kp to: ");
-	Serial.println(kp_bl);
-	transmit_receive_float(
-		SONIC_BOARD_CONST::SONIC_MODULE_LEFT,
-		SONIC_BOARD_CONST::MOTOR_ID_BL,
-		SONIC_BOARD_CONST::SET_MOTOR_KP, kp_bl );
+	hal::log(" setting back left  motor kp to: %.2f\n", kp_bl);
+	write_motor_register(RobotKinematics::WHEEL_BL, SONIC_BOARD_CONST::SET_MOTOR_KP, kp_bl);
 
-	Serial.print(" setting back right motor kp to: ");
-	Serial.println(kp_br);
-	transmit_receive_float(
-		SONIC_BOARD_CONST::SONIC_MODULE_RIGHT,
-		SONIC_BOARD_CONST::MOTOR_ID_BR,
-		SONIC_BOARD_CONST::SET_MOTOR_KP, kp_br );
+	hal::log(" setting back right motor kp to: %.2f\n", kp_br);
+	write_motor_register(RobotKinematics::WHEEL_BR, SONIC_BOARD_CONST::SET_MOTOR_KP, kp_br);
 }
 
 /****************************************************************************************************************
@@ -202,33 +500,17 @@ void SonicBoardController::set_motors_kp(float kp_fr, float kp_fl, float kp_bl,
 *****************************************************************************************************************/
 void SonicBoardController::set_motors_ki(float ki_fr, float ki_fl, float ki_bl, float ki_br)
 {
-	Serial.print(" setting front right motor ki to: ");
-	Serial.println(ki_fr);
-	transmit_receive_float(
-		SONIC_BOARD_CONST::SONIC_MODULE_RIGHT,
-		SONIC_BOARD_CONST::MOTOR_ID_FR,
-		SONIC_BOARD_CONST::SET_MOTOR_KI, ki_fr );
+	hal::log(" setting front right motor ki to: %.2f\n", ki_fr);
+	write_motor_register(RobotKinematics::WHEEL_FR, SONIC_BOARD_CONST::SET_MOTOR_KI, ki_fr);
 
-	Serial.print(" setting front left  motor ki to: ");
-	Serial.println(ki_fl);
-	transmit_receive_float(
-		SONIC_BOARD_CONST::SONIC_MODULE_LEFT,
-		SONIC_BOARD_CONST::MOTOR_ID_FL,
-		SONIC_BOARD_CONST::SET_MOTOR_KI, ki_fl );
+	hal::log(" setting front left  motor ki to: %.2f\n", ki_fl);
+	write_motor_register(RobotKinematics::WHEEL_FL, SONIC_BOARD_CONST::SET_MOTOR_KI, ki_fl);
 
-	Serial.print(" setting back left  motor ki to: ");
-	Serial.println(ki_bl);
-	transmit_receive_float(
-		SONIC_BOARD_CONST::SONIC_MODULE_LEFT,
-		SONIC_BOARD_CONST::MOTOR_ID_BL,
-		SONIC_BOARD_CONST::SET_MOTOR_KI, ki_bl );
+	hal::log(" setting back left  motor ki to: %.2f\n", ki_bl);
+	write_motor_register(RobotKinematics::WHEEL_BL, SONIC_BOARD_CONST::SET_MOTOR_KI, ki_bl);
 
-	Serial.print(" setting back right  motor ki to: ");
-	Serial.println(ki_br);
-	transmit_receive_float(
-		SONIC_BOARD_CONST::SONIC_MODULE_RIGHT,
-		SONIC_BOARD_CONST::MOTOR_ID_BR,
-		SONIC_BOARD_CONST::SET_MOTOR_KI, ki_br );
+	hal::log(" setting back right  motor ki to: %.2f\n", ki_br);
+	write_motor_register(RobotKinematics::WHEEL_BR, SONIC_BOARD_CONST::SET_MOTOR_KI, ki_br);
 }
 
 /****************************************************************************************************************
@@ -238,73 +520,646 @@ void SonicBoardController::set_motors_ki(float ki_fr, float ki_fl, float ki_bl,
 *****************************************************************************************************************/
 void SonicBoardController::set_motors_kd(float kd_fr, float kd_fl, float kd_bl, float kd_br)
 {
-	Serial.print(" setting front right motor kd to: ");
-	Serial.println(kd_fr);
-	transmit_receive_float(
-		SONIC_BOARD_CONST::SONIC_MODULE_RIGHT,
-		SONIC_BOARD_CONST::MOTOR_ID_FR,
-		SONIC_BOARD_CONST::SET_MOTOR_KD, kd_fr );
+	hal::log(" setting front right motor kd to: %.2f\n", kd_fr);
+	write_motor_register(RobotKinematics::WHEEL_FR, SONIC_BOARD_CONST::SET_MOTOR_KD, kd_fr);
 
-	Serial.print(" setting front left  motor kd to: ");
-	Serial.println(kd_fl);
-	transmit_receive_float(
-		SONIC_BOARD_CONST::SONIC_MODULE_LEFT,
-		SONIC_BOARD_CONST::MOTOR_ID_FL,
-		SONIC_BOARD_CONST::SET_MOTOR_KD, kd_fl );
+	hal::log(" setting front left  motor kd to: %.2f\n", kd_fl);
+	write_motor_register(RobotKinematics::WHEEL_FL, SONIC_BOARD_CONST::SET_MOTOR_KD, kd_fl);
 
-	Serial.print(" setting back left  motor kd to: ");
-	Serial.println(kd_bl);
-	transmit_receive_float(
-		SONIC_BOARD_CONST::SONIC_MODULE_LEFT,
-		SONIC_BOARD_CONST::MOTOR_ID_BL,
-		SONIC_BOARD_CONST::SET_MOTOR_KD, kd_bl );
+	hal::log(" setting back left  motor kd to: %.2f\n", kd_bl);
+	write_motor_register(RobotKinematics::WHEEL_BL, SONIC_BOARD_CONST::SET_MOTOR_KD, kd_bl);
 
-	Serial.print(" setting back right  motor kd to: ");
-	Serial.println(kd_br);
-	transmit_receive_float(
-		SONIC_BOARD_CONST::SONIC_MODULE_RIGHT,
-		SONIC_BOARD_CONST::MOTOR_ID_BR,
-		SONIC_BOARD_CONST::SET_MOTOR_KD, kd_br );
+	hal::log(" setting back right  motor kd to: %.2f\n", kd_br);
+	write_motor_register(RobotKinematics::WHEEL_BR, SONIC_BOARD_CONST::SET_MOTOR_KD, kd_br);
 }
 
 /****************************************************************************************************************
 * Descrition: select_module() function enables specified spi module 
-* Pre :  module id is in range from 0 to 1
+* Pre :  module id indexes SONIC_BOARD_TOPOLOGY::BOARDS
 * Post : slave select pin for the specified module is in low state (active)
 *****************************************************************************************************************/
 void SonicBoardController::select_module(uint8_t module_id)
 {
-	if (module_id == SONIC_BOARD_CONST::SONIC_MODULE_LEFT) {
-		digitalWrite(SPI_SETTINGS::SS_SONIC_BOARD_LEFT, LOW);
-	}
-	else if (module_id == SONIC_BOARD_CONST::SONIC_MODULE_RIGHT) {
-		digitalWrite(SPI_SETTINGS::SS_SONIC_BOARD_RIGHT, LOW);
-	}
-	else 
-	{
-		Serial.print("ERROR: module with id = ");
-		Serial.print(module_id);
-		Serial.println(" not found");
+	if (module_id >= BOARD_COUNT) {
+		hal::log("ERROR: module with id = %u not found\n", module_id);
+		return;
 	}
+
+	hal::gpio_fast_write(BOARDS[module_id].cs_pin, hal::GPIO_LOW);
+	bus_cs_toggles.fetch_add(1, std::memory_order_relaxed);
 }
 
 /****************************************************************************************************************
 * Descrition: select_module() function disables specified spi module
-* Pre :  module id is in range from 0 to 1
+* Pre :  module id indexes SONIC_BOARD_TOPOLOGY::BOARDS
 * Post : slave select pin for the specified module is in high state (disabled)
 *****************************************************************************************************************/
 void SonicBoardController::deselect_module(uint8_t module_id)
 {
-	if (module_id == SONIC_BOARD_CONST::SONIC_MODULE_LEFT) {
-		digitalWrite(SPI_SETTINGS::SS_SONIC_BOARD_LEFT, HIGH);
+	if (module_id >= BOARD_COUNT) {
+		hal::log("ERROR: module with id = %u not found\n", module_id);
+		return;
 	}
-	else if (module_id == SONIC_BOARD_CONST::SONIC_MODULE_RIGHT) {
-		digitalWrite(SPI_SETTINGS::SS_SONIC_BOARD_RIGHT, HIGH);
+
+	hal::gpio_fast_write(BOARDS[module_id].cs_pin, hal::GPIO_HIGH);
+	bus_cs_toggles.fetch_add(1, std::memory_order_relaxed);
+}
+
+
+/****************************************************************************************************************
+* Descrition: bus_delay() function waits for the specified time and accounts it in the bus statistics
+* Pre :  none
+* Post : delay_us microseconds have passed
+*****************************************************************************************************************/
+void SonicBoardController::bus_delay(uint32_t delay_us)
+{
+	hal::delay_us(delay_us);
+	bus_delay_us.fetch_add(delay_us, std::memory_order_relaxed);
+}
+
+/****************************************************************************************************************
+* Descrition: set_batched_frame_enabled() function selects between the batched frame and the legacy
+* per-motor transactions for setting motors rpm, the legacy transactions are used by default
+* Pre :  sonic boards support SET_MODULE_MOTORS_RPM command if enabled is true
+* Post : set_motors_rpm() uses the selected protocol
+*****************************************************************************************************************/
+void SonicBoardController::set_batched_frame_enabled(bool enabled)
+{
+	batched_frame_enabled = enabled;
+}
+
+/****************************************************************************************************************
+* Descrition: get_bus_statistics() function returns the spi traffic accumulated since the last reset
+* Pre :  none
+* Post : none, every counter is read atomically while the spi queue worker may still update the others
+*****************************************************************************************************************/
+SpiBusStatistics SonicBoardController::get_bus_statistics() const
+{
+	SpiBusStatistics statistics;
+
+	statistics.transactions = bus_transactions.load(std::memory_order_relaxed);
+	statistics.bytes = bus_bytes.load(std::memory_order_relaxed);
+	statistics.cs_toggles = bus_cs_toggles.load(std::memory_order_relaxed);
+	statistics.delay_us = bus_delay_us.load(std::memory_order_relaxed);
+	statistics.skipped_writes = bus_skipped_writes.load(std::memory_order_relaxed);
+	statistics.dropped_frames = bus_dropped_frames.load(std::memory_order_relaxed);
+	return statistics;
+}
+
+/****************************************************************************************************************
+* Descrition: reset_bus_statistics() function clears the accumulated spi traffic counters
+* Pre :  none
+* Post : all bus statistics counters are zero
+*****************************************************************************************************************/
+void SonicBoardController::reset_bus_statistics()
+{
+	bus_transactions.store(0, std::memory_order_relaxed);
+	bus_bytes.store(0, std::memory_order_relaxed);
+	bus_cs_toggles.store(0, std::memory_order_relaxed);
+	bus_delay_us.store(0, std::memory_order_relaxed);
+	bus_skipped_writes.store(0, std::memory_order_relaxed);
+	bus_dropped_frames.store(0, std::memory_order_relaxed);
+}
+
+/****************************************************************************************************************
+* Descrition: enable_async_transactions() function makes set_motors_rpm() queue the batched frames
+* instead of waiting for the bus
+* Pre :  batched frame is enabled
+* Post : if use_worker_task is true the frames are transmitted by a background task,
+*        otherwise get_transaction_queue().service() must be called to transmit them
+*        true is returned on success
+*****************************************************************************************************************/
+bool SonicBoardController::enable_async_transactions(bool use_worker_task)
+{
+	if (use_worker_task && !transaction_queue.start_worker()) {
+		return false;
 	}
-	else
-	{
-		Serial.print("ERROR: module with id = ");
-		Serial.print(module_id);
-		Serial.println(" not found");
+
+	async_transactions_enabled = true;
+	return true;
+}
+
+/****************************************************************************************************************
+* Descrition: disable_async_transactions() function transmits the queued frames and returns to the
+* synchronous transmission
+* Pre :  none
+* Post : queue is idle, set_motors_rpm() transmits the frames in place
+*****************************************************************************************************************/
+void SonicBoardController::disable_async_transactions()
+{
+	transaction_queue.flush();
+	async_transactions_enabled = false;
+}
+
+/****************************************************************************************************************
+* Descrition: set_bus_backend() function replaces the backend used for the batched frames (e.g. with a mock)
+* Pre :  transaction queue is idle
+* Post : batched frames are transmitted through the specified backend
+*****************************************************************************************************************/
+void SonicBoardController::set_bus_backend(SpiBusBackend& backend)
+{
+	bus_backend = &backend;
+	transaction_queue.set_backend(backend);
+}
+
+SpiTransactionQueue& SonicBoardController::get_transaction_queue()
+{
+	return transaction_queue;
+}
+
+/****************************************************************************************************************
+* Descrition: set_traffic_recorder() function logs the bus transactions to a traffic recorder
+* Pre :  recorder outlives the controller, nullptr stops logging
+* Post : every register transaction and every frame transmitted through this controller is recorded
+*****************************************************************************************************************/
+void SonicBoardController::set_traffic_recorder(TrafficRecorder* recorder)
+{
+	traffic_recorder = recorder;
+}
+
+/****************************************************************************************************************
+* Descrition: set_telemetry_enabled() function enables or disables the telemetry requests in the batched frames
+* Pre :  none
+* Post : when disabled the frames request DUMMY and the telemetry snapshot is no longer updated
+*        while enabled every batched frame is transmitted, the write coalescing skips none of them
+*****************************************************************************************************************/
+void SonicBoardController::set_telemetry_enabled(bool enabled)
+{
+	telemetry_enabled = enabled;
+}
+
+/****************************************************************************************************************
+* Descrition: get_motor_telemetry() function returns a consistent copy of the latest telemetry of a motor
+* Pre :  motor is a motor index (RobotKinematics::WHEEL_* for the wheels)
+* Post : telemetry snapshot is returned, values never received have zero timestamps
+*****************************************************************************************************************/
+MotorTelemetry SonicBoardController::get_motor_telemetry(uint8_t motor) const
+{
+	MotorTelemetry telemetry = {};
+	uint32_t sequence = 0;
+
+	if (motor >= MOTOR_COUNT) {
+		return telemetry;
+	}
+
+	// retry while the snapshot is being written
+	do {
+		sequence = telemetry_sequence.load(std::memory_order_acquire);
+		telemetry = motor_telemetry[motor];
+		std::atomic_thread_fence(std::memory_order_acquire);
+	} while ((sequence & 1) || sequence != telemetry_sequence.load(std::memory_order_relaxed));
+
+	return telemetry;
+}
+
+/****************************************************************************************************************
+* Descrition: get_commanded_rpm() function returns the last rpm commanded to a motor after the rpm limit
+* Pre :  motor is a motor index (RobotKinematics::WHEEL_* for the wheels)
+* Post : commanded rpm is returned, 0 for an invalid motor
+*****************************************************************************************************************/
+float SonicBoardController::get_commanded_rpm(uint8_t motor) const
+{
+	return motor < MOTOR_COUNT ? commanded_rpm[motor] : 0;
+}
+
+/****************************************************************************************************************
+* Descrition: set_motor_rpm() function stages the rpm of a motor that is not a wheel (e.g. a dribbler)
+* Pre :  motor is a motor index from RobotKinematics::WHEEL_COUNT on
+* Post : rpm is transmited with the next update_motors(), wheel rpm is owned by update_motors()
+*****************************************************************************************************************/
+void SonicBoardController::set_motor_rpm(uint8_t motor, float rpm)
+{
+	if (motor < RobotKinematics::WHEEL_COUNT || motor >= MOTOR_COUNT) {
+		hal::log("ERROR: motor with index = %u is not an auxiliary motor\n", motor);
+		return;
+	}
+
+	commanded_rpm[motor] = constrain_rpm(rpm);
+}
+
+/****************************************************************************************************************
+* Descrition: next_telemetry_command() function selects the telemetry to request with the next frame to a module
+* Pre :  module id indexes SONIC_BOARD_TOPOLOGY::BOARDS
+* Post : next command of TELEMETRY_COMMANDS is returned, DUMMY if telemetry is disabled
+*****************************************************************************************************************/
+uint8_t SonicBoardController::next_telemetry_command(uint8_t module_id)
+{
+	if (!telemetry_enabled || module_id >= BOARD_COUNT) {
+		return SONIC_BOARD_CONST::DUMMY;
+	}
+
+	const uint8_t command = SONIC_BOARD_CONST::TELEMETRY_COMMANDS[telemetry_rotation[module_id]];
+	telemetry_rotation[module_id] = (telemetry_rotation[module_id] + 1) % SONIC_BOARD_CONST::TELEMETRY_COMMAND_COUNT;
+	return command;
+}
+
+/****************************************************************************************************************
+* Descrition: process_frame_reply() function stores the telemetry received during a batched frame
+* Pre :  called in the order the frames were transmitted
+*       tx_frame and rx_frame hold a complete batched frame
+* Post : telemetry requested with the previous frame to the module is stored in the snapshot
+*        false is returned if the framed protocol rejected the reply
+*****************************************************************************************************************/
+bool SonicBoardController::process_frame_reply(uint8_t module_id, const uint8_t* tx_frame, const uint8_t* rx_frame)
+{
+	if (module_id >= BOARD_COUNT) {
+		return false;
+	}
+
+	uint8_t telemetry_command = requested_telemetry[module_id];
+	uint8_t payload_offset = SONIC_BOARD_CONST::FRAME_HEADER_SIZE;
+	const uint8_t motor_count = std::min<uint8_t>(tx_frame[3] / sizeof(float), BOARDS[module_id].motor_count);
+	const uint32_t timestamp_us = hal::micros();
+
+	requested_telemetry[module_id] = tx_frame[2];
+	if (tx_frame[0] == SONIC_BOARD_CONST::FRAMED_FRAME_START) {
+		if (!check_framed_reply(module_id, tx_frame, rx_frame)) {
+			return false;
+		}
+		// the module names the telemetry it sends
+		telemetry_command = rx_frame[1];
+		payload_offset = SONIC_BOARD_CONST::FRAMED_HEADER_SIZE;
+	}
+
+	if (telemetry_command == SONIC_BOARD_CONST::DUMMY) {
+		return true;
+	}
+
+	telemetry_sequence.fetch_add(1, std::memory_order_acq_rel);
+	for (uint8_t motor_id = 0; motor_id < motor_count; motor_id++) {
+		MotorTelemetry& telemetry = motor_telemetry[BOARDS[module_id].motors[motor_id]];
+		float value = 0.0f;
+
+		memcpy(&value, rx_frame + payload_offset + motor_id * sizeof(float), sizeof(float));
+
+		if (telemetry_command == SONIC_BOARD_CONST::GET_MOTOR_RPM) {
+			telemetry.rpm = value;
+			telemetry.rpm_timestamp_us = timestamp_us;
+		}
+		else if (telemetry_command == SONIC_BOARD_CONST::GET_MOTOR_ENCODER_COUNTER) {
+			telemetry.encoder_counter = value;
+			telemetry.encoder_counter_timestamp_us = timestamp_us;
+		}
+		else if (telemetry_command == SONIC_BOARD_CONST::GET_MOTOR_CONTROLLER_TEMPERATURE) {
+			telemetry.temperature = value;
+			telemetry.temperature_timestamp_us = timestamp_us;
+		}
+	}
+	telemetry_sequence.fetch_add(1, std::memory_order_release);
+	return true;
+}
+
+/****************************************************************************************************************
+* Descrition: check_framed_reply() function verifies the reply to a framed frame and the acknowledgement
+* of the previous frame to the module
+* Pre :  called in the order the frames were transmitted, tx_frame is a framed frame
+* Post : link statistics are updated, lost setpoints are scheduled for a resend
+*        true is returned if the reply payload can be used
+*****************************************************************************************************************/
+bool SonicBoardController::check_framed_reply(uint8_t module_id, const uint8_t* tx_frame, const uint8_t* rx_frame)
+{
+	const uint8_t payload_size = tx_frame[3];
+	const uint8_t crc_offset = SONIC_BOARD_CONST::FRAMED_HEADER_SIZE + payload_size;
+	const uint16_t crc = rx_frame[crc_offset] | (rx_frame[crc_offset + 1] << 8);
+	const uint8_t previous_sequence = tx_frame[4] - 1;
+	BoardLinkStatistics& link = link_statistics[module_id];
+
+	const bool is_reply_valid = rx_frame[0] == SONIC_BOARD_CONST::FRAMED_REPLY_START &&
+		rx_frame[3] == payload_size && crc16(rx_frame, crc_offset) == crc;
+	const bool is_ack_expected_now = is_ack_expected[module_id];
+
+	link.frames++;
+	is_ack_expected[module_id] = true;
+
+	if (!is_reply_valid) {
+		// the acknowledgement is lost with the reply, so the setpoints are resent to be safe
+		link.rx_errors++;
+		resend_modules.fetch_or(1UL << module_id);
+		record_link_result(module_id, true);
+		return false;
+	}
+
+	if (is_ack_expected_now && (rx_frame[4] != previous_sequence ||
+		(rx_frame[2] & SONIC_BOARD_CONST::FRAME_STATUS_CRC_ERROR))) {
+		link.tx_errors++;
+		resend_modules.fetch_or(1UL << module_id);
+		record_link_result(module_id, true);
+		return true;
+	}
+
+	record_link_result(module_id, false);
+	return true;
+}
+
+/****************************************************************************************************************
+* Descrition: record_link_result() function tracks the error rate of the bus and steps the clock down
+* when it rises
+* Pre :  called from the context that drives the bus
+* Post : after more than MAX_WINDOW_ERRORS errors within ERROR_WINDOW_FRAMES frames the clock is one step lower
+*****************************************************************************************************************/
+void SonicBoardController::record_link_result(uint8_t module_id, bool is_error)
+{
+	// the negotiation counts the errors itself
+	if (clock_negotiation_active) {
+		return;
+	}
+
+	window_frames++;
+	window_errors += is_error;
+
+	if (window_errors > SPI_SETTINGS::MAX_WINDOW_ERRORS) {
+		if (spi_frequency_index > 0) {
+			set_spi_frequency_index(spi_frequency_index - 1);
+			link_statistics[module_id].clock_backoffs++;
+		}
+		window_frames = 0;
+		window_errors = 0;
+	}
+	else if (window_frames >= SPI_SETTINGS::ERROR_WINDOW_FRAMES) {
+		window_frames = 0;
+		window_errors = 0;
+	}
+}
+
+/****************************************************************************************************************
+* Descrition: set_framed_protocol_enabled() function selects the framed protocol for the batched frames
+* Pre :  sonic boards support the framed protocol if enabled is true, the batched frame is enabled
+*        called before init(), or followed by negotiate_spi_clock()
+* Post : batched frames carry a sequence number and crc, when disabled the default clock is restored
+*****************************************************************************************************************/
+void SonicBoardController::set_framed_protocol_enabled(bool enabled)
+{
+	if (async_transactions_enabled) {
+		transaction_queue.flush();
+	}
+
+	framed_protocol_enabled = enabled;
+	if (!enabled && spi_frequency_index) {
+		set_spi_frequency_index(0);
+	}
+}
+
+/****************************************************************************************************************
+* Descrition: negotiate_spi_clock() function raises the spi clock step by step (SPI_SETTINGS::FRAMED_FREQUENCIES)
+* while the modules receive and answer CLOCK_PROBE_FRAMES probe frames each without an error
+* Pre :  framed protocol is enabled, modules answered the boot handshake
+* Post : spi runs at the highest error free clock, false is returned if the framed protocol
+*        fails already at the default clock (it is disabled then)
+*****************************************************************************************************************/
+bool SonicBoardController::negotiate_spi_clock()
+{
+	if (!framed_protocol_enabled) {
+		return false;
+	}
+
+	if (async_transactions_enabled) {
+		transaction_queue.flush();
+	}
+
+	clock_negotiation_active = true;
+	set_spi_frequency_index(0);
+
+	// the first framed frame switches the modules to the framed replies, its own reply is not framed yet
+	memset(is_ack_expected, 0, sizeof(is_ack_expected));
+	probe_link_errors(1);
+
+	bool is_negotiated = probe_link_errors(SPI_SETTINGS::CLOCK_PROBE_FRAMES) == 0;
+	if (!is_negotiated) {
+		hal::log("ERROR: sonic boards do not answer the framed protocol, it is disabled\n");
+		framed_protocol_enabled = false;
+	}
+
+	for (uint8_t index = 1; is_negotiated && index < SPI_SETTINGS::FRAMED_FREQUENCY_COUNT; index++) {
+		set_spi_frequency_index(index);
+		if (probe_link_errors(SPI_SETTINGS::CLOCK_PROBE_FRAMES)) {
+			set_spi_frequency_index(index - 1);
+			break;
+		}
+	}
+
+	// the modules acknowledge the last probe they received intact, not the corrupted ones at the rate above
+	memset(is_ack_expected, 0, sizeof(is_ack_expected));
+	window_frames = 0;
+	window_errors = 0;
+	clock_negotiation_active = false;
+
+	hal::log("spi clock: %lu Hz\n", static_cast<unsigned long>(get_spi_frequency()));
+	return is_negotiated;
+}
+
+/****************************************************************************************************************
+* Descrition: probe_link_errors() function sends DUMMY frames with a test pattern to every module
+* that answered the boot handshake
+* Pre :  framed protocol is enabled
+* Post : number of rx and tx errors detected with the probe frames is returned
+*****************************************************************************************************************/
+uint32_t SonicBoardController::probe_link_errors(uint32_t frame_count)
+{
+	// alternating bit patterns in the payload
+	const float pattern[SONIC_BOARD_CONST::MOTORS_PER_MODULE] = { -1234.5f, 2.71828f };
+	uint32_t errors = 0;
+
+	for (uint8_t module_id = 0; module_id < BOARD_COUNT; module_id++) {
+		if (!(boot_statistics.ready_modules & (1UL << module_id))) {
+			continue;
+		}
+
+		const BoardLinkStatistics before = link_statistics[module_id];
+		for (uint32_t i = 0; i < frame_count; i++) {
+			transmit_receive_frame(module_id, SONIC_BOARD_CONST::DUMMY, pattern, nullptr, BOARDS[module_id].motor_count);
+		}
+
+		const BoardLinkStatistics& after = link_statistics[module_id];
+		errors += (after.rx_errors - before.rx_errors) + (after.tx_errors - before.tx_errors);
+	}
+
+	return errors;
+}
+
+/****************************************************************************************************************
+* Descrition: set_spi_frequency_index() function switches the spi clock to an entry of FRAMED_FREQUENCIES
+* Pre :  index is lower than FRAMED_FREQUENCY_COUNT
+* Post : bus runs at the selected clock
+*****************************************************************************************************************/
+void SonicBoardController::set_spi_frequency_index(uint8_t index)
+{
+	spi_frequency_index = index;
+	hal::spi_set_frequency(SPI_SETTINGS::FRAMED_FREQUENCIES[index]);
+}
+
+uint32_t SonicBoardController::get_spi_frequency() const
+{
+	return SPI_SETTINGS::FRAMED_FREQUENCIES[spi_frequency_index];
+}
+
+/****************************************************************************************************************
+* Descrition: get_update_bus_time_us() function estimates how long the spi bus is busy with one set_motors_rpm()
+* that writes every motor, with the selected protocol at the current clock (chip select delays and bytes)
+* Pre :  none
+* Post : none, with the spi queue update_motors() returns earlier but the bus is busy as long
+*****************************************************************************************************************/
+uint32_t SonicBoardController::get_update_bus_time_us() const
+{
+	const uint32_t BITS_PER_BYTE = 8;
+	uint32_t bus_time_us = 0;
+
+	for (const SONIC_BOARD_TOPOLOGY::BoardDescriptor& board : BOARDS) {
+		const uint32_t payload_size = board.motor_count * sizeof(float);
+
+		if (batched_frame_enabled) {
+			const uint32_t frame_size = framed_protocol_enabled ?
+				SONIC_BOARD_CONST::FRAMED_HEADER_SIZE + payload_size + SONIC_BOARD_CONST::FRAME_CRC_SIZE :
+				SONIC_BOARD_CONST::FRAME_HEADER_SIZE + payload_size;
+			const uint32_t frequency = get_spi_frequency();
+
+			bus_time_us += SPI_SETTINGS::CS_SETUP_DELAY_US + SPI_SETTINGS::CS_RELEASE_DELAY_US +
+				(frame_size * BITS_PER_BYTE * 1000000 + frequency - 1) / frequency;
+		}
+		else {
+			// command and motor id, then the float, each in its own chip select transaction (see transmit_receive_float())
+			const uint32_t transaction_size = 2 + sizeof(float);
+
+			bus_time_us += board.motor_count * (SPI_SETTINGS::CS_SETUP_DELAY_US + 2 * SPI_SETTINGS::CS_RELEASE_DELAY_US +
+				(transaction_size * BITS_PER_BYTE * 1000000 + SPI_SETTINGS::SPI_FREQUENCY - 1) / SPI_SETTINGS::SPI_FREQUENCY);
+		}
+	}
+	return bus_time_us;
+}
+
+/****************************************************************************************************************
+* Descrition: get_link_statistics() function returns the framed protocol error counters of a module
+* Pre :  module id indexes SONIC_BOARD_TOPOLOGY::BOARDS
+* Post : counters are returned, all zero for an invalid module
+*****************************************************************************************************************/
+BoardLinkStatistics SonicBoardController::get_link_statistics(uint8_t module_id) const
+{
+	return module_id < BOARD_COUNT ? link_statistics[module_id] : BoardLinkStatistics();
+}
+
+/****************************************************************************************************************
+* Descrition: on_frame_complete() function is the completion callback of the queued batched frames
+* Pre :  context is the controller that submitted the frame
+* Post : telemetry received with the frame is stored
+*****************************************************************************************************************/
+void SonicBoardController::on_frame_complete(const SpiTransaction& transaction, void* context)
+{
+	static_cast<SonicBoardController*>(context)->process_frame_reply(
+		transaction.module_id, transaction.tx_data, transaction.rx_data);
+}
+
+/****************************************************************************************************************
+* Descrition: set_motor_register() function writes a motor parameter (rpm, enable, brake, dac or pid gain)
+* through the shadow register cache
+* Pre :  motor is a motor index (RobotKinematics::WHEEL_* for the wheels)
+*        command is one of SET_MOTOR_RPM, SET_MOTOR_ENABLE, SET_MOTOR_BRAKE, SET_MOTOR_DAC, SET_MOTOR_KP/KI/KD
+* Post : value is transmited to the motor unless the motor already holds it
+*****************************************************************************************************************/
+void SonicBoardController::set_motor_register(uint8_t motor, uint8_t command, float value)
+{
+	if (motor >= MOTOR_COUNT) {
+		hal::log("ERROR: motor with index = %u not found\n", motor);
+		return;
+	}
+
+	if (command == SONIC_BOARD_CONST::SET_MOTOR_RPM) {
+		value = constrain_rpm(value);
+	}
+	write_motor_register(motor, command, value);
+}
+
+/****************************************************************************************************************
+* Descrition: set_write_coalescing() function configures the shadow register cache
+* Pre :  none
+* Post : when enabled, writes of values the motor already holds are skipped. rpm values within rpm_dead_band
+*        of the shadow value count as unchanged. Every register is rewritten at least every refresh_period_ms
+*        to recover from sonic board resets. The batched rpm frames are coalesced only while the telemetry
+*        is disabled, because skipping them would also skip the telemetry they carry
+*****************************************************************************************************************/
+void SonicBoardController::set_write_coalescing(bool enabled, float rpm_dead_band, uint32_t refresh_period_ms)
+{
+	write_coalescing_enabled = enabled;
+	coalescing_rpm_dead_band = rpm_dead_band;
+	coalescing_refresh_period_ms = refresh_period_ms;
+}
+
+/****************************************************************************************************************
+* Descrition: invalidate_shadow_registers() function forgets the values the motors are known to hold
+* Pre :  none
+* Post : next write of every register is transmited
+*****************************************************************************************************************/
+void SonicBoardController::invalidate_shadow_registers()
+{
+	memset(shadow_valid, 0, sizeof(shadow_valid));
+}
+
+/****************************************************************************************************************
+* Descrition: write_motor_register() function transmits a set command to a motor unless it can be coalesced
+* Pre :  motor is a motor index, command is a set command with a shadow register
+* Post : value is transmited and recorded in the shadow register, or the write is counted as skipped
+*****************************************************************************************************************/
+void SonicBoardController::write_motor_register(uint8_t motor, uint8_t command, float value)
+{
+	const uint32_t now_ms = hal::millis();
+
+	if (!is_write_required(motor, command, value, now_ms)) {
+		bus_skipped_writes.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+
+	transmit_receive_float(motor_module[motor], motor_channel[motor], command, value);
+	update_shadow_register(motor, command, value, now_ms);
+}
+
+/****************************************************************************************************************
+* Descrition: is_write_required() function compares a value with the shadow register of the motor
+* Pre :  motor is a motor index, command is a set command with a shadow register
+* Post : true is returned if coalescing is disabled, the shadow is unknown, the value changed
+*        (beyond the dead band for rpm) or the refresh period elapsed
+*****************************************************************************************************************/
+bool SonicBoardController::is_write_required(uint8_t motor, uint8_t command, float value, uint32_t now_ms) const
+{
+	const uint8_t index = shadow_register_index(command);
+
+	if (!write_coalescing_enabled || index >= SHADOW_REGISTER_COUNT || !(shadow_valid[motor] & (1 << index))) {
+		return true;
+	}
+
+	if (now_ms - shadow_write_time_ms[index][motor] >= coalescing_refresh_period_ms) {
+		return true;
+	}
+
+	const float dead_band = command == SONIC_BOARD_CONST::SET_MOTOR_RPM ? coalescing_rpm_dead_band : 0.0f;
+	return fabsf(value - shadow_value[index][motor]) > dead_band;
+}
+
+/****************************************************************************************************************
+* Descrition: update_shadow_register() function records a value transmited to a motor
+* Pre :  motor is a motor index, command is a set command
+* Post : shadow register holds the value and the time it was written
+*****************************************************************************************************************/
+void SonicBoardController::update_shadow_register(uint8_t motor, uint8_t command, float value, uint32_t now_ms)
+{
+	const uint8_t index = shadow_register_index(command);
+
+	if (index >= SHADOW_REGISTER_COUNT) {
+		return;
+	}
+
+	shadow_value[index][motor] = value;
+	shadow_write_time_ms[index][motor] = now_ms;
+	shadow_valid[motor] |= 1 << index;
+}
+
+/****************************************************************************************************************
+* Descrition: shadow_register_index() function maps a set command to its shadow register
+* Pre :  none
+* Post : index is returned, SHADOW_REGISTER_COUNT if the command has no shadow register
+*****************************************************************************************************************/
+uint8_t SonicBoardController::shadow_register_index(uint8_t command)
+{
+	// set commands from SET_MOTOR_RPM to SET_MOTOR_KD are odd and consecutive
+	if (command < SONIC_BOARD_CONST::SET_MOTOR_RPM || command > SONIC_BOARD_CONST::SET_MOTOR_KD || !(command & 0x01)) {
+		return SHADOW_REGISTER_COUNT;
 	}
+	return (command - SONIC_BOARD_CONST::SET_MOTOR_RPM) / 2;
 }
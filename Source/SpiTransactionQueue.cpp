@@ -0,0 +1,174 @@
+#include "SpiTransactionQueue.h"
+#include "Hal.h"
+#include <string.h>
+
+/****************************************************************************************************************
+* Descrition: SpiTransactionQueue() constructor creates an empty queue driving the specified backend
+* Pre:  none
+* Post: queue is empty and idle
+*****************************************************************************************************************/
+SpiTransactionQueue::SpiTransactionQueue(SpiBusBackend& bus_backend)
+	: backend(&bus_backend), head(0), tail(0), busy(false), completed_count(0), overrun_count(0)
+{
+}
+
+/****************************************************************************************************************
+* Descrition: submit() function copies a frame to the queue and wakes up the worker
+* Pre:  called from a single producer context
+*       length is in range from 1 to MAX_TRANSACTION_SIZE
+* Post: frame is queued and true is returned
+*       if the queue is full the frame is dropped, overrun is counted and false is returned
+*****************************************************************************************************************/
+bool SpiTransactionQueue::submit(uint8_t module_id, const uint8_t* tx_data, uint8_t length,
+	                             SpiTransactionCallback callback, void* context)
+{
+	const uint8_t current_head = head.load(std::memory_order_relaxed);
+	const uint8_t next_head = (current_head + 1) % SPI_QUEUE_CONST::QUEUE_DEPTH;
+
+	if (length > SPI_QUEUE_CONST::MAX_TRANSACTION_SIZE || next_head == tail.load(std::memory_order_acquire)) {
+		overrun_count.fetch_add(1, std::memory_order_relaxed);
+		return false;
+	}
+
+	SpiTransaction& transaction = transactions[current_head];
+	transaction.module_id = module_id;
+	transaction.length = length;
+	transaction.callback = callback;
+	transaction.context = context;
+	memcpy(transaction.tx_data, tx_data, length);
+
+	head.store(next_head, std::memory_order_release);
+
+	if (worker_handle) {
+		hal::task_notify(worker_handle);
+	}
+	return true;
+}
+
+/****************************************************************************************************************
+* Descrition: service() function transmits all queued frames in submission order
+* Pre:  called from a single consumer context (the worker task or the owner when no worker is running)
+* Post: queue is empty, callbacks of the transmitted frames are called
+*       number of transmitted frames is returned
+*****************************************************************************************************************/
+uint32_t SpiTransactionQueue::service()
+{
+	uint32_t transmitted = 0;
+	uint8_t current_tail = tail.load(std::memory_order_relaxed);
+
+	while (current_tail != head.load(std::memory_order_acquire)) {
+		SpiTransaction& transaction = transactions[current_tail];
+
+		busy.store(true, std::memory_order_relaxed);
+		backend->transfer_frame(transaction.module_id, transaction.tx_data, transaction.rx_data, transaction.length);
+
+		if (transaction.callback) {
+			transaction.callback(transaction, transaction.context);
+		}
+
+		current_tail = (current_tail + 1) % SPI_QUEUE_CONST::QUEUE_DEPTH;
+		tail.store(current_tail, std::memory_order_release);
+		busy.store(false, std::memory_order_release);
+		completed_count.fetch_add(1, std::memory_order_relaxed);
+		transmitted++;
+	}
+
+	return transmitted;
+}
+
+/****************************************************************************************************************
+* Descrition: start_worker() function creates the task that drives the bus in the background
+* Pre:  worker is not started yet
+* Post: submitted frames are transmitted by the worker task, true is returned on success
+*****************************************************************************************************************/
+bool SpiTransactionQueue::start_worker()
+{
+	if (worker_handle) {
+		return true;
+	}
+
+	worker_handle = hal::task_create("spi_queue", worker_task, this, SPI_QUEUE_CONST::WORKER_STACK_SIZE,
+		SPI_QUEUE_CONST::WORKER_PRIORITY, SPI_QUEUE_CONST::WORKER_CORE);
+
+	if (!worker_handle) {
+		hal::log("ERROR: failed to start spi queue worker\n");
+		return false;
+	}
+	return true;
+}
+
+/****************************************************************************************************************
+* Descrition: is_idle() function checks whether all submitted frames have been transmitted
+* Pre:  none
+* Post: true is returned if the queue is empty and the bus is not in use by the queue
+*****************************************************************************************************************/
+bool SpiTransactionQueue::is_idle() const
+{
+	return tail.load(std::memory_order_acquire) == head.load(std::memory_order_acquire) &&
+		!busy.load(std::memory_order_acquire);
+}
+
+/****************************************************************************************************************
+* Descrition: is_full() function checks whether the next submit() would be rejected for lack of space
+* Pre:  called from the producer context
+* Post: true is returned if no free slot is left, the consumer can only free slots in the meantime
+*****************************************************************************************************************/
+bool SpiTransactionQueue::is_full() const
+{
+	const uint8_t next_head = (head.load(std::memory_order_relaxed) + 1) % SPI_QUEUE_CONST::QUEUE_DEPTH;
+
+	return next_head == tail.load(std::memory_order_acquire);
+}
+
+/****************************************************************************************************************
+* Descrition: flush() function blocks until all submitted frames have been transmitted
+* Pre:  called from the producer context
+* Post: queue is idle, the bus can be used directly
+*       if the worker is not running the frames are transmitted from the calling context
+*****************************************************************************************************************/
+void SpiTransactionQueue::flush()
+{
+	if (!worker_handle) {
+		service();
+		return;
+	}
+
+	while (!is_idle()) {
+		hal::task_yield();
+	}
+}
+
+/****************************************************************************************************************
+* Descrition: set_backend() function replaces the bus backend (e.g. with a mock)
+* Pre:  queue is idle
+* Post: following frames are transmitted through the new backend
+*****************************************************************************************************************/
+void SpiTransactionQueue::set_backend(SpiBusBackend& bus_backend)
+{
+	backend = &bus_backend;
+}
+
+uint32_t SpiTransactionQueue::get_completed_count() const
+{
+	return completed_count.load(std::memory_order_relaxed);
+}
+
+uint32_t SpiTransactionQueue::get_overrun_count() const
+{
+	return overrun_count.load(std::memory_order_relaxed);
+}
+
+/****************************************************************************************************************
+* Descrition: worker_task() function waits for submitted frames and transmits them
+* Pre:  parameter is a pointer to the owning queue
+* Post: never returns
+*****************************************************************************************************************/
+void SpiTransactionQueue::worker_task(void* parameter)
+{
+	SpiTransactionQueue* queue = static_cast<SpiTransactionQueue*>(parameter);
+
+	for (;;) {
+		hal::task_wait_notification(hal::WAIT_FOREVER);
+		queue->service();
+	}
+}
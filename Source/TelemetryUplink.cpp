@@ -0,0 +1,251 @@
+#include "TelemetryUplink.h"
+#include <math.h>
+#include <string.h>
+
+// little endian writers and readers used by the codec
+static uint8_t* write_u16(uint8_t* buffer, uint16_t value)
+{
+	buffer[0] = value & 0xFF;
+	buffer[1] = value >> 8;
+	return buffer + 2;
+}
+
+static uint8_t* write_u32(uint8_t* buffer, uint32_t value)
+{
+	buffer[0] = value & 0xFF;
+	buffer[1] = (value >> 8) & 0xFF;
+	buffer[2] = (value >> 16) & 0xFF;
+	buffer[3] = value >> 24;
+	return buffer + 4;
+}
+
+static uint16_t read_u16(const uint8_t* buffer)
+{
+	return buffer[0] | (buffer[1] << 8);
+}
+
+static uint32_t read_u32(const uint8_t* buffer)
+{
+	return buffer[0] | (buffer[1] << 8) | (buffer[2] << 16) | (static_cast<uint32_t>(buffer[3]) << 24);
+}
+
+// scales and saturates a value to a signed fixed point field
+static int32_t to_fixed(float value, float scale, int32_t limit)
+{
+	const float scaled = roundf(value * scale);
+
+	if (scaled != scaled) {
+		return 0;
+	}
+	if (scaled <= -limit) {
+		return -limit;
+	}
+	return scaled < limit ? static_cast<int32_t>(scaled) : limit;
+}
+
+/****************************************************************************************************************
+* Descrition: encode() function packs telemetry samples into a datagram
+* Pre:  count is in range from 1 to MAX_SAMPLES_PER_DATAGRAM
+* Post: datagram size is returned, 0 if the buffer is too small
+*****************************************************************************************************************/
+uint32_t TelemetryCodec::encode(const TelemetrySample* samples, uint8_t count, uint32_t sequence,
+	                            uint32_t dropped_samples, uint8_t* buffer, uint32_t capacity)
+{
+	const uint32_t size = HEADER_SIZE + count * SAMPLE_SIZE;
+	uint8_t* position = buffer;
+
+	if (size > capacity) {
+		return 0;
+	}
+
+	position = write_u16(position, TELEMETRY_SETTINGS::MAGIC);
+	*position++ = TELEMETRY_SETTINGS::PROTOCOL_VERSION;
+	*position++ = count;
+	position = write_u32(position, sequence);
+	position = write_u32(position, dropped_samples);
+
+	for (uint8_t i = 0; i < count; i++) {
+		const TelemetrySample& sample = samples[i];
+
+		position = write_u32(position, sample.timestamp_us);
+		for (uint8_t wheel = 0; wheel < 4; wheel++) {
+			position = write_u16(position, to_fixed(sample.commanded_rpm[wheel], 10.0f, 32767));
+		}
+		for (uint8_t wheel = 0; wheel < 4; wheel++) {
+			position = write_u16(position, to_fixed(sample.measured_rpm[wheel], 10.0f, 32767));
+		}
+		for (uint8_t wheel = 0; wheel < 4; wheel++) {
+			position = write_u32(position, to_fixed(sample.encoder_counter[wheel], 1.0f, 2147483520));
+		}
+		for (uint8_t wheel = 0; wheel < 4; wheel++) {
+			position = write_u16(position, to_fixed(sample.temperature[wheel], 100.0f, 32767));
+		}
+		position = write_u16(position, sample.loop_time_us < 0xFFFF ? sample.loop_time_us : 0xFFFF);
+	}
+
+	return size;
+}
+
+/****************************************************************************************************************
+* Descrition: decode() function unpacks a telemetry datagram
+* Pre:  none
+* Post: number of decoded samples is returned, 0 if the datagram is malformed or of another version
+*       sequence and dropped_samples hold the datagram header fields
+*****************************************************************************************************************/
+uint8_t TelemetryCodec::decode(const uint8_t* buffer, uint32_t length, TelemetrySample* samples, uint8_t max_samples,
+	                           uint32_t& sequence, uint32_t& dropped_samples)
+{
+	if (length < HEADER_SIZE || read_u16(buffer) != TELEMETRY_SETTINGS::MAGIC ||
+		buffer[2] != TELEMETRY_SETTINGS::PROTOCOL_VERSION) {
+		return 0;
+	}
+
+	const uint8_t count = buffer[3];
+	if (length < HEADER_SIZE + static_cast<uint32_t>(count) * SAMPLE_SIZE || count > max_samples) {
+		return 0;
+	}
+
+	sequence = read_u32(buffer + 4);
+	dropped_samples = read_u32(buffer + 8);
+
+	const uint8_t* position = buffer + HEADER_SIZE;
+	for (uint8_t i = 0; i < count; i++) {
+		TelemetrySample& sample = samples[i];
+
+		sample.timestamp_us = read_u32(position);
+		position += 4;
+		for (uint8_t wheel = 0; wheel < 4; wheel++, position += 2) {
+			sample.commanded_rpm[wheel] = static_cast<int16_t>(read_u16(position)) / 10.0f;
+		}
+		for (uint8_t wheel = 0; wheel < 4; wheel++, position += 2) {
+			sample.measured_rpm[wheel] = static_cast<int16_t>(read_u16(position)) / 10.0f;
+		}
+		for (uint8_t wheel = 0; wheel < 4; wheel++, position += 4) {
+			sample.encoder_counter[wheel] = static_cast<float>(static_cast<int32_t>(read_u32(position)));
+		}
+		for (uint8_t wheel = 0; wheel < 4; wheel++, position += 2) {
+			sample.temperature[wheel] = static_cast<int16_t>(read_u16(position)) / 100.0f;
+		}
+		sample.loop_time_us = read_u16(position);
+		position += 2;
+	}
+
+	return count;
+}
+
+/****************************************************************************************************************
+* Descrition: start() function starts streaming the recorded samples to the server
+* Pre:  ip is the server address in dotted decimal notation, wifi is connected
+* Post: udp socket is open and the uplink task is running, true is returned on success
+*****************************************************************************************************************/
+bool TelemetryUplink::start(const char* ip, uint16_t port)
+{
+	if (task_handle) {
+		return true;
+	}
+
+	strncpy(server_ip, ip, sizeof(server_ip) - 1);
+	server_port = port;
+
+	udp_socket = hal::udp_open(TELEMETRY_SETTINGS::LOCAL_PORT);
+	if (udp_socket == hal::INVALID_UDP_HANDLE) {
+		hal::log("ERROR: failed to open telemetry socket\n");
+		return false;
+	}
+
+	task_handle = hal::task_create("telemetry", uplink_task, this, TELEMETRY_SETTINGS::TASK_STACK_SIZE,
+		TELEMETRY_SETTINGS::TASK_PRIORITY, TELEMETRY_SETTINGS::TASK_CORE);
+	if (!task_handle) {
+		hal::log("ERROR: failed to start telemetry uplink\n");
+		hal::udp_close(udp_socket);
+		udp_socket = hal::INVALID_UDP_HANDLE;
+		return false;
+	}
+	return true;
+}
+
+bool TelemetryUplink::is_running() const
+{
+	return task_handle != nullptr;
+}
+
+/****************************************************************************************************************
+* Descrition: record() function queues a sample for the uplink
+* Pre:  called from a single producer context (the control loop)
+* Post: true is returned if the sample was queued, false if the ring is full and the sample was dropped
+*****************************************************************************************************************/
+bool TelemetryUplink::record(const TelemetrySample& sample)
+{
+	if (!ring.push(sample)) {
+		statistics.dropped_samples++;
+		return false;
+	}
+
+	statistics.recorded_samples++;
+	return true;
+}
+
+TelemetryStatistics TelemetryUplink::get_statistics() const
+{
+	return statistics;
+}
+
+/****************************************************************************************************************
+* Descrition: run_task() function sends the queued samples every batch period within the datagram rate limit
+* Pre:  called from the uplink task only
+* Post: never returns
+*****************************************************************************************************************/
+void TelemetryUplink::run_task()
+{
+	const uint32_t tokens_per_period =
+		(TELEMETRY_SETTINGS::MAX_DATAGRAMS_PER_SECOND * TELEMETRY_SETTINGS::BATCH_PERIOD_MS + 999) / 1000;
+	uint32_t tokens = tokens_per_period;
+
+	for (;;) {
+		hal::delay_ms(TELEMETRY_SETTINGS::BATCH_PERIOD_MS);
+
+		tokens += tokens_per_period;
+		if (tokens > TELEMETRY_SETTINGS::MAX_DATAGRAMS_PER_SECOND) {
+			tokens = TELEMETRY_SETTINGS::MAX_DATAGRAMS_PER_SECOND;
+		}
+
+		while (tokens && ring.size() && send_batch()) {
+			tokens--;
+		}
+	}
+}
+
+/****************************************************************************************************************
+* Descrition: send_batch() function sends up to MAX_SAMPLES_PER_DATAGRAM queued samples in one datagram
+* Pre:  called from the uplink task only
+* Post: true is returned if a datagram was sent
+*****************************************************************************************************************/
+bool TelemetryUplink::send_batch()
+{
+	TelemetrySample samples[TELEMETRY_SETTINGS::MAX_SAMPLES_PER_DATAGRAM];
+	uint8_t datagram[TelemetryCodec::MAX_DATAGRAM_SIZE];
+	uint8_t count = 0;
+
+	while (count < TELEMETRY_SETTINGS::MAX_SAMPLES_PER_DATAGRAM && ring.pop(samples[count])) {
+		count++;
+	}
+	if (!count) {
+		return false;
+	}
+
+	const uint32_t size = TelemetryCodec::encode(samples, count, datagram_sequence++, statistics.dropped_samples,
+		datagram, sizeof(datagram));
+
+	if (!hal::udp_send(udp_socket, server_ip, server_port, datagram, size)) {
+		statistics.failed_datagrams++;
+		return false;
+	}
+
+	statistics.sent_datagrams++;
+	return true;
+}
+
+void TelemetryUplink::uplink_task(void* parameter)
+{
+	static_cast<TelemetryUplink*>(parameter)->run_task();
+}
@@ -0,0 +1,271 @@
+#include "TrafficRecorder.h"
+#include <string.h>
+
+using namespace TRAFFIC_RECORDER_SETTINGS;
+
+// the free running positions stay consistent across their wrap around
+static_assert((RING_SIZE & (RING_SIZE - 1)) == 0, "RING_SIZE must be a power of two");
+
+// little endian writers and readers of the record fields
+static void write_u16(uint8_t* buffer, uint16_t value)
+{
+	buffer[0] = value & 0xFF;
+	buffer[1] = value >> 8;
+}
+
+static void write_u32(uint8_t* buffer, uint32_t value)
+{
+	buffer[0] = value & 0xFF;
+	buffer[1] = (value >> 8) & 0xFF;
+	buffer[2] = (value >> 16) & 0xFF;
+	buffer[3] = value >> 24;
+}
+
+static uint16_t read_u16(const uint8_t* buffer)
+{
+	return buffer[0] | (buffer[1] << 8);
+}
+
+static uint32_t read_u32(const uint8_t* buffer)
+{
+	return buffer[0] | (buffer[1] << 8) | (buffer[2] << 16) | (static_cast<uint32_t>(buffer[3]) << 24);
+}
+
+/****************************************************************************************************************
+* Descrition: start() function starts recording into an empty ring
+* Pre: none
+* Post: record_*() calls are stored, true is returned on success
+*****************************************************************************************************************/
+bool TrafficRecorder::start()
+{
+	if (!mutex) {
+		mutex = hal::mutex_create();
+		if (!mutex) {
+			hal::log("ERROR: failed to start traffic recorder\n");
+			return false;
+		}
+	}
+
+	clear();
+	is_recording.store(true, std::memory_order_release);
+	return true;
+}
+
+/****************************************************************************************************************
+* Descrition: stop() function stops recording, the ring keeps its records until it is cleared or started again
+* Pre: none
+* Post: record_*() calls are ignored
+*****************************************************************************************************************/
+void TrafficRecorder::stop()
+{
+	is_recording.store(false, std::memory_order_release);
+}
+
+bool TrafficRecorder::is_running() const
+{
+	return is_recording.load(std::memory_order_acquire);
+}
+
+/****************************************************************************************************************
+* Descrition: clear() function drops all the records and resets the statistics
+* Pre: start() was called once
+* Post: ring is empty
+*****************************************************************************************************************/
+void TrafficRecorder::clear()
+{
+	hal::mutex_lock(mutex);
+	head = 0;
+	tail = 0;
+	statistics = TrafficRecorderStatistics();
+	hal::mutex_unlock(mutex);
+}
+
+/****************************************************************************************************************
+* Descrition: record_udp_datagram() function records a datagram received from the server
+* Pre: timestamp_us is the time the datagram was received, datagrams received in the same drain share it
+* Post: datagram is stored if the recorder is running
+*****************************************************************************************************************/
+void TrafficRecorder::record_udp_datagram(uint32_t timestamp_us, const uint8_t* data, uint32_t length)
+{
+	if (!begin_record(RECORD_UDP_DATAGRAM, timestamp_us, length)) {
+		return;
+	}
+	write_ring(data, length);
+	end_record();
+}
+
+/****************************************************************************************************************
+* Descrition: record_spi_float() function records a register transaction (see SonicBoardController::transmit_receive_float())
+* Pre: none
+* Post: transaction is stored if the recorder is running
+*****************************************************************************************************************/
+void TrafficRecorder::record_spi_float(uint8_t module_id, uint8_t motor_id, uint8_t command, float tx_value, float rx_value)
+{
+	uint8_t payload[SPI_FLOAT_PAYLOAD_SIZE];
+
+	payload[0] = module_id;
+	payload[1] = motor_id;
+	payload[2] = command;
+	memcpy(payload + 3, &tx_value, sizeof(float));
+	memcpy(payload + 7, &rx_value, sizeof(float));
+
+	if (!begin_record(RECORD_SPI_FLOAT, hal::micros(), SPI_FLOAT_PAYLOAD_SIZE)) {
+		return;
+	}
+	write_ring(payload, SPI_FLOAT_PAYLOAD_SIZE);
+	end_record();
+}
+
+/****************************************************************************************************************
+* Descrition: record_spi_frame() function records a frame transaction (see SonicBoardController::transfer_frame())
+* Pre: tx_data and rx_data hold length bytes
+* Post: transaction is stored if the recorder is running
+*****************************************************************************************************************/
+void TrafficRecorder::record_spi_frame(uint8_t module_id, const uint8_t* tx_data, const uint8_t* rx_data, uint8_t length)
+{
+	if (!begin_record(RECORD_SPI_FRAME, hal::micros(), 1 + 2 * length)) {
+		return;
+	}
+	write_ring(&module_id, 1);
+	write_ring(tx_data, length);
+	write_ring(rx_data, length);
+	end_record();
+}
+
+/****************************************************************************************************************
+* Descrition: flush() function writes the file header and all the records in the ring to a file
+* Pre: start() was called once
+* Post: true is returned if the file was written, the ring keeps its records
+*       records made while the file is written are rejected instead of waiting for the flash
+*****************************************************************************************************************/
+bool TrafficRecorder::flush(const char* path)
+{
+	uint8_t file_header[FILE_HEADER_SIZE] = {};
+
+	write_u32(file_header, FILE_MAGIC);
+	file_header[4] = FILE_VERSION;
+
+	hal::mutex_lock(mutex);
+	is_flushing.store(true, std::memory_order_relaxed);
+	const uint32_t first = tail;
+	const uint32_t size = head - tail;
+	hal::mutex_unlock(mutex);
+
+	// the records are stored in at most two spans of the ring
+	const uint32_t offset = first % RING_SIZE;
+	const uint32_t first_span = size < RING_SIZE - offset ? size : RING_SIZE - offset;
+
+	bool is_written = hal::file_write(path, file_header, FILE_HEADER_SIZE, false);
+	if (is_written && first_span) {
+		is_written = hal::file_write(path, ring + offset, first_span, true);
+	}
+	if (is_written && size > first_span) {
+		is_written = hal::file_write(path, ring, size - first_span, true);
+	}
+
+	hal::mutex_lock(mutex);
+	is_flushing.store(false, std::memory_order_relaxed);
+	if (is_written) {
+		statistics.flushed_bytes += FILE_HEADER_SIZE + size;
+	}
+	hal::mutex_unlock(mutex);
+
+	if (!is_written) {
+		hal::log("ERROR: failed to write traffic recording %s\n", path);
+	}
+	return is_written;
+}
+
+/****************************************************************************************************************
+* Descrition: get_statistics() function returns the record counters
+* Pre: start() was called once
+* Post: none
+*****************************************************************************************************************/
+TrafficRecorderStatistics TrafficRecorder::get_statistics() const
+{
+	hal::mutex_lock(mutex);
+	const TrafficRecorderStatistics copy = statistics;
+	hal::mutex_unlock(mutex);
+	return copy;
+}
+
+/****************************************************************************************************************
+* Descrition: parse_record() function parses the record at the beginning of data
+* Pre: data holds size bytes of records (without the file header)
+* Post: number of bytes the record takes is returned, 0 if data does not hold a complete record
+*****************************************************************************************************************/
+uint32_t TrafficRecorder::parse_record(const uint8_t* data, uint32_t size, TrafficRecord& record)
+{
+	if (size < RECORD_HEADER_SIZE) {
+		return 0;
+	}
+
+	record.type = data[0];
+	record.timestamp_us = read_u32(data + 1);
+	record.length = read_u16(data + 5);
+	record.payload = data + RECORD_HEADER_SIZE;
+
+	if (size - RECORD_HEADER_SIZE < record.length) {
+		return 0;
+	}
+	return RECORD_HEADER_SIZE + record.length;
+}
+
+/****************************************************************************************************************
+* Descrition: begin_record() function reserves space for a record and writes its header
+* Pre: none
+* Post: true is returned with the mutex held if the payload has to be written, end_record() must follow
+*       oldest records are dropped until the record fits
+*****************************************************************************************************************/
+bool TrafficRecorder::begin_record(uint8_t type, uint32_t timestamp_us, uint32_t length)
+{
+	const uint32_t record_size = RECORD_HEADER_SIZE + length;
+
+	if (!is_recording.load(std::memory_order_acquire)) {
+		return false;
+	}
+
+	hal::mutex_lock(mutex);
+	if (is_flushing.load(std::memory_order_relaxed) || length > 0xFFFF || record_size > RING_SIZE) {
+		statistics.rejected_records++;
+		hal::mutex_unlock(mutex);
+		return false;
+	}
+
+	while (RING_SIZE - (head - tail) < record_size) {
+		uint8_t length_bytes[2];
+		read_ring(tail + 5, length_bytes, 2);
+		tail += RECORD_HEADER_SIZE + read_u16(length_bytes);
+		statistics.overwritten_records++;
+	}
+
+	uint8_t header[RECORD_HEADER_SIZE];
+	header[0] = type;
+	write_u32(header + 1, timestamp_us);
+	write_u16(header + 5, static_cast<uint16_t>(length));
+	write_ring(header, RECORD_HEADER_SIZE);
+	return true;
+}
+
+void TrafficRecorder::end_record()
+{
+	statistics.recorded_records++;
+	hal::mutex_unlock(mutex);
+}
+
+// copies data to the head of the ring, the space must be reserved
+void TrafficRecorder::write_ring(const uint8_t* data, uint32_t length)
+{
+	for (uint32_t i = 0; i < length; i++) {
+		ring[(head + i) % RING_SIZE] = data[i];
+	}
+	head += length;
+}
+
+// copies data from a position of the ring
+void TrafficRecorder::read_ring(uint32_t position, uint8_t* data, uint32_t length) const
+{
+	for (uint32_t i = 0; i < length; i++) {
+		data[i] = ring[(position + i) % RING_SIZE];
+	}
+}
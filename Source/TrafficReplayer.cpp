@@ -0,0 +1,247 @@
+#ifndef ARDUINO
+#include "TrafficReplayer.h"
+#include "HalSimulation.h"
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+
+using namespace TRAFFIC_RECORDER_SETTINGS;
+
+// parses the next bus transaction at offset and moves offset past it, the datagrams are skipped
+static bool next_transaction(const std::vector<uint8_t>& records, uint32_t& offset, TrafficRecord& record)
+{
+	uint32_t record_size = 0;
+
+	while ((record_size = TrafficRecorder::parse_record(records.data() + offset, records.size() - offset, record)) != 0) {
+		offset += record_size;
+		if (record.type != RECORD_UDP_DATAGRAM) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/****************************************************************************************************************
+* Descrition: load() function loads a recording flushed by TrafficRecorder
+* Pre: none
+* Post: true is returned if the file holds a recording of the supported version
+*****************************************************************************************************************/
+bool TrafficReplayer::load(const char* path)
+{
+	datagrams.clear();
+	next_datagram = 0;
+	arrived_datagrams = 0;
+	last_timestamp_us = 0;
+
+	if (!read_recording(path, records)) {
+		return false;
+	}
+
+	TrafficRecord record;
+	uint32_t offset = 0;
+	uint32_t record_size = 0;
+
+	while ((record_size = TrafficRecorder::parse_record(records.data() + offset, records.size() - offset, record)) != 0) {
+		if (record.type == RECORD_UDP_DATAGRAM) {
+			datagrams.push_back(record);
+		}
+		last_timestamp_us = record.timestamp_us;
+		offset += record_size;
+	}
+
+	if (offset != records.size()) {
+		hal::log("WARNING: %s ends with a truncated record\n", path);
+	}
+	return true;
+}
+
+uint32_t TrafficReplayer::get_datagram_count() const
+{
+	return datagrams.size();
+}
+
+/****************************************************************************************************************
+* Descrition: run() function replays the loaded datagrams through update_robot()
+* between two drains update_robot() runs every IDLE_CYCLE_PERIOD_US, so the command watchdog sees the same gaps
+* Pre: robot was initialized with init_replay() and this replayer, simulated sonic boards are attached
+*      the robot traffic recorder (if any) is started
+* Post: all the datagrams were received by the robot and the replay ran until the time of the last record,
+*       the hal clock is left in the mode of the replay
+*       if the robot stops receiving the datagrams (not replaying from this replayer) the rest is undelivered
+*****************************************************************************************************************/
+ReplayStatistics TrafficReplayer::run(Robot& robot, ReplayMode mode)
+{
+	ReplayStatistics statistics = {};
+
+	next_datagram = 0;
+	arrived_datagrams = 0;
+
+	if (datagrams.empty()) {
+		return statistics;
+	}
+
+	hal_sim::set_virtual_clock(mode == REPLAY_FAST);
+
+	const std::chrono::steady_clock::time_point host_start = std::chrono::steady_clock::now();
+	const uint32_t first_timestamp_us = datagrams.front().timestamp_us;
+	const uint32_t replay_start_us = hal::micros();
+
+	while (arrived_datagrams < datagrams.size()) {
+		const uint32_t drain_timestamp_us = datagrams[arrived_datagrams].timestamp_us;
+		const uint32_t drain_offset_us = drain_timestamp_us - first_timestamp_us;
+
+		// idle cycles until the datagrams of the next drain arrive
+		statistics.cycles += run_idle_cycles(robot, replay_start_us, drain_offset_us);
+
+		while (arrived_datagrams < datagrams.size() && datagrams[arrived_datagrams].timestamp_us == drain_timestamp_us) {
+			arrived_datagrams++;
+		}
+		robot.notify_datagram_arrival();
+
+		robot.update_robot();
+		statistics.cycles++;
+		statistics.drains++;
+	}
+
+	// datagrams beyond the drain limit of the robot are left for the following cycles, as in the socket
+	while (next_datagram < datagrams.size()) {
+		const size_t received_datagrams = next_datagram;
+
+		robot.update_robot();
+		statistics.cycles++;
+		if (next_datagram == received_datagrams) {
+			hal::log("ERROR: robot does not receive the replayed datagrams, it was not initialized with init_replay() and this replayer\n");
+			break;
+		}
+	}
+	// the traffic recorded after the last datagram, e.g. a watchdog halt
+	statistics.cycles += run_idle_cycles(robot, replay_start_us, last_timestamp_us - first_timestamp_us);
+
+	statistics.datagrams = datagrams.size();
+	statistics.undelivered_datagrams = datagrams.size() - next_datagram;
+	statistics.recorded_duration_us = datagrams.back().timestamp_us - first_timestamp_us;
+	statistics.elapsed_us = std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::steady_clock::now() - host_start).count();
+	statistics.datagrams_per_second = statistics.elapsed_us
+		? statistics.datagrams * 1000000.0f / statistics.elapsed_us
+		: 0.0f;
+	return statistics;
+}
+
+/****************************************************************************************************************
+* Descrition: run_idle_cycles() function runs update_robot() every IDLE_CYCLE_PERIOD_US until a time of the replay
+* Pre: called from run()
+* Post: number of update_robot() calls is returned
+*****************************************************************************************************************/
+uint32_t TrafficReplayer::run_idle_cycles(Robot& robot, uint32_t replay_start_us, uint32_t end_offset_us)
+{
+	uint32_t cycles = 0;
+
+	for (;;) {
+		const uint32_t replay_time_us = hal::micros() - replay_start_us;
+		if (static_cast<int32_t>(end_offset_us - replay_time_us) <= 0) {
+			return cycles;
+		}
+		robot.update_robot();
+		cycles++;
+		hal::delay_us(std::min(REPLAY_SETTINGS::IDLE_CYCLE_PERIOD_US, end_offset_us - replay_time_us));
+	}
+}
+
+/****************************************************************************************************************
+* Descrition: receive_datagram() function passes the next arrived datagram to the robot
+* Pre: called by the robot during run()
+* Post: length of the datagram is returned, 0 if no datagram arrived yet
+*       datagrams longer than the buffer are truncated as the socket would do
+*****************************************************************************************************************/
+uint32_t TrafficReplayer::receive_datagram(uint8_t* buffer, uint32_t capacity)
+{
+	if (next_datagram >= arrived_datagrams) {
+		return 0;
+	}
+
+	const TrafficRecord& datagram = datagrams[next_datagram++];
+	const uint32_t length = std::min<uint32_t>(datagram.length, capacity);
+
+	memcpy(buffer, datagram.payload, length);
+	return length;
+}
+
+/****************************************************************************************************************
+* Descrition: compare() function compares the sonic board transactions of two recordings, ignoring the timestamps
+* Pre: none
+* Post: true is returned if both recordings hold the same transactions in the same order
+*       otherwise first_mismatch is the index of the first transaction that differs
+*****************************************************************************************************************/
+bool TrafficReplayer::compare(const char* path_a, const char* path_b, uint32_t& first_mismatch)
+{
+	std::vector<uint8_t> records_a;
+	std::vector<uint8_t> records_b;
+
+	first_mismatch = 0;
+	if (!read_recording(path_a, records_a) || !read_recording(path_b, records_b)) {
+		return false;
+	}
+
+	uint32_t offset_a = 0;
+	uint32_t offset_b = 0;
+	TrafficRecord record_a = {};
+	TrafficRecord record_b = {};
+
+	for (;;) {
+		const bool has_a = next_transaction(records_a, offset_a, record_a);
+		const bool has_b = next_transaction(records_b, offset_b, record_b);
+
+		if (!has_a || !has_b) {
+			if (has_a == has_b) {
+				return true;
+			}
+			hal::log("recordings differ in length after %lu transactions\n", static_cast<unsigned long>(first_mismatch));
+			return false;
+		}
+
+		if (record_a.type != record_b.type || record_a.length != record_b.length ||
+			memcmp(record_a.payload, record_b.payload, record_a.length) != 0) {
+			hal::log("recordings differ at transaction %lu\n", static_cast<unsigned long>(first_mismatch));
+			return false;
+		}
+		first_mismatch++;
+	}
+}
+
+/****************************************************************************************************************
+* Descrition: read_recording() function reads the records of a recording file
+* Pre: none
+* Post: true is returned if the file header is valid, records holds the rest of the file
+*****************************************************************************************************************/
+bool TrafficReplayer::read_recording(const char* path, std::vector<uint8_t>& file_records)
+{
+	FILE* file = fopen(path, "rb");
+	uint8_t header[FILE_HEADER_SIZE];
+
+	file_records.clear();
+	if (!file) {
+		hal::log("ERROR: failed to open recording %s\n", path);
+		return false;
+	}
+
+	const uint32_t magic_read = fread(header, 1, FILE_HEADER_SIZE, file) == FILE_HEADER_SIZE
+		? header[0] | (header[1] << 8) | (header[2] << 16) | (static_cast<uint32_t>(header[3]) << 24)
+		: 0;
+
+	if (magic_read != FILE_MAGIC || header[4] != FILE_VERSION) {
+		hal::log("ERROR: %s is not a recording of version %u\n", path, FILE_VERSION);
+		fclose(file);
+		return false;
+	}
+
+	uint8_t chunk[1024];
+	size_t chunk_size = 0;
+	while ((chunk_size = fread(chunk, 1, sizeof(chunk), file)) != 0) {
+		file_records.insert(file_records.end(), chunk, chunk + chunk_size);
+	}
+	fclose(file);
+	return true;
+}
+#endif
@@ -0,0 +1,159 @@
+#include "Robot.h"
+#include "CommandSchema.h"
+#include "HalSimulation.h"
+#include "TestCheck.h"
+#include <string.h>
+
+// the intake applies the newest datagram of a cycle that decodes, malformed ones do not hide it
+
+static const uint8_t MAX_QUEUED_DATAGRAMS = 8;
+
+// hands out the queued datagrams in order
+class QueuedDatagramSource : public DatagramSource
+{
+public:
+	uint8_t datagrams[MAX_QUEUED_DATAGRAMS][COMMAND_SCHEMA::MAX_ENCODED_SIZE];
+	uint32_t lengths[MAX_QUEUED_DATAGRAMS] = {};
+	uint8_t queued = 0;
+	uint8_t next = 0;
+
+	void push_command(float forward, uint32_t sequence)
+	{
+		Command command = Command_init_zero;
+		command.move.x = forward;
+		lengths[queued] = CommandEncoder::encode(command, sequence, datagrams[queued], sizeof(datagrams[queued]));
+		queued++;
+	}
+
+	// a Move submessage whose length runs past the end of the datagram
+	void push_malformed()
+	{
+		datagrams[queued][0] = (COMMAND_SCHEMA::COMMAND_MOVE << 3) | COMMAND_SCHEMA::WIRE_LENGTH_DELIMITED;
+		datagrams[queued][1] = 20;
+		datagrams[queued][2] = 0x0D;
+		lengths[queued] = 3;
+		queued++;
+	}
+
+	uint32_t receive_datagram(uint8_t* buffer, uint32_t capacity) override
+	{
+		if (next == queued) {
+			queued = 0;
+			next = 0;
+			return 0;
+		}
+		const uint32_t length = lengths[next] < capacity ? lengths[next] : capacity;
+		memcpy(buffer, datagrams[next++], length);
+		return length;
+	}
+};
+
+static SimulatedSonicBoard boards[SONIC_BOARD_TOPOLOGY::BOARD_COUNT];
+static QueuedDatagramSource source;
+static Robot robot;
+
+// returns the forward speed the front left wheel of the simulated boards was set to
+static float applied_forward_speed()
+{
+	const uint8_t module_id = 0;
+	return boards[module_id].motors[0].rpm / RobotKinematics::MIXING_MATRIX[SONIC_BOARD_TOPOLOGY::BOARDS[module_id].motors[0]][0];
+}
+
+int main()
+{
+	hal_sim::set_virtual_clock(true);
+	for (uint8_t module_id = 0; module_id < SONIC_BOARD_TOPOLOGY::BOARD_COUNT; module_id++) {
+		hal_sim::attach_sonic_board(SONIC_BOARD_TOPOLOGY::BOARDS[module_id].cs_pin, &boards[module_id]);
+	}
+	robot.init_replay(source);
+
+	// a malformed newest datagram falls back to the valid one before it
+	source.push_command(0.5f, 1);
+	source.push_malformed();
+	robot.update_robot();
+	IngestionStatistics statistics = robot.get_ingestion_statistics();
+	CHECK(statistics.received_packets == 2);
+	CHECK(statistics.decoded_packets == 1);
+	CHECK(statistics.invalid_packets == 1);
+	CHECK(statistics.superseded_packets == 0);
+	CHECK_NEAR(applied_forward_speed(), 0.5, 1e-4);
+
+	// only valid datagrams replaced by a newer valid one are superseded
+	source.push_command(0.25f, 2);
+	source.push_malformed();
+	source.push_command(0.75f, 3);
+	source.push_malformed();
+	robot.update_robot();
+	statistics = robot.get_ingestion_statistics();
+	CHECK(statistics.received_packets == 6);
+	CHECK(statistics.decoded_packets == 2);
+	CHECK(statistics.invalid_packets == 3);
+	CHECK(statistics.superseded_packets == 1);
+	CHECK_NEAR(applied_forward_speed(), 0.75, 1e-4);
+
+	// a cycle of malformed datagrams applies nothing
+	source.push_malformed();
+	robot.update_robot();
+	statistics = robot.get_ingestion_statistics();
+	CHECK(statistics.decoded_packets == 2);
+	CHECK(statistics.invalid_packets == 4);
+	CHECK_NEAR(applied_forward_speed(), 0.75, 1e-4);
+
+	// reordered datagrams: the highest sequence number of a drain is applied, not the last one received
+	source.push_command(0.1f, 10);
+	robot.update_robot();
+	CHECK_NEAR(applied_forward_speed(), 0.1, 1e-4);
+	statistics = robot.get_ingestion_statistics();
+
+	source.push_command(0.5f, 12);
+	source.push_command(0.2f, 9);
+	robot.update_robot();
+	IngestionStatistics reordered = robot.get_ingestion_statistics();
+	CHECK_NEAR(applied_forward_speed(), 0.5, 1e-4);
+	CHECK(reordered.decoded_packets == statistics.decoded_packets + 1);
+	CHECK(reordered.stale_packets == statistics.stale_packets + 1);
+	CHECK(reordered.reordered_packets == statistics.reordered_packets + 1);
+	CHECK(reordered.superseded_packets == statistics.superseded_packets);
+
+	// both newer than the applied command, the older one is superseded
+	statistics = reordered;
+	source.push_command(0.7f, 14);
+	source.push_command(0.3f, 13);
+	robot.update_robot();
+	reordered = robot.get_ingestion_statistics();
+	CHECK_NEAR(applied_forward_speed(), 0.7, 1e-4);
+	CHECK(reordered.decoded_packets == statistics.decoded_packets + 1);
+	CHECK(reordered.superseded_packets == statistics.superseded_packets + 1);
+	CHECK(reordered.stale_packets == statistics.stale_packets);
+
+	// the last applied sequence number did not move backwards
+	statistics = reordered;
+	source.push_command(0.3f, 13);
+	robot.update_robot();
+	reordered = robot.get_ingestion_statistics();
+	CHECK_NEAR(applied_forward_speed(), 0.7, 1e-4);
+	CHECK(reordered.stale_packets == statistics.stale_packets + 1);
+	CHECK(reordered.decoded_packets == statistics.decoded_packets);
+
+	// the field numbers come from the generated tags, the decoder reads a command as the generic parser does
+	CHECK(COMMAND_SCHEMA::IS_SCHEMA_VERIFIED);
+	Command command = Command_init_zero;
+	command.move.x = 0.5f;
+	command.move.y = -0.25f;
+	command.move.r = 1.5f;
+	command.action.kick = 3.0f;
+	command.action.chip = 2.0f;
+	command.action.dribble = 0.75f;
+	command.sequence = 300;
+	uint8_t packet[udp_settings::UDP_BUFFER_SIZE];
+	const uint32_t length = CommandEncoder::encode(command, command.sequence, packet, sizeof(packet));
+	Command decoded = Command_init_zero;
+	Command parsed = Command_init_zero;
+	ProtobufParser parser;
+	CHECK(CommandDecoder::decode(packet, length, decoded) == DECODE_OK);
+	CHECK(parser.parse_udp_packet(packet, parsed, length));
+	CHECK(memcmp(&decoded, &command, sizeof(Command)) == 0);
+	CHECK(memcmp(&parsed, &command, sizeof(Command)) == 0);
+
+	finish_test("CommandIntakeTest");
+}
@@ -0,0 +1,150 @@
+#include "Robot.h"
+#include "CommandSchema.h"
+#include "HalSimulation.h"
+#include "TestCheck.h"
+#include <chrono>
+#include <thread>
+
+// the robot runs its own watchdog task, as after init_robot() on the device
+// 1. worst-case halt latency on the simulated clock, after commands stop the watchdog task must halt within its period
+// 2. while the pipeline runs, the control task does not write the profiled velocity over the watchdog halt
+
+static const uint16_t SERVER_PORT = 10014;
+static const uint32_t DEADLINE_MS = 50;
+static const uint32_t HALT_ROUNDS = 20;
+// the deadline is checked in whole milliseconds, and the halt itself writes the motors
+static const uint32_t HALT_BOUND_US = (WATCHDOG_SETTINGS::CHECK_PERIOD_MS + 2) * 1000;
+
+static const uint32_t PIPELINE_DEADLINE_MS = 50;
+static const uint32_t PIPELINE_ROUNDS = 5;
+static const uint32_t COMMAND_PERIOD_MS = 5;
+static const uint32_t DRIVE_TIME_MS = 50;
+static const uint32_t HALTED_TIME_MS = 20;      // many control periods
+static const uint32_t HALT_TIMEOUT_MS = 500;
+
+// the watchdog task advances the virtual clock, so the test waits in real time
+static const uint32_t POLL_PERIOD_US = 100;
+static const uint32_t POLL_TIMEOUT_US = 1000000;
+
+static SimulatedSonicBoard boards[SONIC_BOARD_TOPOLOGY::BOARD_COUNT];
+static hal_sim::LoopbackUdpServer server;
+static Robot robot;
+static uint32_t sequence = 0;
+
+static bool is_halted()
+{
+	for (uint8_t module_id = 0; module_id < SONIC_BOARD_TOPOLOGY::BOARD_COUNT; module_id++) {
+		for (uint8_t motor_id = 0; motor_id < SONIC_BOARD_TOPOLOGY::BOARDS[module_id].motor_count; motor_id++) {
+			if (boards[module_id].motors[motor_id].rpm != 0.0f) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+static void send_command()
+{
+	Command command = Command_init_zero;
+	command.move.x = 0.5f;
+	command.move.r = 1.0f;
+
+	uint8_t datagram[COMMAND_SCHEMA::MAX_ENCODED_SIZE];
+	const uint32_t length = CommandEncoder::encode(command, ++sequence, datagram, sizeof(datagram));
+	CHECK(server.send_to_robot(datagram, length));
+}
+
+// sends one command and returns once the watchdog task halted the robot after it
+static void run_halt_round()
+{
+	const uint32_t expirations = robot.get_watchdog_statistics().expirations;
+	const uint32_t decoded_packets = robot.get_ingestion_statistics().decoded_packets;
+	send_command();
+
+	uint32_t waited_us = 0;
+	while (robot.get_ingestion_statistics().decoded_packets == decoded_packets && waited_us < POLL_TIMEOUT_US) {
+		robot.update_robot();
+		std::this_thread::sleep_for(std::chrono::microseconds(POLL_PERIOD_US));
+		waited_us += POLL_PERIOD_US;
+	}
+	CHECK(robot.get_ingestion_statistics().decoded_packets == decoded_packets + 1);
+
+	while (!(robot.get_watchdog_statistics().expirations > expirations && is_halted()) && waited_us < POLL_TIMEOUT_US) {
+		std::this_thread::sleep_for(std::chrono::microseconds(POLL_PERIOD_US));
+		waited_us += POLL_PERIOD_US;
+	}
+	CHECK(robot.get_watchdog_statistics().expirations == expirations + 1);
+	CHECK(is_halted());
+}
+
+static void test_worst_case_halt_latency()
+{
+	for (uint32_t round = 0; round < HALT_ROUNDS; round++) {
+		run_halt_round();
+	}
+
+	const WatchdogStatistics statistics = robot.get_watchdog_statistics();
+	printf("worst-case halt latency: %lu us after the deadline (bound %lu us), last %lu us\n",
+		static_cast<unsigned long>(statistics.max_halt_latency_us), static_cast<unsigned long>(HALT_BOUND_US),
+		static_cast<unsigned long>(statistics.last_halt_latency_us));
+	CHECK(statistics.expirations == HALT_ROUNDS);
+	CHECK(statistics.late_commands == HALT_ROUNDS - 1);
+	CHECK(statistics.max_late_ms > 0);
+	CHECK(statistics.max_halt_latency_us <= HALT_BOUND_US);
+}
+
+static void test_halt_is_not_overwritten()
+{
+	robot.set_command_deadline_ms(PIPELINE_DEADLINE_MS);
+	CHECK(robot.start_pipeline());
+
+	uint32_t kept_halts = 0;
+	for (uint32_t round = 0; round < PIPELINE_ROUNDS; round++) {
+		const uint32_t expirations = robot.get_watchdog_statistics().expirations;
+
+		const uint32_t start_ms = hal::millis();
+		while (hal::millis() - start_ms < DRIVE_TIME_MS) {
+			send_command();
+			hal::delay_ms(COMMAND_PERIOD_MS);
+		}
+		CHECK(!is_halted());
+
+		// commands stop, the watchdog halts while the control task keeps running
+		const uint32_t stop_ms = hal::millis();
+		while (!(robot.get_watchdog_statistics().expirations > expirations && is_halted()) &&
+			hal::millis() - stop_ms < HALT_TIMEOUT_MS) {
+			hal::delay_ms(1);
+		}
+		CHECK(robot.get_watchdog_statistics().expirations == expirations + 1);
+
+		bool is_kept = true;
+		const uint32_t halt_ms = hal::millis();
+		while (hal::millis() - halt_ms < HALTED_TIME_MS) {
+			is_kept = is_kept && is_halted();
+			hal::delay_ms(1);
+		}
+		CHECK(is_kept);
+		kept_halts += is_kept ? 1 : 0;
+	}
+	printf("halts kept while the control task runs: %lu of %lu\n",
+		static_cast<unsigned long>(kept_halts), static_cast<unsigned long>(PIPELINE_ROUNDS));
+}
+
+int main()
+{
+	for (uint8_t module_id = 0; module_id < SONIC_BOARD_TOPOLOGY::BOARD_COUNT; module_id++) {
+		hal_sim::attach_sonic_board(SONIC_BOARD_TOPOLOGY::BOARDS[module_id].cs_pin, &boards[module_id]);
+	}
+
+	hal_sim::set_virtual_clock(true);
+	robot.set_command_deadline_ms(DEADLINE_MS);
+	robot.init_robot("host", "host");
+	CHECK(server.open(SERVER_PORT, INGESTION_SETTINGS::COMMAND_PORT));
+
+	test_worst_case_halt_latency();
+
+	hal_sim::set_virtual_clock(false);
+	test_halt_is_not_overwritten();
+
+	finish_test("CommandWatchdogTest");
+}
@@ -0,0 +1,105 @@
+#include "Robot.h"
+#include "CommandSchema.h"
+#include "HalSimulation.h"
+#include "LoopProfiler.h"
+#include "TestCheck.h"
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+// arrival to spi latency of the polled main loop and of the event loop woken by the udp socket,
+// the arrival is stamped with notify_datagram_arrival() right before each datagram is sent over loopback udp
+
+static const uint16_t SERVER_PORT = 10012;
+static const uint16_t TELEMETRY_SERVER_PORT = 10013;
+static const uint32_t DATAGRAM_COUNT = 200;
+// the datagram period is not a multiple of the poll period, so the arrivals fall on every phase of the main loop,
+// and is longer than a main loop cycle with a motor write, so every datagram is written in its own cycle
+static const uint32_t SEND_PERIOD_US = 4300;
+static const uint32_t SEND_JITTER_US = 1000;
+// main loop of the polled mode: update_robot() and a 1 ms delay
+static const uint32_t POLL_PERIOD_US = 1000;
+static const uint32_t RECEIVE_TIMEOUT_MS = 1000;
+
+static SimulatedSonicBoard boards[SONIC_BOARD_TOPOLOGY::BOARD_COUNT];
+static Robot robot;
+static Robot unconnected_robot;
+static hal_sim::LoopbackUdpServer server;
+static std::atomic<bool> is_sending(false);
+
+// sends DATAGRAM_COUNT commands, each with a new velocity and sequence number
+static void send_commands(uint32_t first_sequence)
+{
+	for (uint32_t i = 0; i < DATAGRAM_COUNT; i++) {
+		uint8_t datagram[COMMAND_SCHEMA::MAX_ENCODED_SIZE];
+		Command command = Command_init_zero;
+		command.move.x = 0.1f + (i % 10) * 0.05f;
+		const uint32_t length = CommandEncoder::encode(command, first_sequence + i, datagram, sizeof(datagram));
+
+		robot.notify_datagram_arrival();
+		server.send_to_robot(datagram, length);
+		std::this_thread::sleep_for(std::chrono::microseconds(SEND_PERIOD_US + (i * 137) % SEND_JITTER_US));
+	}
+	is_sending.store(false);
+}
+
+static void report(const char* mode, const StageSummary& summary)
+{
+	printf("%-8s arrival to spi: %u writes, min %.1f us, p50 %.1f us, p99 %.1f us, max %.1f us\n", mode, summary.count,
+		summary.min_us, summary.p50_us, summary.p99_us, summary.max_us);
+}
+
+int main()
+{
+	for (uint8_t module_id = 0; module_id < SONIC_BOARD_TOPOLOGY::BOARD_COUNT; module_id++) {
+		hal_sim::attach_sonic_board(SONIC_BOARD_TOPOLOGY::BOARDS[module_id].cs_pin, &boards[module_id]);
+	}
+	robot.init_robot("host", "host");
+	CHECK(server.open(SERVER_PORT, INGESTION_SETTINGS::COMMAND_PORT));
+
+	// polled: the main loop receives whether or not a datagram is waiting
+	LoopProfiler::reset();
+	is_sending.store(true);
+	std::thread sender(send_commands, 1);
+	while (is_sending.load()) {
+		robot.update_robot();
+		hal::delay_us(POLL_PERIOD_US);
+	}
+	sender.join();
+	uint32_t start_ms = hal::millis();
+	while (robot.get_ingestion_statistics().received_packets < DATAGRAM_COUNT && hal::millis() - start_ms < RECEIVE_TIMEOUT_MS) {
+		robot.update_robot();
+		hal::delay_us(POLL_PERIOD_US);
+	}
+	const StageSummary polled = LoopProfiler::summarize(STAGE_ARRIVAL_TO_SPI);
+	report("polled", polled);
+	CHECK(robot.get_ingestion_statistics().received_packets == DATAGRAM_COUNT);
+	// a datagram delayed by the scheduler into the cycle of the previous one is drained with it
+	CHECK(polled.count >= DATAGRAM_COUNT - DATAGRAM_COUNT / 20);
+
+	// without the command socket the event loop would only poll, it refuses to start
+	CHECK(!unconnected_robot.start_event_loop());
+
+	// event: the event task sleeps on the socket and writes the motors as soon as a datagram is waiting,
+	// the telemetry uplink has its own socket
+	CHECK(robot.start_telemetry_uplink("127.0.0.1", TELEMETRY_SERVER_PORT));
+	LoopProfiler::reset();
+	CHECK(robot.start_event_loop());
+	is_sending.store(true);
+	send_commands(DATAGRAM_COUNT + 1);
+	start_ms = hal::millis();
+	while (robot.get_ingestion_statistics().received_packets < 2 * DATAGRAM_COUNT && hal::millis() - start_ms < RECEIVE_TIMEOUT_MS) {
+		hal::delay_ms(1);
+	}
+	const StageSummary event = LoopProfiler::summarize(STAGE_ARRIVAL_TO_SPI);
+	const EventLoopStatistics statistics = robot.get_event_loop_statistics();
+	report("event", event);
+	printf("event loop: %u wakeups, %u timeouts\n", statistics.wakeups, statistics.timeouts);
+	CHECK(robot.get_ingestion_statistics().received_packets == 2 * DATAGRAM_COUNT);
+	CHECK(event.count >= DATAGRAM_COUNT - DATAGRAM_COUNT / 20);
+	CHECK(statistics.wakeups >= DATAGRAM_COUNT - DATAGRAM_COUNT / 20);
+	CHECK(statistics.timeouts < statistics.wakeups);
+	CHECK(event.p50_us <= polled.p50_us);
+
+	finish_test("EventLoopTest");
+}
@@ -0,0 +1,88 @@
+#include "Kinematics.h"
+#include "TestCheck.h"
+#include <math.h>
+#include <chrono>
+
+// the mixing matrix must reproduce the per-wheel formulas it replaced, the cost of both is reported
+
+static const double LEGACY_PI = 3.1415926535897932384626433832795;
+static const uint32_t BENCHMARK_ITERATIONS = 2000000;
+
+// wheel rpm as calculated by update_motors() before the mixing matrix
+static void legacy_body_to_wheels(float forward_speed, float left_speed, float rotation_speed,
+	                              float (&wheel_rpm)[RobotKinematics::WHEEL_COUNT])
+{
+	wheel_rpm[RobotKinematics::WHEEL_FL] = (((forward_speed / cos((40 * LEGACY_PI) / 180))
+		- (left_speed / sin((40 * LEGACY_PI) / 180))
+		- ((rotation_speed*0.16375) / 2 * LEGACY_PI))
+		/ 0.05) * 60;
+	wheel_rpm[RobotKinematics::WHEEL_FR] = -(((forward_speed / cos((40 * LEGACY_PI) / 180))
+		+ (left_speed / sin((40 * LEGACY_PI) / 180))
+		+ ((rotation_speed*0.16375) / 2 * LEGACY_PI))
+		/ 0.05) * 60;
+	wheel_rpm[RobotKinematics::WHEEL_BL] = (((forward_speed / cos((40 * LEGACY_PI) / 180))
+		+ (left_speed / sin((40 * LEGACY_PI) / 180))
+		- ((rotation_speed*0.16375) / 2 * LEGACY_PI))
+		/ 0.05) * 60;
+	wheel_rpm[RobotKinematics::WHEEL_BR] = -(((forward_speed / cos((40 * LEGACY_PI) / 180))
+		- (left_speed / sin((40 * LEGACY_PI) / 180))
+		+ ((rotation_speed*0.16375) / 2 * LEGACY_PI))
+		/ 0.05) * 60;
+}
+
+// returns the ns per call of a body to wheels function, the inputs change every call
+template <typename Function>
+static double measure_ns_per_op(Function function)
+{
+	volatile float sink = 0.0f;
+	float wheel_rpm[RobotKinematics::WHEEL_COUNT];
+
+	const std::chrono::steady_clock::time_point start_time = std::chrono::steady_clock::now();
+	for (uint32_t i = 0; i < BENCHMARK_ITERATIONS; i++) {
+		const float phase = (i & 63) * 0.03f;
+		function(phase, 1.0f - phase, 0.5f * phase, wheel_rpm);
+		sink = sink + wheel_rpm[i & 3];
+	}
+	const double elapsed_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now() - start_time).count();
+	return elapsed_ns / BENCHMARK_ITERATIONS;
+}
+
+int main()
+{
+	// equivalence over a grid of body velocities, the matrix holds the same gains rounded to float
+	uint32_t compared = 0;
+	for (float forward = -3.0f; forward <= 3.0f; forward += 0.25f) {
+		for (float left = -3.0f; left <= 3.0f; left += 0.25f) {
+			for (float rotation = -10.0f; rotation <= 10.0f; rotation += 1.25f) {
+				float expected[RobotKinematics::WHEEL_COUNT];
+				float wheel_rpm[RobotKinematics::WHEEL_COUNT];
+
+				legacy_body_to_wheels(forward, left, rotation, expected);
+				RobotKinematics::body_to_wheels(forward, left, rotation, wheel_rpm);
+				for (uint8_t wheel = 0; wheel < RobotKinematics::WHEEL_COUNT; wheel++) {
+					CHECK_NEAR(wheel_rpm[wheel], expected[wheel], 1e-3 + 1e-5 * fabs(expected[wheel]));
+				}
+				compared++;
+			}
+		}
+	}
+	printf("compared %lu body velocities\n", static_cast<unsigned long>(compared));
+
+	// the odometry inverts the mixing
+	float wheel_rpm[RobotKinematics::WHEEL_COUNT];
+	float forward = 0.0f;
+	float left = 0.0f;
+	float rotation = 0.0f;
+	RobotKinematics::body_to_wheels(1.5f, -0.75f, 2.0f, wheel_rpm);
+	RobotKinematics::wheels_to_body(wheel_rpm, forward, left, rotation);
+	CHECK_NEAR(forward, 1.5, 1e-4);
+	CHECK_NEAR(left, -0.75, 1e-4);
+	CHECK_NEAR(rotation, 2.0, 1e-4);
+
+	const double legacy_ns = measure_ns_per_op(legacy_body_to_wheels);
+	const double matrix_ns = measure_ns_per_op(RobotKinematics::body_to_wheels);
+	printf("body to wheels: legacy formulas %.2f ns/op, mixing matrix %.2f ns/op\n", legacy_ns, matrix_ns);
+
+	finish_test("KinematicsTest");
+}
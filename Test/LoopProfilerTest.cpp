@@ -0,0 +1,50 @@
+#include "LoopProfiler.h"
+#include "TestCheck.h"
+#include <atomic>
+#include <thread>
+#include <vector>
+
+// the profiler is recorded from the spi worker, control, watchdog and network tasks at once,
+// no duration may be lost and the extremes must be the ones of all tasks
+
+static const uint32_t TASK_COUNT = 4;
+static const uint32_t RECORDS_PER_TASK = 1000000;
+
+int main()
+{
+	const float cycles_per_us = static_cast<float>(hal::cycle_counter_frequency_mhz());
+	std::vector<std::thread> tasks;
+	std::atomic<bool> is_started(false);
+
+	LoopProfiler::reset();
+	CHECK(LoopProfiler::summarize(STAGE_SPI_TRANSACTION).count == 0);
+
+	// every task records its own range of durations, task 0 holds the minimum and the last task the maximum
+	for (uint32_t task = 0; task < TASK_COUNT; task++) {
+		tasks.push_back(std::thread([task, &is_started] {
+			while (!is_started.load()) {
+			}
+			for (uint32_t record = 0; record < RECORDS_PER_TASK; record++) {
+				LoopProfiler::record(STAGE_SPI_TRANSACTION, 100 + task * 1000 + record % 1000);
+			}
+		}));
+	}
+	is_started.store(true);
+	for (std::thread& task : tasks) {
+		task.join();
+	}
+
+	const StageSummary summary = LoopProfiler::summarize(STAGE_SPI_TRANSACTION);
+	CHECK(summary.count == TASK_COUNT * RECORDS_PER_TASK);
+	CHECK_NEAR(summary.min_us, 100 / cycles_per_us, 1e-3);
+	CHECK_NEAR(summary.max_us, (100 + TASK_COUNT * 1000 - 1) / cycles_per_us, 1e-3);
+	CHECK(summary.p50_us >= summary.min_us && summary.p50_us <= summary.p99_us);
+	CHECK(summary.p99_us <= summary.max_us);
+	printf("%u durations recorded by %u tasks, min %.3f us, max %.3f us\n", summary.count, TASK_COUNT,
+		summary.min_us, summary.max_us);
+
+	LoopProfiler::reset();
+	CHECK(LoopProfiler::summarize(STAGE_SPI_TRANSACTION).count == 0);
+
+	finish_test("LoopProfilerTest");
+}
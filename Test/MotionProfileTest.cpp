@@ -0,0 +1,74 @@
+#include "MotionProfile.h"
+#include "TestCheck.h"
+
+// the profiled velocity stays within the range of the received commands and within the velocity limits
+
+static const uint32_t CONTROL_PERIOD_US = 1000;
+static const uint32_t PACKET_INTERVAL_US = 16667;      // 60 Hz
+
+static MotionProfile profile;
+static uint32_t now_us = 0;
+
+// runs the profile for the specified time, returns the lowest and highest forward velocity it produced
+static void run_profile(uint32_t duration_us, float& min_velocity, float& max_velocity)
+{
+	float body_velocity[MotionProfile::AXIS_COUNT];
+
+	for (uint32_t end_us = now_us + duration_us; now_us < end_us; now_us += CONTROL_PERIOD_US) {
+		profile.step(now_us, body_velocity);
+		min_velocity = body_velocity[0] < min_velocity ? body_velocity[0] : min_velocity;
+		max_velocity = body_velocity[0] > max_velocity ? body_velocity[0] : max_velocity;
+	}
+}
+
+int main()
+{
+	float min_velocity = 0.0f;
+	float max_velocity = 0.0f;
+	float body_velocity[MotionProfile::AXIS_COUNT];
+
+	// a stop command followed by packet loss ramps down to zero and not beyond
+	for (uint8_t packet = 0; packet < 30; packet++) {
+		profile.set_target(0.2f, 0.0f, 0.0f, now_us);
+		run_profile(PACKET_INTERVAL_US, min_velocity, max_velocity);
+	}
+	profile.set_target(0.0f, 0.0f, 0.0f, now_us);
+	min_velocity = 0.2f;
+	max_velocity = 0.0f;
+	run_profile(500000, min_velocity, max_velocity);
+	profile.step(now_us, body_velocity);
+	CHECK(min_velocity >= 0.0f);
+	CHECK(max_velocity <= 0.2f + 1e-6f);
+	CHECK_NEAR(body_velocity[0], 0.0, 1e-6);
+
+	// a step change does not overshoot the new command
+	min_velocity = 0.0f;
+	max_velocity = 0.0f;
+	for (uint8_t packet = 0; packet < 30; packet++) {
+		profile.set_target(packet < 5 ? 0.0f : 1.0f, 0.0f, 0.0f, now_us);
+		run_profile(PACKET_INTERVAL_US, min_velocity, max_velocity);
+	}
+	run_profile(500000, min_velocity, max_velocity);
+	CHECK(min_velocity >= 0.0f);
+	CHECK(max_velocity <= 1.0f + 1e-6f);
+	profile.step(now_us, body_velocity);
+	CHECK_NEAR(body_velocity[0], 1.0, 1e-6);
+
+	// commands beyond the motor limit are clamped to the velocity limit
+	MotionLimits limits = {};
+	for (uint8_t axis = 0; axis < MotionProfile::AXIS_COUNT; axis++) {
+		limits.max_velocity[axis] = 1.5f;
+		limits.max_acceleration[axis] = 4.0f;
+		limits.max_jerk[axis] = 80.0f;
+	}
+	profile.set_limits(limits);
+	max_velocity = 0.0f;
+	for (uint8_t packet = 0; packet < 60; packet++) {
+		profile.set_target(5.0f, 0.0f, 0.0f, now_us);
+		run_profile(PACKET_INTERVAL_US, min_velocity, max_velocity);
+	}
+	CHECK(max_velocity <= 1.5f + 1e-6f);
+	CHECK_NEAR(max_velocity, 1.5, 1e-6);
+
+	finish_test("MotionProfileTest");
+}
@@ -0,0 +1,64 @@
+#include "Robot.h"
+#include "CommandSchema.h"
+#include "HalSimulation.h"
+#include "TestCheck.h"
+
+// smoke test of the host build: a command sent over loopback udp reaches the simulated sonic boards
+
+static const uint16_t SERVER_PORT = 10011;
+static const uint32_t RECEIVE_TIMEOUT_MS = 1000;
+
+static SimulatedSonicBoard boards[SONIC_BOARD_TOPOLOGY::BOARD_COUNT];
+static Robot robot;
+
+// returns the rpm the simulated boards hold for a wheel
+static float simulated_wheel_rpm(uint8_t wheel)
+{
+	for (uint8_t module_id = 0; module_id < SONIC_BOARD_TOPOLOGY::BOARD_COUNT; module_id++) {
+		for (uint8_t motor_id = 0; motor_id < SONIC_BOARD_TOPOLOGY::BOARDS[module_id].motor_count; motor_id++) {
+			if (SONIC_BOARD_TOPOLOGY::BOARDS[module_id].motors[motor_id] == wheel) {
+				return boards[module_id].motors[motor_id].rpm;
+			}
+		}
+	}
+	return 0.0f;
+}
+
+int main()
+{
+	for (uint8_t module_id = 0; module_id < SONIC_BOARD_TOPOLOGY::BOARD_COUNT; module_id++) {
+		hal_sim::attach_sonic_board(SONIC_BOARD_TOPOLOGY::BOARDS[module_id].cs_pin, &boards[module_id]);
+	}
+
+	robot.init_robot("host", "host");
+
+	hal_sim::LoopbackUdpServer server;
+	CHECK(server.open(SERVER_PORT, INGESTION_SETTINGS::COMMAND_PORT));
+
+	Command command = Command_init_zero;
+	command.move.x = 0.5f;
+	command.move.y = -0.25f;
+	command.move.r = 1.0f;
+	command.action.dribble = 0.75f;
+
+	uint8_t datagram[COMMAND_SCHEMA::MAX_ENCODED_SIZE];
+	const uint32_t length = CommandEncoder::encode(command, 1, datagram, sizeof(datagram));
+	CHECK(length > 0);
+	CHECK(server.send_to_robot(datagram, length));
+
+	const uint32_t start_ms = hal::millis();
+	while (robot.get_ingestion_statistics().decoded_packets == 0 && hal::millis() - start_ms < RECEIVE_TIMEOUT_MS) {
+		robot.update_robot();
+		hal::delay_ms(1);
+	}
+	CHECK(robot.get_ingestion_statistics().decoded_packets == 1);
+
+	float expected_rpm[RobotKinematics::WHEEL_COUNT];
+	RobotKinematics::body_to_wheels(command.move.x, command.move.y, command.move.r, expected_rpm);
+	for (uint8_t wheel = 0; wheel < RobotKinematics::WHEEL_COUNT; wheel++) {
+		CHECK(expected_rpm[wheel] != 0.0f);
+		CHECK_NEAR(simulated_wheel_rpm(wheel), expected_rpm[wheel], 1e-3);
+	}
+
+	finish_test("RobotHostTest");
+}
@@ -0,0 +1,122 @@
+#include "SonicBoardController.h"
+#include "HalSimulation.h"
+#include "TestCheck.h"
+
+// bus cost of one update_motors() call with the legacy transactions and with the batched frames
+
+static SimulatedSonicBoard boards[SONIC_BOARD_TOPOLOGY::BOARD_COUNT];
+
+// returns the rpm the simulated boards hold for a wheel
+static float simulated_wheel_rpm(uint8_t wheel)
+{
+	for (uint8_t module_id = 0; module_id < SONIC_BOARD_TOPOLOGY::BOARD_COUNT; module_id++) {
+		for (uint8_t motor_id = 0; motor_id < SONIC_BOARD_TOPOLOGY::BOARDS[module_id].motor_count; motor_id++) {
+			if (SONIC_BOARD_TOPOLOGY::BOARDS[module_id].motors[motor_id] == wheel) {
+				return boards[module_id].motors[motor_id].rpm;
+			}
+		}
+	}
+	return 0.0f;
+}
+
+// runs one update and returns the bus cost of it, the boards must hold the commanded rpm afterwards
+static SpiBusStatistics measure_update(SonicBoardController& controller, float forward, float left, float rotation)
+{
+	controller.reset_bus_statistics();
+	controller.update_motors(forward, left, rotation);
+	const SpiBusStatistics statistics = controller.get_bus_statistics();
+
+	for (uint8_t wheel = 0; wheel < RobotKinematics::WHEEL_COUNT; wheel++) {
+		CHECK_NEAR(simulated_wheel_rpm(wheel), controller.get_commanded_rpm(wheel), 1e-3);
+	}
+	printf("  %lu transactions, %lu bytes, %lu cs toggles, %lu us bus delay\n",
+		static_cast<unsigned long>(statistics.transactions), static_cast<unsigned long>(statistics.bytes),
+		static_cast<unsigned long>(statistics.cs_toggles), static_cast<unsigned long>(statistics.delay_us));
+	return statistics;
+}
+
+int main()
+{
+	using namespace SONIC_BOARD_TOPOLOGY;
+
+	hal_sim::set_virtual_clock(true);
+	for (uint8_t module_id = 0; module_id < BOARD_COUNT; module_id++) {
+		hal_sim::attach_sonic_board(BOARDS[module_id].cs_pin, &boards[module_id]);
+	}
+
+	static SonicBoardController controller;
+	controller.init();
+	controller.set_write_coalescing(false, 0.0f, 0);
+
+	// a legacy write is two chip select transactions: [command][motor id], then the float
+	printf("legacy transactions:\n");
+	const SpiBusStatistics legacy = measure_update(controller, 0.4f, 0.1f, 0.5f);
+	const uint32_t legacy_delay_us = SPI_SETTINGS::CS_SETUP_DELAY_US + 2 * SPI_SETTINGS::CS_RELEASE_DELAY_US;
+	CHECK(legacy.transactions == MOTOR_COUNT);
+	CHECK(legacy.bytes == MOTOR_COUNT * 6u);
+	CHECK(legacy.cs_toggles == MOTOR_COUNT * 4u);
+	CHECK(legacy.delay_us == MOTOR_COUNT * legacy_delay_us);
+	// the bus time the control period is derived from, about 2.5 ms at the default clock
+	const uint32_t legacy_bus_time_us = legacy.delay_us + legacy.bytes * 8 * 1000000 / SPI_SETTINGS::SPI_FREQUENCY;
+	printf("  %lu us bus time\n", static_cast<unsigned long>(controller.get_update_bus_time_us()));
+	CHECK(controller.get_update_bus_time_us() == legacy_bus_time_us);
+
+	// a batched frame is one chip select transaction per board
+	printf("batched frames:\n");
+	controller.set_batched_frame_enabled(true);
+	const SpiBusStatistics batched = measure_update(controller, -0.3f, 0.2f, -0.5f);
+	const uint32_t frame_size = SONIC_BOARD_CONST::FRAME_HEADER_SIZE + SONIC_BOARD_CONST::MAX_FRAME_PAYLOAD_SIZE;
+	const uint32_t batched_delay_us = SPI_SETTINGS::CS_SETUP_DELAY_US + SPI_SETTINGS::CS_RELEASE_DELAY_US;
+	CHECK(batched.transactions == BOARD_COUNT);
+	CHECK(batched.bytes == BOARD_COUNT * frame_size);
+	CHECK(batched.cs_toggles == BOARD_COUNT * 2u);
+	CHECK(batched.delay_us == BOARD_COUNT * batched_delay_us);
+	const uint32_t batched_bus_time_us = batched.delay_us + batched.bytes * 8 * 1000000 / SPI_SETTINGS::SPI_FREQUENCY;
+	printf("  %lu us bus time\n", static_cast<unsigned long>(controller.get_update_bus_time_us()));
+	CHECK(controller.get_update_bus_time_us() == batched_bus_time_us);
+
+	CHECK(batched.cs_toggles < legacy.cs_toggles);
+	CHECK(batched.delay_us < legacy.delay_us);
+
+	// the batched frames carry the telemetry, so they are coalesced only while the telemetry is disabled
+	controller.set_write_coalescing(true, 0.0f, SONIC_BOARD_CONST::DEFAULT_REFRESH_PERIOD_MS);
+	controller.update_motors(0.5f, 0.5f, 0.5f);
+	controller.reset_bus_statistics();
+	controller.update_motors(0.5f, 0.5f, 0.5f);
+	CHECK(controller.get_bus_statistics().transactions == BOARD_COUNT);
+	CHECK(controller.get_bus_statistics().skipped_writes == 0);
+	controller.set_telemetry_enabled(false);
+	controller.update_motors(0.5f, 0.5f, 0.5f);
+	CHECK(controller.get_bus_statistics().transactions == BOARD_COUNT);
+	CHECK(controller.get_bus_statistics().skipped_writes == BOARD_COUNT);
+	controller.set_telemetry_enabled(true);
+	controller.set_write_coalescing(false, 0.0f, 0);
+
+	// the queue buffers at least two updates of every board, the frames that do not fit are dropped and sent later
+	SpiTransactionQueue& queue = controller.get_transaction_queue();
+	const uint32_t capacity = SPI_QUEUE_CONST::QUEUE_DEPTH - 1;
+	const uint32_t buffered_updates = capacity / BOARD_COUNT;
+	const uint32_t dropped_frames = BOARD_COUNT - capacity % BOARD_COUNT;
+
+	CHECK(buffered_updates >= SPI_QUEUE_CONST::FRAMES_PER_MODULE);
+	CHECK(controller.enable_async_transactions(false));
+	controller.reset_bus_statistics();
+	for (uint32_t update = 0; update < buffered_updates; update++) {
+		controller.update_motors(0.1f * update, 0.0f, 0.0f);
+	}
+	CHECK(controller.get_bus_statistics().dropped_frames == 0);
+	controller.update_motors(0.3f, 0.0f, 0.0f);
+	CHECK(controller.get_bus_statistics().dropped_frames == dropped_frames);
+	CHECK(queue.get_overrun_count() == 0);
+	CHECK(queue.service() == capacity);
+
+	// the dropped setpoints are written with the next update
+	controller.update_motors(0.3f, 0.0f, 0.0f);
+	CHECK(queue.service() == BOARD_COUNT);
+	CHECK(controller.get_bus_statistics().dropped_frames == dropped_frames);
+	for (uint8_t wheel = 0; wheel < RobotKinematics::WHEEL_COUNT; wheel++) {
+		CHECK_NEAR(simulated_wheel_rpm(wheel), controller.get_commanded_rpm(wheel), 1e-3);
+	}
+
+	finish_test("SonicBoardBusTest");
+}
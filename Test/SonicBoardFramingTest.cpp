@@ -0,0 +1,171 @@
+#include "SonicBoardController.h"
+#include "HalSimulation.h"
+#include "TestCheck.h"
+
+// framed protocol against bit errors injected by the simulated bus
+// 1. the clock negotiation stops below the rate where the frames get corrupted
+// 2. a frame rejected for its crc is resent, even when the write coalescing would skip it
+// 3. repeated errors step the spi clock down
+// 4. boards without the framed protocol, or without an answer, fall back to the unframed frames at the default clock
+
+static const uint32_t EVERY_BYTE = 1000000;          // corrupted bytes per million
+static const uint32_t MAX_STEP_DOWN_UPDATES = 100;
+
+static SimulatedSonicBoard boards[SONIC_BOARD_TOPOLOGY::BOARD_COUNT];
+static SonicBoardController controller;
+
+// returns true if the simulated boards hold the commanded rpm of every wheel
+static bool is_commanded_rpm_held()
+{
+	for (uint8_t module_id = 0; module_id < SONIC_BOARD_TOPOLOGY::BOARD_COUNT; module_id++) {
+		for (uint8_t motor_id = 0; motor_id < SONIC_BOARD_TOPOLOGY::BOARDS[module_id].motor_count; motor_id++) {
+			const uint8_t motor = SONIC_BOARD_TOPOLOGY::BOARDS[module_id].motors[motor_id];
+			if (boards[module_id].motors[motor_id].rpm != controller.get_commanded_rpm(motor)) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+static uint32_t count_link_errors()
+{
+	uint32_t errors = 0;
+	for (uint8_t module_id = 0; module_id < SONIC_BOARD_TOPOLOGY::BOARD_COUNT; module_id++) {
+		const BoardLinkStatistics link = controller.get_link_statistics(module_id);
+		errors += link.rx_errors + link.tx_errors;
+	}
+	return errors;
+}
+
+static uint32_t count_clock_backoffs()
+{
+	uint32_t backoffs = 0;
+	for (uint8_t module_id = 0; module_id < SONIC_BOARD_TOPOLOGY::BOARD_COUNT; module_id++) {
+		backoffs += controller.get_link_statistics(module_id).clock_backoffs;
+	}
+	return backoffs;
+}
+
+static void test_clock_negotiation()
+{
+	hal_sim::set_spi_signal_integrity(2000000, EVERY_BYTE);
+	controller.set_batched_frame_enabled(true);
+	controller.set_framed_protocol_enabled(true);
+	controller.init();
+
+	printf("negotiated spi clock: %lu Hz\n", static_cast<unsigned long>(controller.get_spi_frequency()));
+	CHECK(controller.get_spi_frequency() == 2000000);
+	CHECK(hal_sim::get_spi_frequency() == 2000000);
+
+	controller.update_motors(0.4f, 0.0f, 0.2f);
+	CHECK(is_commanded_rpm_held());
+}
+
+static void test_crc_mismatch_is_resent()
+{
+	controller.set_telemetry_enabled(false);
+	controller.set_write_coalescing(true, 0.0f, SONIC_BOARD_CONST::DEFAULT_REFRESH_PERIOD_MS);
+	controller.update_motors(0.4f, 0.0f, 0.2f);
+	CHECK(is_commanded_rpm_held());
+
+	// the boards reject the corrupted frames and keep the previous rpm
+	const uint32_t errors = count_link_errors();
+	hal_sim::set_spi_signal_integrity(1000000, EVERY_BYTE);
+	controller.update_motors(-0.4f, 0.1f, 0.0f);
+	CHECK(!is_commanded_rpm_held());
+	CHECK(count_link_errors() == errors + SONIC_BOARD_TOPOLOGY::BOARD_COUNT);
+
+	// the coalescing would skip the unchanged setpoints, the resend writes them
+	hal_sim::set_spi_signal_integrity(2000000, EVERY_BYTE);
+	controller.reset_bus_statistics();
+	controller.update_motors(-0.4f, 0.1f, 0.0f);
+	CHECK(controller.get_bus_statistics().transactions == SONIC_BOARD_TOPOLOGY::BOARD_COUNT);
+	CHECK(controller.get_bus_statistics().skipped_writes == 0);
+	CHECK(is_commanded_rpm_held());
+
+	// a single corrupted update does not lower the clock
+	CHECK(controller.get_spi_frequency() == 2000000);
+	CHECK(count_clock_backoffs() == 0);
+
+	controller.set_write_coalescing(false, 0.0f, 0);
+	controller.set_telemetry_enabled(true);
+}
+
+static void test_repeated_errors_step_clock_down()
+{
+	hal_sim::set_spi_signal_integrity(500000, EVERY_BYTE);
+
+	uint32_t updates = 0;
+	while (controller.get_spi_frequency() > 500000 && updates < MAX_STEP_DOWN_UPDATES) {
+		controller.update_motors(0.1f * (updates % 5), 0.0f, 0.0f);
+		updates++;
+	}
+	printf("spi clock after %lu corrupted updates: %lu Hz\n", static_cast<unsigned long>(updates),
+		static_cast<unsigned long>(controller.get_spi_frequency()));
+	CHECK(controller.get_spi_frequency() == 500000);
+	CHECK(hal_sim::get_spi_frequency() == 500000);
+	CHECK(count_clock_backoffs() == 2);
+
+	// at the clean rate the errors stop, the resent setpoints get through
+	controller.update_motors(0.3f, -0.2f, 0.1f);
+	const uint32_t errors = count_link_errors();
+	controller.update_motors(0.3f, -0.2f, 0.1f);
+	CHECK(count_link_errors() == errors);
+	CHECK(is_commanded_rpm_held());
+	CHECK(count_clock_backoffs() == 2);
+}
+
+// the negotiation must fail and leave the unframed frames at the default clock, which the boards still execute
+static void check_fallback(const char* name)
+{
+	controller.set_framed_protocol_enabled(true);
+	const bool is_negotiated = controller.negotiate_spi_clock();
+	printf("%s: framed protocol %s, spi clock %lu Hz\n", name, is_negotiated ? "negotiated" : "disabled",
+		static_cast<unsigned long>(controller.get_spi_frequency()));
+	CHECK(!is_negotiated);
+	CHECK(controller.get_spi_frequency() == SPI_SETTINGS::SPI_FREQUENCY);
+	CHECK(hal_sim::get_spi_frequency() == SPI_SETTINGS::SPI_FREQUENCY);
+}
+
+static void test_fallback_without_framing_support()
+{
+	using namespace SONIC_BOARD_TOPOLOGY;
+
+	hal_sim::set_spi_signal_integrity(0, 0);
+
+	// an older firmware takes the framed frames for garbage and clocks out no framed reply
+	controller.set_framed_protocol_enabled(false);
+	controller.update_motors(0.0f, 0.0f, 0.0f);
+	for (uint8_t module_id = 0; module_id < BOARD_COUNT; module_id++) {
+		boards[module_id].is_framed_protocol_supported = false;
+	}
+	check_fallback("boards without the framed protocol");
+	controller.update_motors(0.2f, 0.3f, -0.4f);
+	CHECK(is_commanded_rpm_held());
+	for (uint8_t module_id = 0; module_id < BOARD_COUNT; module_id++) {
+		boards[module_id].is_framed_protocol_supported = true;
+	}
+
+	// a board that does not answer at all, the bus reads 0xFF
+	hal_sim::attach_sonic_board(BOARDS[BOARD_COUNT - 1].cs_pin, nullptr);
+	check_fallback("board without an answer");
+	hal_sim::attach_sonic_board(BOARDS[BOARD_COUNT - 1].cs_pin, &boards[BOARD_COUNT - 1]);
+	controller.update_motors(-0.2f, 0.1f, 0.4f);
+	CHECK(is_commanded_rpm_held());
+}
+
+int main()
+{
+	for (uint8_t module_id = 0; module_id < SONIC_BOARD_TOPOLOGY::BOARD_COUNT; module_id++) {
+		hal_sim::attach_sonic_board(SONIC_BOARD_TOPOLOGY::BOARDS[module_id].cs_pin, &boards[module_id]);
+	}
+	hal_sim::set_virtual_clock(true);
+
+	test_clock_negotiation();
+	test_crc_mismatch_is_resent();
+	test_repeated_errors_step_clock_down();
+	test_fallback_without_framing_support();
+
+	finish_test("SonicBoardFramingTest");
+}
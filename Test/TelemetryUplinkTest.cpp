@@ -0,0 +1,164 @@
+#include "TelemetryUplink.h"
+#include "TestCheck.h"
+#include <string.h>
+
+// telemetry datagram format: byte layout of the header and the sample fields, round trip, sequence wrap
+// and rejection of datagrams the host tools cannot read
+
+static const uint8_t SAMPLE_COUNT = TELEMETRY_SETTINGS::MAX_SAMPLES_PER_DATAGRAM;
+
+// every field gets a value that differs between samples and wheels, within the range of its fixed point field
+static TelemetrySample make_sample(uint8_t index)
+{
+	TelemetrySample sample = {};
+
+	sample.timestamp_us = 0xF0000000u + index * 1000003u;
+	for (uint8_t wheel = 0; wheel < 4; wheel++) {
+		sample.commanded_rpm[wheel] = -2000.0f + index * 100.3f + wheel * 7.1f;
+		sample.measured_rpm[wheel] = 1500.0f - index * 90.7f - wheel * 3.3f;
+		sample.encoder_counter[wheel] = -1000000.0f + index * 12345.0f + wheel;
+		sample.temperature[wheel] = 25.0f + index * 1.37f + wheel * 0.11f;
+	}
+	sample.loop_time_us = 100 + index * 97;
+	return sample;
+}
+
+static void test_byte_layout()
+{
+	TelemetrySample sample = {};
+	sample.timestamp_us = 0x12345678;
+	sample.commanded_rpm[0] = 1.0f;
+	sample.commanded_rpm[1] = -1.0f;
+	sample.measured_rpm[3] = 3276.7f;
+	sample.encoder_counter[0] = -2.0f;
+	sample.temperature[2] = 40.96f;
+	sample.loop_time_us = 0x0102;
+
+	uint8_t datagram[TelemetryCodec::MAX_DATAGRAM_SIZE];
+	const uint32_t size = TelemetryCodec::encode(&sample, 1, 0x0A0B0C0D, 0x01020304, datagram, sizeof(datagram));
+	CHECK(size == static_cast<uint32_t>(TelemetryCodec::HEADER_SIZE + TelemetryCodec::SAMPLE_SIZE));
+
+	// [magic u16][version u8][sample count u8][datagram sequence u32][dropped samples u32], little endian
+	const uint8_t header[TelemetryCodec::HEADER_SIZE] = { 0x54, 0x52, TELEMETRY_SETTINGS::PROTOCOL_VERSION, 1,
+		0x0D, 0x0C, 0x0B, 0x0A, 0x04, 0x03, 0x02, 0x01 };
+	CHECK(memcmp(datagram, header, sizeof(header)) == 0);
+
+	// [timestamp u32][commanded rpm x 4 i16][measured rpm x 4 i16][encoder counter x 4 i32][temperature x 4 i16][loop time u16]
+	const uint8_t* fields = datagram + TelemetryCodec::HEADER_SIZE;
+	const uint8_t timestamp[] = { 0x78, 0x56, 0x34, 0x12 };
+	const uint8_t commanded_rpm[] = { 0x0A, 0x00, 0xF6, 0xFF, 0x00, 0x00, 0x00, 0x00 };
+	const uint8_t measured_rpm[] = { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xFF, 0x7F };
+	const uint8_t encoder_counter[] = { 0xFE, 0xFF, 0xFF, 0xFF, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 };
+	const uint8_t temperature[] = { 0x00, 0x00, 0x00, 0x00, 0x00, 0x10, 0x00, 0x00 };
+	const uint8_t loop_time[] = { 0x02, 0x01 };
+
+	CHECK(memcmp(fields, timestamp, sizeof(timestamp)) == 0);
+	fields += sizeof(timestamp);
+	CHECK(memcmp(fields, commanded_rpm, sizeof(commanded_rpm)) == 0);
+	fields += sizeof(commanded_rpm);
+	CHECK(memcmp(fields, measured_rpm, sizeof(measured_rpm)) == 0);
+	fields += sizeof(measured_rpm);
+	CHECK(memcmp(fields, encoder_counter, sizeof(encoder_counter)) == 0);
+	fields += sizeof(encoder_counter);
+	CHECK(memcmp(fields, temperature, sizeof(temperature)) == 0);
+	fields += sizeof(temperature);
+	CHECK(memcmp(fields, loop_time, sizeof(loop_time)) == 0);
+	fields += sizeof(loop_time);
+	CHECK(fields == datagram + size);
+}
+
+static void test_round_trip()
+{
+	TelemetrySample samples[SAMPLE_COUNT];
+	for (uint8_t i = 0; i < SAMPLE_COUNT; i++) {
+		samples[i] = make_sample(i);
+	}
+
+	uint8_t datagram[TelemetryCodec::MAX_DATAGRAM_SIZE];
+	const uint32_t size = TelemetryCodec::encode(samples, SAMPLE_COUNT, 77, 5, datagram, sizeof(datagram));
+	CHECK(size == TelemetryCodec::MAX_DATAGRAM_SIZE);
+
+	TelemetrySample decoded[SAMPLE_COUNT] = {};
+	uint32_t sequence = 0;
+	uint32_t dropped_samples = 0;
+	CHECK(TelemetryCodec::decode(datagram, size, decoded, SAMPLE_COUNT, sequence, dropped_samples) == SAMPLE_COUNT);
+	CHECK(sequence == 77);
+	CHECK(dropped_samples == 5);
+
+	// within half a step of the fixed point fields
+	for (uint8_t i = 0; i < SAMPLE_COUNT; i++) {
+		CHECK(decoded[i].timestamp_us == samples[i].timestamp_us);
+		for (uint8_t wheel = 0; wheel < 4; wheel++) {
+			CHECK_NEAR(decoded[i].commanded_rpm[wheel], samples[i].commanded_rpm[wheel], 0.05);
+			CHECK_NEAR(decoded[i].measured_rpm[wheel], samples[i].measured_rpm[wheel], 0.05);
+			CHECK_NEAR(decoded[i].encoder_counter[wheel], samples[i].encoder_counter[wheel], 0.5);
+			CHECK_NEAR(decoded[i].temperature[wheel], samples[i].temperature[wheel], 0.005);
+		}
+		CHECK(decoded[i].loop_time_us == samples[i].loop_time_us);
+	}
+
+	// values outside the fields saturate instead of wrapping around
+	TelemetrySample extreme = make_sample(0);
+	extreme.commanded_rpm[0] = 1e6f;
+	extreme.measured_rpm[1] = -1e6f;
+	extreme.temperature[2] = 1000.0f;
+	extreme.loop_time_us = 100000;
+	CHECK(TelemetryCodec::encode(&extreme, 1, 0, 0, datagram, sizeof(datagram)) > 0);
+	CHECK(TelemetryCodec::decode(datagram, sizeof(datagram), decoded, 1, sequence, dropped_samples) == 1);
+	CHECK_NEAR(decoded[0].commanded_rpm[0], 3276.7, 1e-3);
+	CHECK_NEAR(decoded[0].measured_rpm[1], -3276.7, 1e-3);
+	CHECK_NEAR(decoded[0].temperature[2], 327.67, 1e-3);
+	CHECK(decoded[0].loop_time_us == 0xFFFF);
+}
+
+static void test_sequence_wrap()
+{
+	const TelemetrySample sample = make_sample(1);
+	const uint32_t sequences[] = { 0xFFFFFFFEu, 0xFFFFFFFFu, 0, 1 };
+	uint8_t datagram[TelemetryCodec::MAX_DATAGRAM_SIZE];
+	TelemetrySample decoded = {};
+	uint32_t previous_sequence = 0;
+
+	for (uint8_t i = 0; i < sizeof(sequences) / sizeof(sequences[0]); i++) {
+		uint32_t sequence = 0;
+		uint32_t dropped_samples = 0;
+		const uint32_t size = TelemetryCodec::encode(&sample, 1, sequences[i], 0xFFFFFFFFu, datagram, sizeof(datagram));
+
+		CHECK(TelemetryCodec::decode(datagram, size, &decoded, 1, sequence, dropped_samples) == 1);
+		CHECK(sequence == sequences[i]);
+		CHECK(dropped_samples == 0xFFFFFFFFu);
+		// the receiver counts lost datagrams by the difference, which stays 1 across the wrap
+		CHECK(i == 0 || sequence - previous_sequence == 1);
+		previous_sequence = sequence;
+	}
+}
+
+static void test_rejected_datagrams()
+{
+	const TelemetrySample sample = make_sample(2);
+	uint8_t datagram[TelemetryCodec::MAX_DATAGRAM_SIZE];
+	TelemetrySample decoded = {};
+	uint32_t sequence = 0;
+	uint32_t dropped_samples = 0;
+
+	const uint32_t size = TelemetryCodec::encode(&sample, 1, 3, 0, datagram, sizeof(datagram));
+	CHECK(TelemetryCodec::encode(&sample, 1, 3, 0, datagram, size - 1) == 0);
+	CHECK(TelemetryCodec::decode(datagram, size - 1, &decoded, 1, sequence, dropped_samples) == 0);
+	CHECK(TelemetryCodec::decode(datagram, size, &decoded, 0, sequence, dropped_samples) == 0);
+
+	datagram[2] = TELEMETRY_SETTINGS::PROTOCOL_VERSION + 1;
+	CHECK(TelemetryCodec::decode(datagram, size, &decoded, 1, sequence, dropped_samples) == 0);
+	datagram[2] = TELEMETRY_SETTINGS::PROTOCOL_VERSION;
+	datagram[0] ^= 0xFF;
+	CHECK(TelemetryCodec::decode(datagram, size, &decoded, 1, sequence, dropped_samples) == 0);
+}
+
+int main()
+{
+	test_byte_layout();
+	test_round_trip();
+	test_sequence_wrap();
+	test_rejected_datagrams();
+
+	finish_test("TelemetryUplinkTest");
+}
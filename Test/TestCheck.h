@@ -0,0 +1,37 @@
+#pragma once
+#include <stdio.h>
+#include <stdlib.h>
+
+/***********************************************************************************************
+* minimal checks of the host tests
+* 1. CHECK() logs a failed condition and counts it, the test goes on
+* 2. finish_test() reports the result and ends the process with a non-zero status on failure,
+*    without running the static destructors the robot tasks may still be using
+************************************************************************************************/
+static int test_failures = 0;
+
+#define CHECK(condition) \
+	do { \
+		if (!(condition)) { \
+			printf("%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #condition); \
+			test_failures++; \
+		} \
+	} while (0)
+
+#define CHECK_NEAR(value, expected, tolerance) \
+	do { \
+		const double check_value = (value); \
+		const double check_expected = (expected); \
+		if (check_value - check_expected > (tolerance) || check_expected - check_value > (tolerance)) { \
+			printf("%s:%d: CHECK_NEAR failed: %s = %g, expected %g\n", __FILE__, __LINE__, #value, \
+				check_value, check_expected); \
+			test_failures++; \
+		} \
+	} while (0)
+
+static inline void finish_test(const char* name)
+{
+	printf("%s: %s (%d failed checks)\n", name, test_failures ? "FAILED" : "passed", test_failures);
+	fflush(stdout);
+	_Exit(test_failures ? EXIT_FAILURE : EXIT_SUCCESS);
+}
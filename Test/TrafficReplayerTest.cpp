@@ -0,0 +1,70 @@
+#include "TrafficReplayer.h"
+#include "CommandSchema.h"
+#include "HalSimulation.h"
+#include "TestCheck.h"
+
+// a replay delivers every recorded datagram, also the ones beyond the drain limit of a cycle,
+// and returns instead of spinning when the robot does not receive from the replayer
+
+static const char* const RECORDING_PATH = "TrafficReplayerTest.bin";
+static const uint32_t DRAINS = 3;
+static const uint32_t DATAGRAMS_PER_DRAIN = INGESTION_SETTINGS::MAX_DRAINED_PACKETS + 4;
+static const uint32_t DRAIN_PERIOD_US = 20000;
+
+// a source that never has a datagram
+class SilentDatagramSource : public DatagramSource
+{
+public:
+	uint32_t receive_datagram(uint8_t*, uint32_t) override
+	{
+		return 0;
+	}
+};
+
+static SimulatedSonicBoard boards[SONIC_BOARD_TOPOLOGY::BOARD_COUNT];
+static TrafficRecorder recorder;
+static TrafficReplayer replayer;
+static SilentDatagramSource silent_source;
+static Robot replay_robot;
+static Robot unwired_robot;
+
+int main()
+{
+	for (uint8_t module_id = 0; module_id < SONIC_BOARD_TOPOLOGY::BOARD_COUNT; module_id++) {
+		hal_sim::attach_sonic_board(SONIC_BOARD_TOPOLOGY::BOARDS[module_id].cs_pin, &boards[module_id]);
+	}
+
+	// every drain holds more datagrams than the robot receives in one cycle
+	CHECK(recorder.start());
+	for (uint32_t drain = 0; drain < DRAINS; drain++) {
+		for (uint32_t datagram = 0; datagram < DATAGRAMS_PER_DRAIN; datagram++) {
+			uint8_t payload[COMMAND_SCHEMA::MAX_ENCODED_SIZE];
+			Command command = Command_init_zero;
+			command.move.x = 0.1f;
+			const uint32_t length = CommandEncoder::encode(command, drain * DATAGRAMS_PER_DRAIN + datagram + 1,
+				payload, sizeof(payload));
+			recorder.record_udp_datagram(drain * DRAIN_PERIOD_US, payload, length);
+		}
+	}
+	recorder.stop();
+	CHECK(recorder.flush(RECORDING_PATH));
+	CHECK(replayer.load(RECORDING_PATH));
+	CHECK(replayer.get_datagram_count() == DRAINS * DATAGRAMS_PER_DRAIN);
+
+	replay_robot.init_replay(replayer);
+	ReplayStatistics statistics = replayer.run(replay_robot, REPLAY_FAST);
+	CHECK(statistics.datagrams == DRAINS * DATAGRAMS_PER_DRAIN);
+	CHECK(statistics.undelivered_datagrams == 0);
+	CHECK(statistics.drains == DRAINS);
+	CHECK(replay_robot.get_ingestion_statistics().received_packets == DRAINS * DATAGRAMS_PER_DRAIN);
+
+	// the robot takes its datagrams from another source, the datagrams left after the drains are never received
+	unwired_robot.init_replay(silent_source);
+	statistics = replayer.run(unwired_robot, REPLAY_FAST);
+	CHECK(statistics.datagrams == DRAINS * DATAGRAMS_PER_DRAIN);
+	CHECK(statistics.undelivered_datagrams == DRAINS * DATAGRAMS_PER_DRAIN);
+	CHECK(unwired_robot.get_ingestion_statistics().received_packets == 0);
+
+	remove(RECORDING_PATH);
+	finish_test("TrafficReplayerTest");
+}